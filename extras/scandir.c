@@ -27,6 +27,7 @@
  * scandir.c -- if scandir() is missing, make a replacement
  */
 
+#include "config.h"
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -20,6 +20,7 @@
 
 /* $Id: access.c,v 1.1.2.6 2005/02/22 14:11:29 jnelson Exp $ */
 
+#include "config.h"
 #include <string.h>
 #include <stdlib.h>
 #include <fnmatch.h>
@@ -28,7 +28,8 @@
 struct alias {
     char *fakename;             /* URI path to file */
     char *realname;             /* Actual path to file */
-    enum ALIAS type;            /* ALIAS, SCRIPTALIAS, REDIRECT */
+    enum ALIAS type;            /* ALIAS, SCRIPTALIAS, REDIRECT, TCLALIAS,
+                                 * PROXYALIAS */
     unsigned int fake_len;      /* strlen of fakename */
     unsigned int real_len;      /* strlen of realname */
     struct alias *next;
@@ -247,8 +248,10 @@ int translate_uri(request * req)
     uri_len = strlen(req->request_uri);
     current = find_alias(req->request_uri, uri_len);
     if (current) {
-        if (current->type == SCRIPTALIAS) /* Script */
+        if (current->type == SCRIPTALIAS || current->type == TCLALIAS)
             return init_script_alias(req, current, uri_len);
+        if (current->type == PROXYALIAS)
+            return proxy_route(req, current->fakename);
 
         /* not a script alias, therefore begin filling in data */
         if (current->real_len + uri_len - current->fake_len + 1 > sizeof(buffer)) {
@@ -278,6 +281,7 @@ int translate_uri(request * req)
                 boa_perror(req, "unable to strdup buffer onto req->pathname");
                 return 0;
             }
+            req->root_len = current->real_len;
             return 1;
         }
     }
@@ -331,7 +335,23 @@ int translate_uri(request * req)
             memcpy(buffer + l1 + 1, user_dir, l2 + 1);
             if (p)
                 memcpy(buffer + l1 + 1 + l2, p, l3 + 1);
+            req->root_len = l1 + 1 + l2;
         }
+    } else if ((req->pack_entry_var =
+                pack_lookup(req->request_uri)) != NULL) {
+        /* in the DocumentPack: nothing to translate, and it is no CGI */
+        if (req->method == M_POST) {
+            log_error_doc(req);
+            fputs("POST to non-script disallowed.\n", stderr);
+            send_r_bad_request(req);
+            return 0;
+        }
+        req->pathname = strdup(req->request_uri);
+        if (!req->pathname) {
+            boa_perror(req, "Could not strdup request_uri for req->pathname!");
+            return 0;
+        }
+        return 1;
     } else if (vhost_root) {
         /* no aliasing, no userdir... */
         unsigned int l1, l2, l3, l4, l5;
@@ -365,6 +385,7 @@ int translate_uri(request * req)
         /* request_uri starts with '/' */
         memcpy(buffer + l1 + 1 + l2 + 1 + l3 + 1 + l4, req->request_uri,
                l5 + 1);
+        req->root_len = l1 + 1 + l2 + 1 + l3 + 1 + l4;
     } else if (document_root) {
         /* no aliasing, no userdir... */
         unsigned int l1, l2, l3;
@@ -389,8 +410,11 @@ int translate_uri(request * req)
             buffer[l1] = '/';
             memcpy(buffer + l1 + 1, req->local_ip_addr, l3);
             memcpy(buffer + l1 + 1 + l3, req->request_uri, l2 + 1);
-        } else
+            req->root_len = l1 + 1 + l3;
+        } else {
             memcpy(buffer + l1, req->request_uri, l2 + 1);
+            req->root_len = l1;
+        }
     } else {
         /* not aliased.  not userdir.  not part of document_root.  BAIL */
         send_r_not_found(req);
@@ -458,6 +482,7 @@ static int init_script_alias(request * req, alias * current1, unsigned int uri_l
 {
     static char pathname[MAX_HEADER_LENGTH + 1];
     struct stat statbuf;
+    int script_mode = R_OK | X_OK;
 
     int i = 0;
     char c;
@@ -514,7 +539,12 @@ static int init_script_alias(request * req, alias * current1, unsigned int uri_l
             "%s:%d - pathname in init_script_alias is: \"%s\" (\"%s\")\n",
             __FILE__, __LINE__, pathname, pathname + current1->real_len);
 #endif
-    if (strncmp("nph-", pathname + current1->real_len, 4) == 0
+    if (current1->type == TCLALIAS) {
+        /* run in the server, and only read */
+        req->cgi_type = CGI;
+        req->tcl_alias = 1;
+        script_mode = R_OK;
+    } else if (strncmp("nph-", pathname + current1->real_len, 4) == 0
         || (req->http_version == HTTP09))
         req->cgi_type = NPH;
     else
@@ -542,10 +572,10 @@ static int init_script_alias(request * req, alias * current1, unsigned int uri_l
             /* is it a dir? */
             if (!S_ISDIR(statbuf.st_mode)) {
                 /* check access */
-                /* the file must be readable+executable by at least
-                 * u,g,or o 
+                /* the file must be readable+executable (just readable,
+                 * for a TclAlias) by at least u,g,or o
                  */
-                if (!S_ISREG(statbuf.st_mode) || access(pathname, R_OK|X_OK)) {
+                if (!S_ISREG(statbuf.st_mode) || access(pathname, script_mode)) {
                     send_r_forbidden(req);
                     return 0;
                 }
@@ -577,7 +607,7 @@ static int init_script_alias(request * req, alias * current1, unsigned int uri_l
             /* the file must be readable+executable by at least
              * u,g,or o 
              */
-            if (!S_ISREG(statbuf.st_mode) || access(pathname, R_OK|X_OK)) {
+            if (!S_ISREG(statbuf.st_mode) || access(pathname, script_mode)) {
                 send_r_forbidden(req);
                 return 0;
             }
@@ -43,15 +43,12 @@ extern const char *config_file_name;
 static void usage(const char *programname);
 static void parse_commandline(int argc, char *argv[]);
 static void fixup_server_root(void);
-static int create_server_socket(void);
 static void drop_privs(void);
 
-static int sock_opt = 1;
 static int do_fork = 1;
 
 int main(int argc, char *argv[])
 {
-    int server_s;               /* boa socket */
     pid_t pid;
 
     /* set umask to u+rw, u-x, go-rwx */
@@ -85,9 +82,10 @@ int main(int argc, char *argv[])
     read_config_files();
     create_common_env();
     open_logs();
-    server_s = create_server_socket();
+    listen_open();
     init_signals();
     build_needs_escape();
+    pack_init();
 
     /* background ourself */
     if (do_fork) {
@@ -129,7 +127,14 @@ int main(int argc, char *argv[])
     status.errors = 0;
 
     start_time = current_time;
-    loop(server_s);
+    resolve_init();
+    negative_cache_init();
+    fcgi_init();
+#ifdef USE_IO_THREADS
+    io_pool_init();
+#endif
+    warmup();
+    loop();
     return 0;
 }
 
@@ -201,43 +206,6 @@ static void parse_commandline(int argc, char *argv[])
     }
 }
 
-static int create_server_socket(void)
-{
-    int server_s;
-
-    server_s = socket(SERVER_PF, SOCK_STREAM, IPPROTO_TCP);
-    if (server_s == -1) {
-        DIE("unable to create socket");
-    }
-
-    /* server socket is nonblocking */
-    if (set_nonblock_fd(server_s) == -1) {
-        DIE("fcntl: unable to set server socket to nonblocking");
-    }
-
-    /* close server socket on exec so CGIs can't write to it */
-    if (fcntl(server_s, F_SETFD, 1) == -1) {
-        DIE("can't set close-on-exec on server socket!");
-    }
-
-    /* reuse socket addr */
-    if ((setsockopt(server_s, SOL_SOCKET, SO_REUSEADDR, (void *) &sock_opt,
-                    sizeof (sock_opt))) == -1) {
-        DIE("setsockopt");
-    }
-
-    /* Internet family-specific code encapsulated in bind_server()  */
-    if (bind_server(server_s, server_ip, server_port) == -1) {
-        DIE("unable to bind");
-    }
-
-    /* listen: large number just in case your kernel is nicely tweaked */
-    if (listen(server_s, backlog) == -1) {
-        DIE("unable to listen");
-    }
-    return server_s;
-}
-
 static void drop_privs(void)
 {
     /* give away our privs if we can */
@@ -37,7 +37,6 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <limits.h>             /* OPEN_MAX */
-#include <setjmp.h>
 
 #include <netinet/in.h>
 
@@ -45,6 +44,7 @@
 #include <sys/types.h>          /* socket, bind, accept */
 #include <sys/socket.h>         /* socket, bind, accept, setsockopt, */
 #include <sys/stat.h>           /* open */
+#include <sys/uio.h>            /* writev */
 
 #include "compat.h"             /* oh what fun is porting */
 #include "defines.h"
@@ -103,8 +103,8 @@ int write_body(request * req);
 
 /* request */
 request *new_request(void);
-void get_request(int);
-void process_requests(int server_s);
+void get_request(void);
+void process_requests(void);
 int process_header_end(request * req);
 int process_header_line(request * req);
 int process_logline(request * req);
@@ -114,14 +114,15 @@ void free_requests(void);
 
 /* response */
 const char *http_ver_string(enum HTTP_VERSION ver);
+const char *document_type(request * req, const char **charset);
 void print_ka_phrase(request * req);
 void print_content_type(request * req);
 void print_content_length(request * req);
 void print_last_modified(request * req);
+void print_etag(request * req);
 void print_http_headers(request * req);
 void print_content_range(request * req);
-void print_partial_content_continue(request * req);
-void print_partial_content_done(request * req);
+int multipart_header(request * req, Range * r, char *buf, unsigned int len);
 int complete_response(request *req);
 
 void send_r_continue(request * req); /* 100 */
@@ -149,12 +150,15 @@ void send_r_bad_version(request * req, const char * version); /* 505 */
 void create_common_env(void);
 void add_to_common_env(char *key, char *value);
 void clear_common_env(void);
+char **common_env(void);
 int add_cgi_env(request * req, const char *key, const char *value, int http_prefix);
 int init_cgi(request * req);
+int cgi_resume(request * req);
 
 /* signals */
 void init_signals(void);
 void reset_signals(void);
+void signal_collect(void);
 void sighup_run(void);
 void sigchld_run(void);
 void sigalrm_run(void);
@@ -165,10 +169,12 @@ void sigterm_stage2_run(void);
 void clean_pathname(char *pathname);
 char *get_commonlog_time(void);
 void rfc822_time_buf(char *buf, time_t s);
-char *simple_itoa(unsigned int i);
+char *simple_itoa(unsigned long long i);
 int boa_atoi(const char *s);
+off_t boa_atoo(const char *s);
 int month2int(const char *month);
 int modified_since(time_t * mtime, const char *if_modified_since);
+time_t http_date(const char *date);
 int unescape_uri(char *uri, char **query_string);
 int create_temporary_file(short want_unlink, char *storage, unsigned int size);
 int real_set_block_fd(int fd);
@@ -187,6 +193,7 @@ void reset_output_buffer(request * req);
 int req_write_escape_http(request * req, const char *msg);
 int req_write_escape_html(request * req, const char *msg);
 int req_flush(request * req);
+int req_flush_more(request * req);
 char *escape_uri(const char *uri);
 char *escape_string(const char *inp, char *buf);
 
@@ -197,6 +204,111 @@ void timestamp(void);
 struct mmap_entry *find_mmap(int data_fd, struct stat *s);
 void release_mmap(struct mmap_entry *e);
 
+/* index_cache */
+struct index_entry *find_index(request * req, struct stat *s);
+char *index_head_html(request * req, unsigned int *len);
+void release_index(struct index_entry *e);
+
+/* cache_control */
+void cache_policy_add(int kind, const char *key, const char *value);
+void print_cache_control(request * req);
+void dump_cache_policies(void);
+
+/* warmup */
+void warmup(void);
+
+/* cgi_limit */
+void cgi_limit_add(const char *prefix, const char *max);
+int cgi_admit(request * req);
+void cgi_started(request * req, pid_t pid, int piped);
+void cgi_reaped(pid_t pid, int status);
+int cgi_output_ok(request * req);
+void cgi_forget(request * req);
+int cgi_watching(void);
+void cgi_watchdog(void);
+
+/* cgi_cache */
+void cgi_cache_add(const char *prefix, const char *max_age);
+void cgi_cache_key_add(const char *header);
+int cgi_cache_lookup(request * req);
+void cgi_cache_header(request * req, const char *start, const char *end);
+void cgi_cache_body(request * req, const char *buf, unsigned int len);
+void cgi_cache_finish(request * req);
+void cgi_cache_failed(request * req);
+void cgi_cache_forget(request * req);
+void dump_cgi_cache(void);
+
+/* cgi_gzip */
+void cgi_gzip_type_add(const char *type);
+int cgi_gzip_start(request * req, char *start, char *end);
+void cgi_gzip_finish(request * req);
+int cgi_gzip_flush(request * req);
+int cgi_gzip_write(request * req);
+void cgi_gzip_free(request * req);
+void dump_cgi_gzip(void);
+
+/* tcl_handler */
+void tcl_alias_add(const char *fakename, const char *realname);
+int tcl_run(request * req);
+int tcl_read(request * req, char *buf, unsigned int len);
+void tcl_forget(request * req);
+void dump_tcl(void);
+
+/* fastcgi */
+void fcgi_add_server(const char *prefix, const char *socket);
+void fcgi_add_spawn(const char *socket, const char *program);
+void fcgi_init(void);
+void fcgi_reaped(pid_t pid);
+void fcgi_stop(void);
+int fcgi_start(request * req);
+int fcgi_write(request * req);
+int fcgi_watching(void);
+void fcgi_watchdog(void);
+int fcgi_read(request * req, char *buf, unsigned int len);
+void fcgi_abort(request * req);
+
+/* proxy */
+void proxy_add(const char *prefix, const char *url);
+int proxy_route(request * req, const char *prefix);
+int proxy_start(request * req);
+int proxy_write(request * req);
+int proxy_read(request * req, char *buf, unsigned int len);
+void proxy_abort(request * req);
+
+/* pack */
+void pack_init(void);
+const struct pack_entry *pack_lookup(const char *uri);
+char *pack_entity(request * req);
+const char *pack_mime(const struct pack_entry *e);
+
+/* resolve */
+void resolve_init(void);
+int doc_root_fd(request * req, const char *path, const char **rel);
+int doc_openat(int dirfd, const char *rel, const char *path);
+int doc_open(request * req, const char *path);
+void resolve_show_stats(void);
+
+/* negative_cache */
+void negative_cache_init(void);
+int negative_lookup(const char *path);
+void negative_add(const char *path);
+int negative_open(request * req, const char *path);
+void negative_collect(void);
+void negative_show_stats(void);
+
+/* iopool */
+#ifdef USE_IO_THREADS
+void io_pool_init(void);
+void io_pool_collect(void);
+void io_pool_show_stats(void);
+int io_submit_open(request * req);
+int io_submit_read(request * req, char *buf, size_t len, off_t offset);
+int io_open_result(request * req, int *fd, struct stat *statbuf);
+int io_read_result(request * req, int *bytes_read);
+int io_resume(request * req);
+void io_job_free(request * req);
+#endif
+
 /* sublog */
 int open_gen_fd(char *spec);
 int process_cgi_header(request * req);
@@ -205,18 +317,26 @@ int process_cgi_header(request * req);
 int read_from_pipe(request * req);
 int write_from_pipe(request * req);
 int io_shuffle(request * req);
+void stream_init(request * req);
+void stream_done(request * req);
 #ifdef HAVE_SENDFILE
 #include <sys/sendfile.h>
 int io_shuffle_sendfile(request * req);
 #endif
 
+/* listen */
+void listen_add(const char *address, const char *option);
+void listen_open(void);
+void listen_close(void);
+int listen_proxy_line(request * req);
+
 /* ip */
 int bind_server(int sock, char *ip, unsigned int port);
 char *ascii_sockaddr(struct SOCKADDR *s, char *dest, unsigned int len);
 int net_port(struct SOCKADDR *s);
 
 /* select or poll */
-void loop(int server_s);
+void loop(void);
 
 /* range.c */
 void ranges_reset(request * req);
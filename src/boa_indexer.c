@@ -0,0 +1,99 @@
+/*
+ *  Copyright (C) 1997-2005 Jon Nelson <jnelson@boa.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 1, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/* $Id$*/
+
+#include "config.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "compat.h"
+#include "escape.h"
+#include "index_dir.h"
+
+/*
+ * boa_indexer: the DirectoryMaker that ships with Boa.
+ * The listing itself is rendered by index_dir.c, which Boa also
+ * uses directly when DirectoryMaker is "internal".
+ */
+
+static void send_error(int error)
+{
+    const char *the_error;
+
+    switch (error) {
+
+    case 1:
+        the_error = "Not enough arguments were passed to the indexer.";
+        break;
+    case 2:
+        the_error = "The Directory Sorter ran out of Memory";
+        break;
+    case 3:
+        the_error =
+            "The was a problem changing to the appropriate directory.";
+        break;
+    case 4:
+        the_error = "There was an error escaping a string.";
+        break;
+    case 5:
+        the_error = "Too many arguments were passed to the indexer.";
+        break;
+    case 6:
+        the_error = "No files in this directory.";
+        break;
+    default:
+        the_error = "An unknown error occurred producing the directory.";
+        break;
+    }
+    printf("<html>\n<head>\n<title>\n%s\n</title>\n"
+           "<body>\n%s\n</body>\n</html>\n", the_error, the_error);
+}
+
+int main(int argc, char *argv[])
+{
+    struct index_buf listing;
+    int ret;
+
+    if (argc < 3) {
+        send_error(INDEX_ERR_ARGS);
+        return -1;
+    } else if (argc > 3) {
+        send_error(INDEX_ERR_TOO_MANY_ARGS);
+        return -1;
+    }
+
+    build_needs_escape();
+
+    memset(&listing, 0, sizeof (listing));
+    if (argv[2] == NULL)
+        ret = index_directory(argv[1], argv[1], &listing);
+    else
+        ret = index_directory(argv[1], argv[2], &listing);
+
+    if (ret) {
+        send_error(ret);
+        return -1;
+    }
+
+    fwrite(listing.data, 1, listing.len, stdout);
+    free(listing.data);
+
+    return 0;
+}
@@ -0,0 +1,396 @@
+/*
+ *  Boa, an http server
+ *  Copyright (C) 1999-2005 Larry Doolittle <ldoolitt@boa.org>
+ *  Copyright (C) 2000-2005 Jon Nelson <jnelson@boa.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 1, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/* $Id$*/
+
+#include "config.h"             /* first: may set _FILE_OFFSET_BITS */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "pack.h"
+
+/*
+ * boa_mkpack: makes a DocumentPack out of a directory tree.
+ *
+ *   boa_mkpack [-c] [-i index] [-m mime.types] [-t type] dir output
+ *
+ * Every regular file under dir becomes /its/path in the pack; a
+ * directory with an index file (index.html unless -i says otherwise)
+ * is also there as /its/path/.  Types come from mime.types by
+ * extension, as Boa does it.  With -c, output is C source defining
+ * the pack, to be linked into boa (make PACK_SOURCE=output).
+ */
+
+struct file {
+    char *uri;
+    char *name;                 /* on disk */
+    const char *mime;
+    struct stat statbuf;
+    int is_index;               /* a directory: its index file's data */
+};
+
+struct mime {
+    char *ext;
+    char *type;
+};
+
+static struct file *files = NULL;
+static unsigned int nfiles = 0, files_size = 0;
+static struct mime *mimes = NULL;
+static unsigned int nmimes = 0, mimes_size = 0;
+
+static const char *index_name = "index.html";
+static const char *default_type = "text/plain";
+
+static void die(const char *what)
+{
+    perror(what);
+    exit(EXIT_FAILURE);
+}
+
+static void *xrealloc(void *p, size_t size)
+{
+    p = realloc(p, size);
+    if (p == NULL)
+        die("realloc");
+    return p;
+}
+
+static char *xstrdup(const char *s)
+{
+    char *p = strdup(s);
+
+    if (p == NULL)
+        die("strdup");
+    return p;
+}
+
+static void read_mime_types(const char *name)
+{
+    FILE *f = fopen(name, "r");
+    char line[1024];
+
+    if (f == NULL)
+        die(name);
+    while (fgets(line, sizeof (line), f)) {
+        char *type, *ext;
+
+        if (line[0] == '#')
+            continue;
+        type = strtok(line, " \t\r\n");
+        if (type == NULL)
+            continue;
+        while ((ext = strtok(NULL, " \t\r\n")) != NULL) {
+            if (nmimes == mimes_size) {
+                mimes_size = mimes_size ? 2 * mimes_size : 256;
+                mimes = xrealloc(mimes, mimes_size * sizeof (*mimes));
+            }
+            mimes[nmimes].ext = xstrdup(ext);
+            mimes[nmimes].type = xstrdup(type);
+            nmimes++;
+        }
+    }
+    fclose(f);
+}
+
+static const char *mime_type(const char *name)
+{
+    const char *ext = strrchr(name, '.');
+    unsigned int i;
+
+    if (ext == NULL || strchr(ext, '/'))
+        return default_type;
+    for (i = 0; i < nmimes; ++i) {
+        if (!strcmp(mimes[i].ext, ext + 1))
+            return mimes[i].type;
+    }
+    return default_type;
+}
+
+static void add_file(const char *uri, const char *name,
+                     struct stat *statbuf, int is_index)
+{
+    if (nfiles == files_size) {
+        files_size = files_size ? 2 * files_size : 256;
+        files = xrealloc(files, files_size * sizeof (*files));
+    }
+    files[nfiles].uri = xstrdup(uri);
+    files[nfiles].name = xstrdup(name);
+    files[nfiles].mime = mime_type(name);
+    files[nfiles].statbuf = *statbuf;
+    files[nfiles].is_index = is_index;
+    nfiles++;
+}
+
+/* dir is the path on disk, uri the matching URI path, ending in / */
+static void walk(const char *dir, const char *uri)
+{
+    DIR *d = opendir(dir);
+    struct dirent *de;
+    char name[4096], sub[4096];
+    struct stat statbuf;
+
+    if (d == NULL)
+        die(dir);
+    while ((de = readdir(d)) != NULL) {
+        if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, ".."))
+            continue;
+        if ((unsigned) snprintf(name, sizeof (name), "%s/%s", dir,
+                                de->d_name) >= sizeof (name) ||
+            (unsigned) snprintf(sub, sizeof (sub), "%s%s", uri,
+                                de->d_name) >= sizeof (sub)) {
+            fprintf(stderr, "%s/%s: name too long\n", dir, de->d_name);
+            exit(EXIT_FAILURE);
+        }
+        if (stat(name, &statbuf) == -1)
+            die(name);
+        if (S_ISDIR(statbuf.st_mode)) {
+            strcat(sub, "/");
+            walk(name, sub);
+        } else if (S_ISREG(statbuf.st_mode)) {
+            add_file(sub, name, &statbuf, 0);
+            if (!strcmp(de->d_name, index_name))
+                add_file(uri, name, &statbuf, 1);
+        }
+    }
+    closedir(d);
+}
+
+static int by_uri(const void *a, const void *b)
+{
+    return strcmp(((const struct file *) a)->uri,
+                  ((const struct file *) b)->uri);
+}
+
+static uint64_t align(uint64_t n)
+{
+    return (n + PACK_ALIGN - 1) & ~(uint64_t) (PACK_ALIGN - 1);
+}
+
+static void read_file(const char *name, char *buf, size_t len)
+{
+    int fd = open(name, O_RDONLY);
+    size_t got = 0;
+
+    if (fd == -1)
+        die(name);
+    while (got < len) {
+        ssize_t n = read(fd, buf + got, len - got);
+
+        if (n <= 0) {
+            fprintf(stderr, "%s: changed while being packed\n", name);
+            exit(EXIT_FAILURE);
+        }
+        got += n;
+    }
+    close(fd);
+}
+
+static int find_uri(const char *uri)
+{
+    unsigned int lo = 0, hi = nfiles;
+
+    while (lo < hi) {
+        unsigned int mid = (lo + hi) / 2;
+        int cmp = strcmp(uri, files[mid].uri);
+
+        if (cmp == 0)
+            return mid;
+        if (cmp < 0)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    return -1;
+}
+
+/*
+ * Lays the pack out in memory.  A directory's "/" entry shares the
+ * data of its index file.
+ */
+static char *build(uint64_t *size)
+{
+    struct pack_header h;
+    struct pack_entry *entries;
+    uint32_t *buckets, nbuckets = 1;
+    uint64_t *offsets, strings, pos;
+    char key[4096 + 64];
+    char *pack;
+    unsigned int i;
+
+    /* sort by URI, so the same tree always makes the same pack */
+    qsort(files, nfiles, sizeof (*files), by_uri);
+
+    while (nbuckets < 2 * nfiles)
+        nbuckets <<= 1;
+
+    strings = sizeof (h) + nbuckets * sizeof (uint32_t) +
+        (uint64_t) nfiles * sizeof (struct pack_entry);
+    pos = strings;
+    for (i = 0; i < nfiles; ++i)
+        pos += strlen(files[i].uri) + 1 + strlen(files[i].mime) + 1;
+
+    offsets = xrealloc(NULL, (nfiles ? nfiles : 1) * sizeof (uint64_t));
+    for (i = 0; i < nfiles; ++i) {
+        if (files[i].is_index)
+            continue;
+        pos = align(pos);
+        offsets[i] = pos;
+        pos += files[i].statbuf.st_size;
+    }
+    *size = pos;
+
+    pack = calloc(1, pos);
+    if (pack == NULL)
+        die("calloc");
+    for (i = 0; i < nfiles; ++i) {
+        if (!files[i].is_index)
+            read_file(files[i].name, pack + offsets[i],
+                      files[i].statbuf.st_size);
+    }
+
+    memset(&h, 0, sizeof (h));
+    memcpy(h.magic, PACK_MAGIC, sizeof (h.magic));
+    h.nbuckets = nbuckets;
+    h.nentries = nfiles;
+    h.size = pos;
+    memcpy(pack, &h, sizeof (h));
+    buckets = (uint32_t *) (pack + sizeof (h));
+    entries = (struct pack_entry *) (buckets + nbuckets);
+
+    pos = strings;
+    for (i = 0; i < nfiles; ++i) {
+        struct pack_entry *e = entries + i;
+        const char *data;
+        uint32_t sum = 2166136261U;
+        off_t j;
+
+        if (files[i].is_index) {
+            snprintf(key, sizeof (key), "%s%s", files[i].uri, index_name);
+            offsets[i] = offsets[find_uri(key)];
+        }
+        data = pack + offsets[i];
+
+        e->hash = pack_hash(files[i].uri);
+        e->path = pos;
+        strcpy(pack + pos, files[i].uri);
+        pos += strlen(files[i].uri) + 1;
+        e->mime = pos;
+        strcpy(pack + pos, files[i].mime);
+        pos += strlen(files[i].mime) + 1;
+
+        e->offset = offsets[i];
+        e->length = files[i].statbuf.st_size;
+        e->mtime = files[i].statbuf.st_mtime;
+        for (j = 0; j < files[i].statbuf.st_size; ++j) {
+            sum ^= (unsigned char) data[j];
+            sum *= 16777619U;
+        }
+        snprintf(e->etag, sizeof (e->etag), "\"%lx-%lx-%lx\"",
+                 (unsigned long) e->length, (unsigned long) e->mtime,
+                 (unsigned long) sum);
+    }
+
+    /* chains are built backwards, so each one goes forward */
+    for (i = nfiles; i-- > 0;) {
+        uint32_t b = entries[i].hash & (nbuckets - 1);
+
+        entries[i].next = buckets[b];
+        buckets[b] = i + 1;
+    }
+    free(offsets);
+    return pack;
+}
+
+static void write_c(FILE *f, const char *pack, uint64_t size)
+{
+    uint64_t i;
+
+    fputs("/* made by boa_mkpack; link into boa with "
+          "make PACK_SOURCE=<this file> */\n\n"
+          "const unsigned char boa_builtin_pack[] "
+          "__attribute__ ((aligned(8))) = {", f);
+    for (i = 0; i < size; ++i)
+        fprintf(f, "%s%u,", i % 16 ? "" : "\n", (unsigned char) pack[i]);
+    fprintf(f, "\n};\n\nconst unsigned long boa_builtin_pack_size = %luUL;\n",
+            (unsigned long) size);
+}
+
+static void usage(void)
+{
+    fputs("usage: boa_mkpack [-c] [-i index] [-m mime.types] [-t type] "
+          "dir output\n", stderr);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *mime_types = "/etc/mime.types";
+    int c, c_source = 0;
+    uint64_t size;
+    char *pack;
+    FILE *f;
+
+    while ((c = getopt(argc, argv, "ci:m:t:")) != -1) {
+        switch (c) {
+        case 'c':
+            c_source = 1;
+            break;
+        case 'i':
+            index_name = optarg;
+            break;
+        case 'm':
+            mime_types = optarg;
+            break;
+        case 't':
+            default_type = optarg;
+            break;
+        default:
+            usage();
+        }
+    }
+    if (argc - optind != 2)
+        usage();
+
+    read_mime_types(mime_types);
+    walk(argv[optind], "/");
+    pack = build(&size);
+
+    f = fopen(argv[optind + 1], "w");
+    if (f == NULL)
+        die(argv[optind + 1]);
+    if (c_source)
+        write_c(f, pack, size);
+    else
+        fwrite(pack, 1, size, f);
+    if (fclose(f) != 0)
+        die(argv[optind + 1]);
+
+    fprintf(stderr, "%u entries, %lu bytes\n", nfiles,
+            (unsigned long) size);
+    return 0;
+}
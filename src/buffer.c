@@ -196,14 +196,15 @@ int req_write_escape_html(request * req, const char *msg)
 
 
 /*
- * Name: flush_req
+ * Name: req_send_buffer
  *
- * Description: Sends any backlogged buffer to client.
+ * Description: Sends any backlogged buffer to client, passing flags
+ * on to send(2).
  *
  * Returns: -2 for error, -1 for blocked, otherwise how much is stored
  */
 
-int req_flush(request * req)
+static int req_send_buffer(request * req, int flags)
 {
     unsigned bytes_to_write;
 
@@ -214,8 +215,8 @@ int req_flush(request * req)
     if (bytes_to_write) {
         int bytes_written;
 
-        bytes_written = write(req->fd, req->buffer + req->buffer_start,
-                              bytes_to_write);
+        bytes_written = send(req->fd, req->buffer + req->buffer_start,
+                             bytes_to_write, flags);
 
         if (bytes_written < 0) {
             if (errno == EWOULDBLOCK || errno == EAGAIN)
@@ -249,6 +250,40 @@ int req_flush(request * req)
     return req->buffer_end;     /* successful */
 }
 
+/*
+ * Name: req_flush
+ *
+ * Description: Sends any backlogged buffer to client.
+ *
+ * Returns: -2 for error, -1 for blocked, otherwise how much is stored
+ */
+
+int req_flush(request * req)
+{
+    return req_send_buffer(req, 0);
+}
+
+/*
+ * Name: req_flush_more
+ *
+ * Description: Like req_flush, but tells the kernel that the body
+ * follows right away, so the headers are not pushed out in a
+ * segment of their own.  The next send without MSG_MORE (or the
+ * last chunk of a sendfile) releases everything at once.  This
+ * also applies with TCP_NODELAY set.
+ *
+ * Returns: -2 for error, -1 for blocked, otherwise how much is stored
+ */
+
+int req_flush_more(request * req)
+{
+#ifdef MSG_MORE
+    return req_send_buffer(req, MSG_MORE);
+#else
+    return req_send_buffer(req, 0);
+#endif
+}
+
 /*
  * Name: escape_string
  *
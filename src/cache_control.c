@@ -0,0 +1,254 @@
+/*
+ *  Boa, an http server
+ *  Copyright (C) 1999-2005 Larry Doolittle <ldoolitt@boa.org>
+ *  Copyright (C) 2000-2005 Jon Nelson <jnelson@boa.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 1, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/* $Id$*/
+
+/*
+ * Cache-Control and Expires for documents (CachePath, CacheType,
+ * CacheFingerprint).
+ *
+ * Each policy keeps its two header lines ready made; only the Expires
+ * date in them changes, and that at most once a second.  A document
+ * whose name carries a content hash (app.3f2a9c1b.js) gets the
+ * CacheFingerprint policy, then the longest CachePath prefix of its
+ * URL applies, then its CacheType.
+ */
+
+#include "boa.h"
+
+struct cache_policy {
+    char *key;                  /* URL prefix or MIME type */
+    unsigned int key_len;
+    int wildcard;               /* a "type/..." key */
+    time_t max_age;
+    time_t stamp;               /* of the Expires date in header */
+    char *header;
+    char *expires;              /* the date, inside header */
+    struct cache_policy *next;
+};
+
+static struct cache_policy *path_policies = NULL;
+static struct cache_policy *type_policies = NULL;
+static struct cache_policy *fingerprint_policy = NULL;
+
+/*
+ * Name: cache_policy_new
+ * Description: Makes a policy from "max-age [immutable]", as given in
+ * the config file, with its header lines.
+ */
+
+static struct cache_policy *cache_policy_new(const char *key,
+                                             const char *value,
+                                             int immutable)
+{
+    struct cache_policy *p;
+    long max_age;
+    char *end, buf[128];
+    int n;
+
+    if (value == NULL) {
+        log_error_time();
+        fprintf(stderr, "cache policy for \"%s\" has no max-age\n", key);
+        exit(EXIT_FAILURE);
+    }
+    /* strtol takes a sign and leading blanks: a max-age has neither */
+    errno = 0;
+    max_age = strtol(value, &end, 10);
+    while (isspace((unsigned char) *end))
+        ++end;
+    if (!strcasecmp(end, "immutable")) {
+        immutable = 1;
+        end += 9;
+    }
+    if (!isdigit((unsigned char) *value) || errno == ERANGE ||
+        *end != '\0') {
+        log_error_time();
+        fprintf(stderr, "bad cache policy \"%s\" (want max-age "
+                "[immutable])\n", value);
+        exit(EXIT_FAILURE);
+    }
+
+    p = calloc(1, sizeof (struct cache_policy));
+    if (p == NULL)
+        DIE("out of memory adding cache policy");
+    if (key) {
+        p->key_len = strlen(key);
+        p->wildcard = (p->key_len > 1 && !strcmp(key + p->key_len - 2, "/*"));
+        if (p->wildcard)
+            p->key_len--;       /* match "type/" */
+        p->key = strdup(key);
+        if (p->key == NULL)
+            DIE("out of memory adding cache policy");
+    }
+    p->max_age = max_age;
+
+    if (max_age == 0)
+        n = snprintf(buf, sizeof (buf), "Cache-Control: no-cache" CRLF);
+    else
+        n = snprintf(buf, sizeof (buf), "Cache-Control: max-age=%ld%s" CRLF,
+                     max_age, immutable ? ", immutable" : "");
+    strcpy(buf + n, "Expires: "
+           "                             " CRLF);
+    p->header = strdup(buf);
+    if (p->header == NULL)
+        DIE("out of memory adding cache policy");
+    p->expires = p->header + n + 9;
+    return p;
+}
+
+static void cache_policy_free(struct cache_policy *p)
+{
+    while (p) {
+        struct cache_policy *next = p->next;
+
+        free(p->key);
+        free(p->header);
+        free(p);
+        p = next;
+    }
+}
+
+/*
+ * Empties the policy lists, for a SIGHUP.
+ */
+
+void dump_cache_policies(void)
+{
+    cache_policy_free(path_policies);
+    cache_policy_free(type_policies);
+    cache_policy_free(fingerprint_policy);
+    path_policies = type_policies = fingerprint_policy = NULL;
+}
+
+/*
+ * Name: cache_policy_add
+ * Description: For CachePath (CACHE_PATH) and CacheType (CACHE_TYPE)
+ * lines, and CacheFingerprint (CACHE_FINGERPRINT, with key NULL).
+ */
+
+void cache_policy_add(int kind, const char *key, const char *value)
+{
+    struct cache_policy *p;
+
+    if (kind == CACHE_FINGERPRINT) {
+        /* a one argument line, so the max-age is in key */
+        cache_policy_free(fingerprint_policy);
+        fingerprint_policy = cache_policy_new(NULL, key, 1);
+        return;
+    }
+
+    p = cache_policy_new(key, value, 0);
+    if (kind == CACHE_PATH) {
+        p->next = path_policies;
+        path_policies = p;
+    } else {
+        p->next = type_policies;
+        type_policies = p;
+    }
+}
+
+/*
+ * Name: fingerprinted
+ * Description: Whether the last part of uri looks like name.HASH.ext
+ * or name-HASH.ext, HASH being CACHE_FINGERPRINT_MIN or more hex
+ * digits.  Build tools name files that way so that they never change.
+ */
+
+static int fingerprinted(const char *uri)
+{
+    const char *base, *ext, *p;
+
+    base = strrchr(uri, '/');
+    base = (base ? base + 1 : uri);
+    ext = strrchr(base, '.');
+    if (ext == NULL)
+        return 0;
+    for (p = ext; p > base && isxdigit((unsigned char) p[-1]); --p);
+    return (ext - p >= CACHE_FINGERPRINT_MIN && p - 1 > base &&
+            (p[-1] == '.' || p[-1] == '-'));
+}
+
+/*
+ * Name: cache_policy_lookup
+ * Description: Finds the policy for the document req is sending.
+ *
+ * Return values: it, or NULL for none
+ */
+
+static struct cache_policy *cache_policy_lookup(request * req)
+{
+    struct cache_policy *p, *best = NULL;
+
+    if (fingerprint_policy && fingerprinted(req->request_uri))
+        return fingerprint_policy;
+
+    for (p = path_policies; p; p = p->next) {
+        if ((best == NULL || p->key_len > best->key_len) &&
+            !strncmp(req->request_uri, p->key, p->key_len))
+            best = p;
+    }
+    if (best)
+        return best;
+
+    if (type_policies) {
+        const char *charset;
+        const char *type = document_type(req, &charset);
+
+        if (type == NULL)
+            return NULL;
+        for (p = type_policies; p; p = p->next) {
+            if (p->wildcard ? !strncasecmp(type, p->key, p->key_len) :
+                !strcasecmp(type, p->key))
+                return p;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Name: print_cache_control
+ * Description: Writes the Cache-Control and Expires lines, if any
+ * policy applies, for a 200, 206 or 304.
+ */
+
+void print_cache_control(request * req)
+{
+    struct cache_policy *p;
+
+    if (path_policies == NULL && type_policies == NULL &&
+        fingerprint_policy == NULL)
+        return;
+
+    p = cache_policy_lookup(req);
+    if (p == NULL)
+        return;
+
+    if (p->stamp != current_time) {
+        time_t max_age = p->max_age;
+
+        /* RFC 2616 14.21: no more than a year ahead */
+        if (max_age > CACHE_EXPIRES_MAX)
+            max_age = CACHE_EXPIRES_MAX;
+        rfc822_time_buf(p->expires, current_time + max_age);
+        p->stamp = current_time;
+    }
+    req_write(req, p->header);
+}
@@ -23,12 +23,19 @@
 
 /* $Id: cgi.c,v 1.83.2.28 2005/02/22 14:11:29 jnelson Exp $ */
 
+#ifdef __linux__
+#define _GNU_SOURCE             /* F_SETPIPE_SZ */
+#endif
+
 #include "boa.h"
+#include <signal.h>             /* sigprocmask */
 
 static char *env_gen_extra(const char *key, const char *value,
                            unsigned int extra);
-static void create_argv(request * req, char **aargv);
+static int create_argv(request * req, char **aargv, char **words);
 static int complete_env(request * req);
+static int cgi_start(request * req);
+static int cgi_spawn(request * req);
 
 int verbose_cgi_logs = 0;
 /* The +1 is for the the NULL in complete_env */
@@ -142,6 +149,16 @@ void clear_common_env(void)
     }
 }
 
+/*
+ * The environment every CGI gets, for programs (FastCGI servers) that
+ * are not run for a request.
+ */
+
+char **common_env(void)
+{
+    return common_cgi_env;
+}
+
 /*
  * Name: env_gen_extra
  *       (and via a not-so-tricky #define, env_gen)
@@ -174,6 +191,46 @@ static char *env_gen_extra(const char *key, const char *value,
     return result;
 }
 
+/*
+ * Name: cgi_env_room
+ *
+ * Description: Takes len bytes of req's CGI variable space, which is
+ * kept with the request struct from one request to the next, so that
+ * building the environment doesn't call malloc.  If it has to grow,
+ * the strings already made move, and cgi_env is pointed at them again.
+ *
+ * Returns the bytes, or NULL if out of memory.
+ */
+
+static char *cgi_env_room(request * req, unsigned int len)
+{
+    char *p;
+
+    if (req->cgi_env_used + len > req->cgi_env_arena_size) {
+        unsigned int size = (req->cgi_env_arena_size ?
+                             req->cgi_env_arena_size : CGI_ENV_ARENA);
+        char *old = req->cgi_env_arena;
+        int i;
+
+        while (size < req->cgi_env_used + len)
+            size *= 2;
+        p = malloc(size);
+        if (!p)
+            return NULL;
+        if (old) {
+            memcpy(p, old, req->cgi_env_used);
+            for (i = common_cgi_env_count; i < req->cgi_env_index; ++i)
+                req->cgi_env[i] = p + (req->cgi_env[i] - old);
+            free(old);
+        }
+        req->cgi_env_arena = p;
+        req->cgi_env_arena_size = size;
+    }
+    p = req->cgi_env_arena + req->cgi_env_used;
+    req->cgi_env_used += len;
+    return p;
+}
+
 /*
  * Name: add_cgi_env
  *
@@ -185,7 +242,7 @@ int add_cgi_env(request * req, const char *key, const char *value,
                 int http_prefix)
 {
     char *p;
-    unsigned int prefix_len;
+    unsigned int prefix_len, key_len, value_len;
 
     if (http_prefix) {
         prefix_len = 5;
@@ -194,7 +251,12 @@ int add_cgi_env(request * req, const char *key, const char *value,
     }
 
     if (req->cgi_env_index < CGI_ENV_MAX) {
-        p = env_gen_extra(key, value, prefix_len);
+        if (value == NULL)
+            value = "";
+        key_len = strlen(key);
+        value_len = strlen(value);
+        /* leave room for '=' sign and null terminator */
+        p = cgi_env_room(req, prefix_len + key_len + value_len + 2);
         if (!p) {
             log_error_doc(req);
             fprintf(stderr,
@@ -202,9 +264,13 @@ int add_cgi_env(request * req, const char *key, const char *value,
                     "variable -- ran out of memory!\n");
             return 0;
         }
+        req->cgi_env[req->cgi_env_index++] = p;
         if (prefix_len)
             memcpy(p, "HTTP_", 5);
-        req->cgi_env[req->cgi_env_index++] = p;
+        p += prefix_len;
+        memcpy(p, key, key_len);
+        p[key_len] = '=';
+        memcpy(p + key_len + 1, value, value_len + 1);
         return 1;
     }
     log_error_doc(req);
@@ -305,16 +371,19 @@ static int complete_env(request * req)
  * Name: make_args_cgi
  *
  * Build argv list for a CGI script according to spec
+ * (aargv[0] is left to the caller).  The words of an "index" query
+ * share one allocation, stored in *words for the caller to free.
  *
+ * Returns 0 if out of memory, else 1.
  */
 
-static void create_argv(request * req, char **aargv)
+static int create_argv(request * req, char **aargv, char **words)
 {
     char *p, *q, *r;
     int aargc;
 
     q = req->query_string;
-    aargv[0] = req->pathname;
+    *words = NULL;
 
     /* here, we handle a special "indexed" query string.
      * Taken from the CGI/1.1 SPEC:
@@ -365,8 +434,9 @@ static void create_argv(request * req, char **aargv)
         if (!q) {
             log_error_doc(req);
             fputs("unable to strdup 'q' in create_argv!\n", stderr);
-            _exit(EXIT_FAILURE);
+            return 0;
         }
+        *words = q;
         for (aargc = 1; q && (aargc < CGI_ARGC_MAX);) {
             r = q;
             /* for an index-style CGI, + is used to separate arguments
@@ -387,6 +457,137 @@ static void create_argv(request * req, char **aargv)
     } else {
         aargv[1] = NULL;
     }
+    return 1;
+}
+
+/*
+ * What went wrong in a CGI child, for the parent to log: the child
+ * runs in our memory (see init_cgi) and must keep off stdio.
+ */
+
+struct cgi_failure {
+    const char *what;
+    int error;
+};
+
+#define CHILD_FAIL(f, w) { (f)->what = (w); (f)->error = errno; return; }
+
+/*
+ * Name: cgi_child
+ *
+ * Description: Runs in the child between vfork and exec.  Ties stdout
+ * to the pipe (or the socket), stdin to the POST data and stderr to
+ * the CGI log, moves to the script's directory, sets the limits and
+ * execs.  Nothing here allocates or writes to memory but *fail, since
+ * that memory is the server's.
+ *
+ * Returns only if it failed.
+ */
+
+static void cgi_child(request * req, int *pipes, const char *dir,
+                      char **aargv, volatile struct cgi_failure *fail)
+{
+    /* so that cgi_kill gets whatever it starts, too */
+    setpgid(0, 0);
+
+    if (dir && chdir(dir) != 0)
+        CHILD_FAIL(fail, "CGI chdir");
+
+    if (pipes) {
+        /* close the 'read' end of the pipes[] */
+        close(pipes[0]);
+        /* tie CGI's STDOUT to our write end of pipe */
+        if (dup2(pipes[1], STDOUT_FILENO) == -1)
+            CHILD_FAIL(fail, "dup2 - pipes");
+        close(pipes[1]);
+    } else {
+        /* tie stdout to socket */
+        if (dup2(req->fd, STDOUT_FILENO) == -1)
+            CHILD_FAIL(fail, "dup2 - fd");
+        close(req->fd);
+    }
+    /* Switch socket flags back to blocking */
+    if (set_block_fd(STDOUT_FILENO) == -1)
+        CHILD_FAIL(fail, "cgi-fcntl");
+    /* tie post_data_fd to POST stdin */
+    if (req->method == M_POST) { /* tie stdin to file */
+        lseek(req->post_data_fd, 0, SEEK_SET);
+        dup2(req->post_data_fd, STDIN_FILENO);
+        close(req->post_data_fd);
+    }
+
+#ifdef USE_SETRLIMIT
+    /* setrlimit stuff.
+     * This is neat!
+     * RLIMIT_STACK    max stack size
+     * RLIMIT_CORE     max core file size
+     * RLIMIT_RSS      max resident set size
+     * RLIMIT_NPROC    max number of processes
+     * RLIMIT_NOFILE   max number of open files
+     * RLIMIT_MEMLOCK  max locked-in-memory address space
+     * RLIMIT_AS       address space (virtual memory) limit
+     *
+     * RLIMIT_CPU      CPU time in seconds
+     * RLIMIT_DATA     max data size
+     *
+     * Currently, we only limit the CPU time and the DATA segment
+     * We also "nice" the process.
+     *
+     * This section of code adapted from patches sent in by Steve Thompson
+     * (no email available)
+     */
+
+    {
+        struct rlimit rl;
+
+        if (cgi_rlimit_cpu) {
+            rl.rlim_cur = rl.rlim_max = cgi_rlimit_cpu;
+            if (setrlimit(RLIMIT_CPU, &rl) == -1)
+                CHILD_FAIL(fail, "setrlimit(RLIMIT_CPU)");
+        }
+
+        if (cgi_rlimit_data) {
+            rl.rlim_cur = rl.rlim_max = cgi_rlimit_data;
+            if (setrlimit(RLIMIT_DATA, &rl) == -1)
+                CHILD_FAIL(fail, "setrlimit(RLIMIT_DATA)");
+        }
+
+        if (cgi_nice) {
+            errno = 0;
+            if (nice(cgi_nice) == -1 && errno)
+                CHILD_FAIL(fail, "nice");
+        }
+    }
+#endif
+
+    umask(cgi_umask);           /* change umask *again* u=rwx,g=rxw,o= */
+
+    /*
+     * tie STDERR to cgi_log_fd
+     * cgi_log_fd will automatically close, close-on-exec rocks!
+     * if we don't tie STDERR (current log_error) to cgi_log_fd,
+     *  then we ought to tie it to /dev/null
+     *  FIXME: we currently don't tie it to /dev/null, we leave it
+     *  tied to whatever 'error_log' points to.  This means CGIs can
+     *  scribble on the error_log, probably a bad thing.
+     */
+    if (cgi_log_fd) {
+        dup2(cgi_log_fd, STDERR_FILENO);
+    }
+
+    if (req->cgi_type) {
+        execve(aargv[0], aargv, req->cgi_env);
+    } else {
+        if (req->pathname[strlen(req->pathname) - 1] == '/')
+            execl(dirmaker, dirmaker, req->pathname, req->request_uri,
+                  (void *) NULL);
+#ifdef GUNZIP
+        else
+            execl(GUNZIP, GUNZIP, "--stdout", "--decompress",
+                  req->pathname, (void *) NULL);
+#endif
+    }
+    CHILD_FAIL(fail, "execve");
 }
 
 /*
@@ -397,19 +598,45 @@ static void create_argv(request * req, char **aargv)
  * stdin to data if POST, and execs CGI.
  * stderr remains tied to our log file; is this good?
  *
+ * The child is started with vfork: it borrows the server's memory
+ * until it execs, rather than copying the page tables of the mmap
+ * cache and everything else, so starting a CGI takes no longer as
+ * the server grows.  Whatever needs memory (the script's directory,
+ * its argv) is made here first; cgi_child only makes system calls.
+ *
+ * A GET under a CGICache path may be answered from the cache instead.
+ *
  * Returns:
+ * -1 - waiting for a CGI slot (CGI_WAIT), or for the same CGI to
+ *      finish (CGI_CACHE_WAIT)
  * 0 - error or NPH, either way the socket is closed
  * 1 - success
  */
 
 int init_cgi(request * req)
 {
-    int child_pid;
-    int pipes[2];
-    int use_pipes = 0;
+    int n = cgi_cache_lookup(req);
+
+    if (n != 2)
+        return n;
+    return cgi_start(req);
+}
+
+/*
+ * Name: cgi_start
+ *
+ * Description: The rest of init_cgi, for a CGI which is to run.
+ */
+
+static int cgi_start(request * req)
+{
+    int n;
 
     SQUASH_KA(req);
 
+    if (req->proxy_pass)
+        return proxy_start(req);
+
     if (req->cgi_type) {
         if (complete_env(req) == 0) {
             return 0;
@@ -423,6 +650,93 @@ int init_cgi(request * req)
                     __FILE__, req->cgi_env[i]);
     }
 
+    if (req->tcl_alias)
+        return tcl_run(req);
+
+    if (req->cgi_type == CGI) {
+        n = fcgi_start(req);
+        if (n != -1)
+            return n;
+    }
+
+    n = cgi_admit(req);
+    if (n != 1)
+        return n;
+    return cgi_spawn(req);
+}
+
+/*
+ * Name: cgi_resume
+ *
+ * Description: Called by process_requests for a request readied from
+ * CGI_WAIT: starts its child if there is room now.  From
+ * CGI_CACHE_WAIT: sends what the CGI it waited for left in the cache,
+ * or goes on to run it.
+ */
+
+int cgi_resume(request * req)
+{
+    int n;
+
+    if (req->status == CGI_CACHE_WAIT) {
+        n = cgi_cache_lookup(req);
+        if (n != 2)
+            return n;
+        return cgi_start(req);
+    }
+
+    n = cgi_admit(req);
+
+    if (n != 1)
+        return n;
+    return cgi_spawn(req);
+}
+
+/*
+ * Name: cgi_spawn
+ *
+ * Description: The rest of init_cgi: starts the child.
+ */
+
+static int cgi_spawn(request * req)
+{
+    int child_pid;
+    int pipes[2];
+    int use_pipes = 0;
+    char *aargv[CGI_ARGC_MAX + 1];
+    char *dir = NULL, *prog = NULL, *words = NULL;
+    /* volatile: only the child, as far as the compiler knows, can
+     * have written it */
+    volatile struct cgi_failure fail;
+    sigset_t all, saved;
+
+    if (req->cgi_type == CGI || req->cgi_type == NPH) {
+        /* run it as ./script, from the script's directory */
+        char *c = strrchr(req->pathname, '/');
+
+        if (!c) {
+            /* there will always be a '.' */
+            log_error_doc(req);
+            fprintf(stderr,
+                    "unable to find '/' in req->pathname: \"%s\"\n",
+                    req->pathname);
+            send_r_error(req);
+            return 0;
+        }
+        dir = strdup(req->pathname);
+        prog = malloc(strlen(c) + 2);
+        if (!dir || !prog || !create_argv(req, aargv, &words)) {
+            boa_perror(req, "unable to malloc for CGI arguments");
+            free(dir);
+            free(prog);
+            return 0;
+        }
+        dir[c - req->pathname] = '\0';
+        prog[0] = '.';
+        strcpy(prog + 1, c);    /* includes the '/' */
+        aargv[0] = prog;
+    }
+
     /* we want to use pipes whenever it's a CGI or directory */
     /* otherwise (NPH, gunzip) we want no pipes */
     if (req->cgi_type == CGI ||
@@ -430,257 +744,101 @@ int init_cgi(request * req)
          (req->pathname[strlen(req->pathname) - 1] == '/'))) {
         use_pipes = 1;
         if (pipe(pipes) == -1) {
-            log_error_doc(req);
-            perror("pipe");
-            return 0;
+            boa_perror(req, "pipe");
+            goto out;
         }
 
         /* set the read end of the socket to non-blocking */
         if (set_nonblock_fd(pipes[0]) == -1) {
-            log_error_doc(req);
-            perror("cgi-fcntl");
-            close(pipes[0]);
-            close(pipes[1]);
-            return 0;
-        }
-    }
-
-    child_pid = fork();
-    switch (child_pid) {
-    case -1:
-        /* fork unsuccessful */
-        /* FIXME: There is a problem here. send_r_error (called by
-         * boa_perror) would work for NPH and CGI, but not for GUNZIP.  
-         * Fix that. 
-         */
-        boa_perror(req, "fork failed");
-        if (use_pipes) {
+            boa_perror(req, "cgi-fcntl");
             close(pipes[0]);
             close(pipes[1]);
+            goto out;
         }
-        return 0;
-        break;
-    case 0:
-        /* child */
-        reset_signals();
-
-        if (req->cgi_type == CGI || req->cgi_type == NPH) {
-            char *c;
-            unsigned int l;
-            char *newpath, *oldpath;
-
-            c = strrchr(req->pathname, '/');
-            if (!c) {
-                /* there will always be a '.' */
-                log_error_doc(req);
-                fprintf(stderr,
-                        "unable to find '/' in req->pathname: \"%s\"\n",
-                        req->pathname);
-                if (use_pipes)
-                    close(pipes[1]);
-                _exit(EXIT_FAILURE);
-            }
-
-            *c = '\0';
-
-            if (chdir(req->pathname) != 0) {
-                int saved_errno = errno;
-                log_error_doc(req);
-                fprintf(stderr, "Could not chdir to \"%s\":",
-                        req->pathname);
-                errno = saved_errno;
-                perror("chdir");
-                if (use_pipes)
-                    close(pipes[1]);
-                _exit(EXIT_FAILURE);
-            }
 
-            oldpath = req->pathname;
-            req->pathname = ++c;
-            l = strlen(req->pathname) + 3;
-            /* prefix './' */
-            newpath = malloc(sizeof (char) * l);
-            if (!newpath) {
-                /* there will always be a '.' */
-                log_error_doc(req);
-                perror("unable to malloc for newpath");
-                if (use_pipes)
-                    close(pipes[1]);
-                _exit(EXIT_FAILURE);
-            }
-            newpath[0] = '.';
-            newpath[1] = '/';
-            memcpy(&newpath[2], req->pathname, l - 2); /* includes the trailing '\0' */
-            free(oldpath);
-            req->pathname = newpath;
-        }
-        if (use_pipes) {
-            /* close the 'read' end of the pipes[] */
-            close(pipes[0]);
-            /* tie CGI's STDOUT to our write end of pipe */
-            if (dup2(pipes[1], STDOUT_FILENO) == -1) {
-                log_error_doc(req);
-                perror("dup2 - pipes");
-                _exit(EXIT_FAILURE);
-            }
-            close(pipes[1]);
-        } else {
-            /* tie stdout to socket */
-            if (dup2(req->fd, STDOUT_FILENO) == -1) {
-                log_error_doc(req);
-                perror("dup2 - fd");
-                _exit(EXIT_FAILURE);
-            }
-            close(req->fd);
-        }
-        /* Switch socket flags back to blocking */
-        if (set_block_fd(STDOUT_FILENO) == -1) {
+#ifdef F_SETPIPE_SZ
+        /* not fatal: the kernel may cap it at fs.pipe-max-size */
+        if (cgi_pipe_size &&
+            fcntl(pipes[0], F_SETPIPE_SZ, cgi_pipe_size) == -1 &&
+            verbose_cgi_logs) {
             log_error_doc(req);
-            perror("cgi-fcntl");
-            _exit(EXIT_FAILURE);
-        }
-        /* tie post_data_fd to POST stdin */
-        if (req->method == M_POST) { /* tie stdin to file */
-            lseek(req->post_data_fd, SEEK_SET, 0);
-            dup2(req->post_data_fd, STDIN_FILENO);
-            close(req->post_data_fd);
-        }
-
-#ifdef USE_SETRLIMIT
-        /* setrlimit stuff.
-         * This is neat!
-         * RLIMIT_STACK    max stack size
-         * RLIMIT_CORE     max core file size
-         * RLIMIT_RSS      max resident set size
-         * RLIMIT_NPROC    max number of processes
-         * RLIMIT_NOFILE   max number of open files
-         * RLIMIT_MEMLOCK  max locked-in-memory address space
-         * RLIMIT_AS       address space (virtual memory) limit
-         *
-         * RLIMIT_CPU      CPU time in seconds
-         * RLIMIT_DATA     max data size
-         *
-         * Currently, we only limit the CPU time and the DATA segment
-         * We also "nice" the process.
-         *
-         * This section of code adapted from patches sent in by Steve Thompson
-         * (no email available)
-         */
-
-        {
-            struct rlimit rl;
-            int retval;
-
-            if (cgi_rlimit_cpu) {
-                rl.rlim_cur = rl.rlim_max = cgi_rlimit_cpu;
-                retval = setrlimit(RLIMIT_CPU, &rl);
-                if (retval == -1) {
-                    log_error_time();
-                    fprintf(stderr,
-                            "setrlimit(RLIMIT_CPU,%d): %s\n",
-                            rlimit_cpu, strerror(errno));
-                    _exit(EXIT_FAILURE);
-                }
-            }
-
-            if (cgi_limit_data) {
-                rl.rlim_cur = rl.rlim_max = cgi_rlimit_data;
-                retval = setrlimit(RLIMIT_DATA, &rl);
-                if (retval == -1) {
-                    log_error_time();
-                    fprintf(stderr,
-                            "setrlimit(RLIMIT_DATA,%d): %s\n",
-                            rlimit_data, strerror(errno));
-                    _exit(EXIT_FAILURE);
-                }
-            }
-
-            if (cgi_nice) {
-                retval = nice(cgi_nice);
-                if (retval == -1) {
-                    log_error_time();
-                    perror("nice");
-                    _exit(EXIT_FAILURE);
-                }
-            }
+            perror("F_SETPIPE_SZ");
         }
 #endif
+    }
 
-        umask(cgi_umask);       /* change umask *again* u=rwx,g=rxw,o= */
+    /* our handlers must not run in the child, which shares our
+     * memory: hold all signals until it has put them back (and
+     * unblocked them all, including those signal_fd takes) */
+    fail.what = NULL;
+    sigfillset(&all);
+    sigprocmask(SIG_BLOCK, &all, &saved);
+    child_pid = vfork();
+    if (child_pid == 0) {
+        reset_signals();
+        cgi_child(req, use_pipes ? pipes : NULL, dir, aargv, &fail);
+        _exit(EXIT_FAILURE);
+    }
+    sigprocmask(SIG_SETMASK, &saved, NULL);
 
-        /*
-         * tie STDERR to cgi_log_fd
-         * cgi_log_fd will automatically close, close-on-exec rocks!
-         * if we don't tie STDERR (current log_error) to cgi_log_fd,
-         *  then we ought to tie it to /dev/null
-         *  FIXME: we currently don't tie it to /dev/null, we leave it
-         *  tied to whatever 'error_log' points to.  This means CGIs can
-         *  scribble on the error_log, probably a bad thing.
+    if (child_pid == -1 || fail.what) {
+        /* FIXME: There is a problem here. send_r_error (called by
+         * boa_perror) would work for NPH and CGI, but not for GUNZIP.
+         * Fix that.
          */
-        if (cgi_log_fd) {
-            dup2(cgi_log_fd, STDERR_FILENO);
-        }
-
-        if (req->cgi_type) {
-            char *aargv[CGI_ARGC_MAX + 1];
-            create_argv(req, aargv);
-            execve(req->pathname, aargv, req->cgi_env);
-        } else {
-            if (req->pathname[strlen(req->pathname) - 1] == '/')
-                execl(dirmaker, dirmaker, req->pathname, req->request_uri,
-                      (void *) NULL);
-#ifdef GUNZIP
-            else
-                execl(GUNZIP, GUNZIP, "--stdout", "--decompress",
-                      req->pathname, (void *) NULL);
-#endif
+        if (fail.what)
+            errno = fail.error;
+        boa_perror(req, child_pid == -1 ? "vfork failed" : fail.what);
+        if (use_pipes) {
+            close(pipes[0]);
+            close(pipes[1]);
         }
-        /* execve failed */
-        log_error_doc(req);
-        fprintf(stderr, "Unable to execve/execl pathname: \"%s\"",
-                req->pathname);
-        perror("");
-        _exit(EXIT_FAILURE);
-        break;
+        goto out;
+    }
 
-    default:
-        /* parent */
-        /* if here, fork was successful */
-        if (verbose_cgi_logs) {
-            log_error_time();
-            fprintf(stderr, "Forked child \"%s\" pid %d\n",
-                    req->pathname, child_pid);
-        }
+    /* if here, the child is running */
+    cgi_started(req, child_pid, use_pipes);
+    if (verbose_cgi_logs) {
+        log_error_time();
+        fprintf(stderr, "Started child \"%s\" pid %d\n",
+                req->pathname, child_pid);
+    }
+    free(dir);
+    free(prog);
+    free(words);
 
-        if (req->method == M_POST) {
-            close(req->post_data_fd); /* child closed it too */
-            req->post_data_fd = 0;
-        }
+    if (req->method == M_POST) {
+        close(req->post_data_fd); /* child closed it too */
+        req->post_data_fd = 0;
+    }
 
-        /* NPH, GUNZIP, etc... all go straight to the fd */
-        if (!use_pipes)
-            return 0;
+    /* NPH, GUNZIP, etc... all go straight to the fd */
+    if (!use_pipes)
+        return 0;
 
-        close(pipes[1]);
-        req->data_fd = pipes[0];
-
-        req->status = PIPE_READ;
-        if (req->cgi_type == CGI) {
-            req->cgi_status = CGI_PARSE; /* got to parse cgi header */
-            /* for cgi_header... I get half the buffer! */
-            req->header_line = req->header_end =
-                (req->buffer + BUFFER_SIZE / 2);
-        } else {
-            req->cgi_status = CGI_BUFFER;
-            /* I get all the buffer! */
-            req->header_line = req->header_end = req->buffer;
-        }
+    close(pipes[1]);
+    req->data_fd = pipes[0];
 
-        /* reset req->filepos for logging (it's used in pipe.c) */
-        /* still don't know why req->filesize might be reset though */
-        req->filepos = 0;
-        break;
+    req->status = PIPE_READ;
+    if (req->cgi_type == CGI) {
+        req->cgi_status = CGI_PARSE; /* got to parse cgi header */
+        /* for cgi_header... I get half the buffer! */
+        req->header_line = req->header_end =
+            (req->buffer + BUFFER_SIZE / 2);
+    } else {
+        req->cgi_status = CGI_BUFFER;
+        /* I get all the buffer! */
+        req->header_line = req->header_end = req->buffer;
     }
 
+    /* reset req->filepos for logging (it's used in pipe.c) */
+    /* still don't know why req->filesize might be reset though */
+    req->filepos = 0;
     return 1;
+
+  out:
+    free(dir);
+    free(prog);
+    free(words);
+    return 0;
 }
@@ -0,0 +1,863 @@
+/*
+ *  Boa, an http server
+ *  Copyright (C) 1999-2005 Larry Doolittle <ldoolitt@boa.org>
+ *  Copyright (C) 2000-2005 Jon Nelson <jnelson@boa.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 1, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/* $Id$*/
+
+/*
+ * Cache of CGI responses (CGICache, CGICacheKey, CGICacheSize,
+ * CGICacheSpool).
+ *
+ * A GET under a CGICache path is looked up by script, path info,
+ * query string, host, and the request headers named by CGICacheKey.
+ * On a miss the request becomes the "filler": its CGI runs as usual,
+ * and what it sends is kept as well.  A response is stored only if the
+ * CGI says it may be -- a 200 with Cache-Control max-age (or s-maxage)
+ * or Expires, no Set-Cookie, and no Vary beyond the CGICacheKey
+ * headers -- and for no longer than the CGICache line allows.
+ *
+ * As a shared cache may (RFC 2616 14.8), it answers a request with
+ * Authorization only from a response marked public or with s-maxage,
+ * and stores what such a request gets only if it is so marked.  The
+ * other request headers, Cookie among them, are not looked at: a CGI
+ * whose response depends on one has to have it named by CGICacheKey.
+ *
+ * Requests for the same key while the filler is running wait in the
+ * CGI_CACHE_WAIT state, parked with no fd like CGI_WAIT, and are
+ * readied when it is done: one CGI runs, not one per request.  If the
+ * response can't be stored, the key is remembered for
+ * CGI_CACHE_PASS_TIME seconds, so that requests don't queue up behind
+ * one another for nothing.
+ *
+ * Hits are sent like static files: from memory by process_get, or,
+ * for bodies over MmapMaxFileSize when there is a CGICacheSpool, from
+ * an unlinked file there by io_shuffle_sendfile.  Entries are
+ * reference counted like those of the index cache, and the least
+ * recently used go when CGICacheSize is reached.
+ */
+
+#include "boa.h"
+
+enum CGI_CACHE_STATE { CGI_CACHE_FILLING, CGI_CACHE_STORED, CGI_CACHE_PASS };
+
+struct cgi_cache_rule {
+    char *prefix;               /* of the URL */
+    unsigned int prefix_len;
+    unsigned int max_age;
+    struct cgi_cache_rule *next;
+};
+
+struct cgi_cache_key {
+    char *name;                 /* the header, as for Vary */
+    char *env;                  /* HTTP_NAME= */
+    unsigned int env_len;
+    struct cgi_cache_key *next;
+};
+
+struct cgi_cache_entry {
+    char *key;                  /* '\0'-separated fields */
+    unsigned int key_len;
+    unsigned int hash;
+    enum CGI_CACHE_STATE state;
+    unsigned int max_age;       /* of the CGICache line */
+    time_t stored;
+    time_t expires;
+    int shared;                 /* public or s-maxage */
+    int filler_auth;            /* the filler has Authorization */
+
+    char *header;               /* the CGI's header lines, CRLF ended */
+    off_t content_length;       /* as the CGI gave it, or -1 */
+    char *body;                 /* NULL if spooled */
+    off_t body_len;
+    off_t body_size;            /* allocated, while filling */
+    int spool_fd;               /* -1 unless spooled */
+    off_t size;                 /* counted against CGICacheSize */
+
+    request *filler;
+    request *waiting;           /* through req->cgi_cache_next */
+    int use_count;
+    int cached;                 /* in the table */
+    struct cgi_cache_entry *hash_next;
+    struct cgi_cache_entry *lru_prev, *lru_next;
+};
+
+static struct cgi_cache_rule *cgi_cache_rules = NULL;
+static struct cgi_cache_key *cgi_cache_keys = NULL;
+
+static struct cgi_cache_entry *cgi_cache_table[CGI_CACHE_HASH_SIZE];
+/* stored and passed entries, most recently used first */
+static struct cgi_cache_entry *lru_head = NULL, *lru_tail = NULL;
+static off_t cgi_cache_bytes = 0;
+
+/*
+ * Name: cgi_cache_add
+ * Description: For a CGICache line.
+ */
+
+void cgi_cache_add(const char *prefix, const char *max_age)
+{
+    struct cgi_cache_rule *r;
+    char *end;
+    long n;
+
+    n = (max_age ? strtol(max_age, &end, 10) : -1);
+    if (n < 1 || *end != '\0') {
+        log_error_time();
+        fprintf(stderr, "CGICache %s: want a number of seconds\n", prefix);
+        exit(EXIT_FAILURE);
+    }
+
+    r = calloc(1, sizeof (struct cgi_cache_rule));
+    if (r == NULL || (r->prefix = strdup(prefix)) == NULL)
+        DIE("out of memory adding CGICache");
+    r->prefix_len = strlen(prefix);
+    r->max_age = n;
+    r->next = cgi_cache_rules;
+    cgi_cache_rules = r;
+}
+
+/*
+ * Name: cgi_cache_key_add
+ * Description: For a CGICacheKey line: the request header is looked
+ * for among the CGI variables, as HTTP_NAME.
+ */
+
+void cgi_cache_key_add(const char *header)
+{
+    struct cgi_cache_key *k;
+
+    k = calloc(1, sizeof (struct cgi_cache_key));
+    if (k == NULL || (k->name = strdup(header)) == NULL ||
+        (k->env = malloc(strlen(header) + 7)) == NULL)
+        DIE("out of memory adding CGICacheKey");
+    memcpy(k->env, "HTTP_", 5);
+    strcpy(k->env + 5, header);
+    to_upper(k->env + 5);
+    strcat(k->env, "=");
+    k->env_len = strlen(k->env);
+    k->next = cgi_cache_keys;
+    cgi_cache_keys = k;
+}
+
+static void cgi_cache_free(struct cgi_cache_entry *e)
+{
+    if (e->spool_fd != -1)
+        close(e->spool_fd);
+    free(e->body);
+    free(e->header);
+    free(e->key);
+    free(e);
+}
+
+static void lru_unlink(struct cgi_cache_entry *e)
+{
+    if (e->lru_prev)
+        e->lru_prev->lru_next = e->lru_next;
+    else
+        lru_head = e->lru_next;
+    if (e->lru_next)
+        e->lru_next->lru_prev = e->lru_prev;
+    else
+        lru_tail = e->lru_prev;
+    e->lru_prev = e->lru_next = NULL;
+}
+
+static void lru_push(struct cgi_cache_entry *e)
+{
+    e->lru_prev = NULL;
+    e->lru_next = lru_head;
+    if (lru_head)
+        lru_head->lru_prev = e;
+    else
+        lru_tail = e;
+    lru_head = e;
+}
+
+/* a hit: e is now the most recently used */
+static void lru_touch(struct cgi_cache_entry *e)
+{
+    if (e->cached && e != lru_head) {
+        lru_unlink(e);
+        lru_push(e);
+    }
+}
+
+/*
+ * Name: cgi_cache_remove
+ * Description: Takes an entry out of the table.  It is freed once
+ * nothing uses it.
+ */
+
+static void cgi_cache_remove(struct cgi_cache_entry *e)
+{
+    struct cgi_cache_entry **p;
+
+    if (!e->cached)
+        return;
+    for (p = &cgi_cache_table[e->hash & CGI_CACHE_HASH_MASK]; *p;
+         p = &(*p)->hash_next) {
+        if (*p == e) {
+            *p = e->hash_next;
+            break;
+        }
+    }
+    if (e->state != CGI_CACHE_FILLING) {
+        lru_unlink(e);
+        cgi_cache_bytes -= e->size;
+    }
+    e->cached = 0;
+    if (e->use_count == 0)
+        cgi_cache_free(e);
+}
+
+static void cgi_cache_release(struct cgi_cache_entry *e)
+{
+    if (--e->use_count == 0 && !e->cached)
+        cgi_cache_free(e);
+}
+
+/*
+ * Name: cgi_cache_wake
+ * Description: Readies the requests waiting for e's filler, which
+ * has finished or given up.  They find out which in cgi_cache_lookup.
+ */
+
+static void cgi_cache_wake(struct cgi_cache_entry *e)
+{
+    request *req, *next;
+
+    for (req = e->waiting; req; req = next) {
+        next = req->cgi_cache_next;
+        req->cgi_cache_next = NULL;
+        ready_request(req);
+    }
+    e->waiting = NULL;
+}
+
+/*
+ * Name: cgi_cache_abandon
+ * Description: The filler's response won't be stored.  With pass set,
+ * the key is remembered as not worth waiting for.
+ */
+
+static void cgi_cache_abandon(request * req, int pass)
+{
+    struct cgi_cache_entry *e = req->cgi_cache;
+
+    e->filler = NULL;
+    req->cgi_cache = NULL;
+    free(e->body);
+    e->body = NULL;
+    e->body_len = e->body_size = 0;
+
+    if (pass && e->cached) {
+        e->state = CGI_CACHE_PASS;
+        e->expires = current_time + CGI_CACHE_PASS_TIME;
+        e->size = sizeof (struct cgi_cache_entry) + e->key_len;
+        cgi_cache_bytes += e->size;
+        lru_push(e);
+    } else {
+        cgi_cache_remove(e);
+        e->state = CGI_CACHE_PASS;
+    }
+    cgi_cache_wake(e);
+    cgi_cache_release(e);
+}
+
+/*
+ * Name: cgi_cache_make_key
+ * Description: The key for req, in *len bytes of malloced memory.
+ */
+
+static char *cgi_cache_make_key(request * req, unsigned int *len)
+{
+    const char *field[4];
+    struct cgi_cache_key *k;
+    unsigned int n, i;
+    char *key, *p;
+
+    field[0] = req->pathname;
+    field[1] = (req->path_info ? req->path_info : "");
+    field[2] = (req->query_string ? req->query_string : "");
+    field[3] = (req->host ? req->host : "");
+
+    n = 0;
+    for (i = 0; i < 4; ++i)
+        n += strlen(field[i]) + 1;
+    /* HTTP_ variables are set as the header is read; the common ones
+     * before them only come with complete_env */
+    for (k = cgi_cache_keys; k; k = k->next) {
+        for (i = common_cgi_env_count; i < (unsigned) req->cgi_env_index;
+             ++i) {
+            if (!strncmp(req->cgi_env[i], k->env, k->env_len))
+                break;
+        }
+        n += (i < (unsigned) req->cgi_env_index ?
+              strlen(req->cgi_env[i]) - k->env_len : 0) + 1;
+    }
+
+    key = p = malloc(n);
+    if (key == NULL)
+        return NULL;
+    for (i = 0; i < 4; ++i) {
+        strcpy(p, field[i]);
+        p += strlen(p) + 1;
+    }
+    for (k = cgi_cache_keys; k; k = k->next) {
+        *p = '\0';
+        for (i = common_cgi_env_count; i < (unsigned) req->cgi_env_index;
+             ++i) {
+            if (!strncmp(req->cgi_env[i], k->env, k->env_len)) {
+                strcpy(p, req->cgi_env[i] + k->env_len);
+                break;
+            }
+        }
+        p += strlen(p) + 1;
+    }
+    *len = n;
+    return key;
+}
+
+/* whether req has the header of env ("HTTP_NAME=") */
+static int cgi_cache_has(request * req, const char *env)
+{
+    unsigned int i, len = strlen(env);
+
+    for (i = common_cgi_env_count; i < (unsigned) req->cgi_env_index; ++i) {
+        if (!strncmp(req->cgi_env[i], env, len))
+            return 1;
+    }
+    return 0;
+}
+
+static unsigned int cgi_cache_hash(const char *key, unsigned int len)
+{
+    unsigned int h = 2166136261U;
+
+    while (len--) {
+        h ^= (unsigned char) *key++;
+        h *= 16777619U;
+    }
+    return h;
+}
+
+/*
+ * Name: cgi_cache_send
+ * Description: Starts sending a stored response, the way start_entity
+ * does for a file.  Any Range is ignored: the whole of it is sent.
+ *
+ * Return values: as for init_get
+ */
+
+static int cgi_cache_send(request * req, struct cgi_cache_entry *e)
+{
+    req->cgi_cache = e;
+    req->filesize = e->body_len;
+
+    if (req->ranges)
+        ranges_reset(req);
+    req->ranges = range_pool_pop();
+    req->ranges->start = 0;
+    req->ranges->stop = -1;
+    if (!ranges_fixup(req))
+        return 0;
+
+    send_r_request_ok(req);     /* cgi_type is set: no entity headers */
+    if (req->http_version != HTTP09) {
+        req_write(req, "Age: ");
+        req_write(req, simple_itoa(current_time - e->stored));
+        req_write(req, CRLF);
+        print_content_length(req);
+        req_write(req, e->header);
+        req_write(req, CRLF);
+    }
+
+    if (req->method == M_HEAD)
+        return complete_response(req);
+
+    if (e->spool_fd != -1) {
+        req->data_fd = dup(e->spool_fd);
+        if (req->data_fd == -1) {
+            req->data_fd = 0;
+            boa_perror(req, "dup of CGICacheSpool file");
+            return 0;
+        }
+        req->status = IOSHUFFLE;
+    } else {
+        req->data_mem = e->body;
+        req->status = WRITE;
+    }
+    return 1;
+}
+
+/*
+ * Name: cgi_cache_lookup
+ * Description: Called by init_cgi for a CGI request, before anything
+ * else is done for it, and by cgi_resume for one readied from
+ * CGI_CACHE_WAIT.
+ *
+ * Return values:
+ *  -1: wait (the request is in CGI_CACHE_WAIT, to be blocked)
+ *   0: finished or error, request will be freed
+ *   1: a stored response is being sent
+ *   2: run the CGI; its response will be stored if req->cgi_cache
+ *      is set
+ */
+
+int cgi_cache_lookup(request * req)
+{
+    struct cgi_cache_rule *r;
+    struct cgi_cache_entry *e;
+    unsigned int len, hash;
+    char *key;
+    int auth;
+
+    if (req->status == CGI_CACHE_WAIT) {
+        e = req->cgi_cache;
+        req->status = WRITE;    /* as when init_cgi was called */
+        if (e->state == CGI_CACHE_STORED) {
+            lru_touch(e);
+            return cgi_cache_send(req, e);
+        }
+        /* the filler gave up: see what there is now */
+        req->cgi_cache = NULL;
+        cgi_cache_release(e);
+    }
+
+    if (req->cgi_type != CGI ||
+        (req->method != M_GET && req->method != M_HEAD))
+        return 2;
+    for (r = cgi_cache_rules; r; r = r->next) {
+        if (!strncmp(req->request_uri, r->prefix, r->prefix_len))
+            break;
+    }
+    if (r == NULL)
+        return 2;
+    auth = cgi_cache_has(req, "HTTP_AUTHORIZATION=");
+
+    key = cgi_cache_make_key(req, &len);
+    if (key == NULL)
+        return 2;
+    hash = cgi_cache_hash(key, len);
+
+    for (e = cgi_cache_table[hash & CGI_CACHE_HASH_MASK]; e;
+         e = e->hash_next) {
+        if (e->hash == hash && e->key_len == len &&
+            !memcmp(e->key, key, len))
+            break;
+    }
+    if (e && e->state != CGI_CACHE_FILLING && e->expires <= current_time) {
+        cgi_cache_remove(e);
+        e = NULL;
+    }
+
+    if (e) {
+        free(key);
+        switch (e->state) {
+        case CGI_CACHE_STORED:
+            if (auth && !e->shared)
+                return 2;
+            e->use_count++;
+            lru_touch(e);
+            return cgi_cache_send(req, e);
+        case CGI_CACHE_FILLING:
+            /* the filler's response might not be one to share */
+            if (req->method == M_HEAD || auth)
+                return 2;
+            e->use_count++;
+            req->cgi_cache = e;
+            req->cgi_cache_next = e->waiting;
+            e->waiting = req;
+            req->status = CGI_CACHE_WAIT;
+            return -1;
+        case CGI_CACHE_PASS:
+            return 2;
+        }
+    }
+
+    if (req->method == M_HEAD) {
+        free(key);
+        return 2;
+    }
+    e = calloc(1, sizeof (struct cgi_cache_entry));
+    if (e == NULL) {
+        free(key);
+        return 2;
+    }
+    e->key = key;
+    e->key_len = len;
+    e->hash = hash;
+    e->state = CGI_CACHE_FILLING;
+    e->max_age = r->max_age;
+    e->content_length = -1;
+    e->spool_fd = -1;
+    e->filler = req;
+    e->filler_auth = auth;
+    e->use_count = 1;
+    e->cached = 1;
+    e->hash_next = cgi_cache_table[hash & CGI_CACHE_HASH_MASK];
+    cgi_cache_table[hash & CGI_CACHE_HASH_MASK] = e;
+    req->cgi_cache = e;
+    return 2;
+}
+
+/* the value of a "name=value" token in a Cache-Control header */
+static long cc_seconds(const char *s, unsigned int len, const char *name)
+{
+    unsigned int n = strlen(name);
+
+    if (len <= n || strncasecmp(s, name, n) || s[n] != '=')
+        return -2;
+    return atol(s + n + 1);
+}
+
+/* whether a token of a Vary header is among the CGICacheKey headers */
+static int vary_ok(const char *s, unsigned int len)
+{
+    struct cgi_cache_key *k;
+
+    for (k = cgi_cache_keys; k; k = k->next) {
+        if (strlen(k->name) == len && !strncasecmp(s, k->name, len))
+            return 1;
+    }
+    return 0;
+}
+
+/*
+ * Name: cgi_cache_header
+ * Description: Called by process_cgi_header for the filler with the
+ * header lines the CGI sent, from start up to end.  Decides whether
+ * the response may be stored, and for how long, and keeps the lines
+ * to send with it.
+ */
+
+void cgi_cache_header(request * req, const char *start, const char *end)
+{
+    struct cgi_cache_entry *e = req->cgi_cache;
+    long max_age = -1, s_maxage = -1;
+    time_t expires = -1;
+    int has_expires = 0, pass = 0, is_public = 0;
+    const char *line, *eol, *colon, *v, *t;
+    unsigned int n;
+    char *h;
+    long lifetime;
+
+    h = malloc(2 * (end - start) + 1); /* room for CRs */
+    if (h == NULL) {
+        cgi_cache_abandon(req, 0);
+        return;
+    }
+    n = 0;
+
+    for (line = start; line < end && !pass; line = eol + 1) {
+        unsigned int len;
+
+        eol = memchr(line, '\n', end - line);
+        if (eol == NULL)
+            eol = end;
+        len = eol - line;
+        while (len && line[len - 1] == '\r')
+            --len;
+        if (len == 0)
+            continue;
+        colon = memchr(line, ':', len);
+        if (colon == NULL)
+            continue;
+        for (v = colon + 1; v < line + len && (*v == ' ' || *v == '\t'); ++v);
+
+#define IS(name) (colon - line == sizeof (name) - 1 && \
+                  !strncasecmp(line, name, sizeof (name) - 1))
+        if (IS("Status")) {
+            if (atoi(v) != 200)
+                pass = 1;
+            continue;
+        } else if (IS("Location") || IS("Set-Cookie")) {
+            pass = 1;
+        } else if (IS("Content-Length")) {
+            e->content_length = boa_atoo(v);
+            continue;
+        } else if (IS("Connection")) {
+            continue;
+        } else if (IS("Expires")) {
+            char date[64];
+            unsigned int dlen = line + len - v;
+
+            has_expires = 1;
+            if (dlen < sizeof (date)) {
+                memcpy(date, v, dlen);
+                date[dlen] = '\0';
+                expires = http_date(date);
+            }
+        } else if (IS("Cache-Control") || IS("Vary")) {
+            int is_vary = IS("Vary");
+
+            for (t = v; t < line + len; ) {
+                unsigned int tlen;
+                long s;
+
+                while (t < line + len && (*t == ' ' || *t == ','))
+                    ++t;
+                for (tlen = 0; t + tlen < line + len && t[tlen] != ',';
+                     ++tlen);
+                while (tlen && t[tlen - 1] == ' ')
+                    --tlen;
+                if (tlen == 0)
+                    break;
+                if (is_vary) {
+                    if (!vary_ok(t, tlen))
+                        pass = 1;
+                } else if ((tlen == 8 && !strncasecmp(t, "no-store", 8)) ||
+                           (tlen == 8 && !strncasecmp(t, "no-cache", 8)) ||
+                           (tlen == 7 && !strncasecmp(t, "private", 7))) {
+                    pass = 1;
+                } else if (tlen == 6 && !strncasecmp(t, "public", 6)) {
+                    is_public = 1;
+                } else if ((s = cc_seconds(t, tlen, "max-age")) != -2) {
+                    max_age = s;
+                } else if ((s = cc_seconds(t, tlen, "s-maxage")) != -2) {
+                    s_maxage = s;
+                }
+                t += tlen;
+            }
+        }
+#undef IS
+        memcpy(h + n, line, len);
+        n += len;
+        memcpy(h + n, CRLF, 2);
+        n += 2;
+    }
+    h[n] = '\0';
+
+    /* s-maxage, then max-age, override Expires (RFC 2616 14.9.3) */
+    if (s_maxage >= 0)
+        lifetime = s_maxage;
+    else if (max_age >= 0)
+        lifetime = max_age;
+    else if (has_expires)
+        lifetime = (expires == -1 ? 0 : expires - current_time);
+    else
+        lifetime = 0;           /* nothing says it may be kept */
+    if (lifetime > (long) e->max_age)
+        lifetime = e->max_age;
+
+    if (pass || lifetime <= 0 || n > BUFFER_SIZE / 2) {
+        free(h);
+        cgi_cache_abandon(req, 1);
+        return;
+    }
+    e->shared = (is_public || s_maxage >= 0);
+    if (e->filler_auth && !e->shared) {
+        /* a request without Authorization may yet store it */
+        free(h);
+        cgi_cache_abandon(req, 0);
+        return;
+    }
+    e->header = h;
+    e->stored = current_time;
+    e->expires = current_time + lifetime;
+}
+
+/*
+ * Name: cgi_cache_body
+ * Description: Called by read_from_pipe (and process_cgi_header) for
+ * the filler with body data as it comes from the CGI.
+ */
+
+void cgi_cache_body(request * req, const char *buf, unsigned int len)
+{
+    struct cgi_cache_entry *e = req->cgi_cache;
+
+    if (e->header == NULL || len == 0)
+        return;
+    if (e->body_len + len > (off_t) cgi_cache_size / CGI_CACHE_ENTRY_PART) {
+        cgi_cache_abandon(req, 1);
+        return;
+    }
+    if (e->body_len + len > e->body_size) {
+        off_t size = (e->body_size ? e->body_size * 2 : BUFFER_SIZE);
+        char *p;
+
+        while (size < e->body_len + len)
+            size *= 2;
+        p = realloc(e->body, size);
+        if (p == NULL) {
+            cgi_cache_abandon(req, 0);
+            return;
+        }
+        e->body = p;
+        e->body_size = size;
+    }
+    memcpy(e->body + e->body_len, buf, len);
+    e->body_len += len;
+}
+
+/*
+ * Name: cgi_cache_spool
+ * Description: Moves a body bigger than MmapMaxFileSize out to an
+ * unlinked file in CGICacheSpool, to be sent with sendfile.  If that
+ * can't be done, the body stays in memory.
+ */
+
+static void cgi_cache_spool(struct cgi_cache_entry *e)
+{
+    char name[MAX_PATH_LENGTH + 1];
+    off_t done;
+    int fd, n;
+
+    if (snprintf(name, sizeof (name), "%s/boa-cgi.XXXXXX",
+                 cgi_cache_spool_dir) >= (int) sizeof (name))
+        return;
+    fd = mkstemp(name);
+    if (fd == -1) {
+        log_error_time();
+        perror("mkstemp in CGICacheSpool");
+        return;
+    }
+    unlink(name);
+    for (done = 0; done < e->body_len; done += n) {
+        n = write(fd, e->body + done, e->body_len - done);
+        if (n == -1 && errno == EINTR)
+            n = 0;
+        else if (n <= 0) {
+            log_error_time();
+            perror("write to CGICacheSpool");
+            close(fd);
+            return;
+        }
+    }
+    free(e->body);
+    e->body = NULL;
+    e->spool_fd = fd;
+}
+
+/*
+ * Name: cgi_cache_finish
+ * Description: Called by read_from_pipe for the filler when the CGI's
+ * output has ended: the response is stored, and those waiting for it
+ * readied.
+ */
+
+void cgi_cache_finish(request * req)
+{
+    struct cgi_cache_entry *e = req->cgi_cache;
+
+    if (e->header == NULL || e->body_len == 0 ||
+        (e->content_length != -1 && e->content_length != e->body_len)) {
+        /* no header, or a short (or empty) body */
+        cgi_cache_abandon(req, 0);
+        return;
+    }
+    if (cgi_cache_spool_dir && e->body_len > (off_t) max_file_mmap)
+        cgi_cache_spool(e);
+    else if (e->body_size > e->body_len) {
+        char *p = realloc(e->body, e->body_len);
+
+        if (p)
+            e->body = p;
+    }
+    e->body_size = e->body_len;
+    e->state = CGI_CACHE_STORED;
+    e->filler = NULL;
+    req->cgi_cache = NULL;
+
+    if (e->cached) {
+        e->size = sizeof (struct cgi_cache_entry) + e->key_len +
+            strlen(e->header) + e->body_len;
+        cgi_cache_bytes += e->size;
+        lru_push(e);
+        /* make room, oldest first; e itself is last to go */
+        while (cgi_cache_bytes > (off_t) cgi_cache_size && lru_tail)
+            cgi_cache_remove(lru_tail);
+    }
+    cgi_cache_wake(e);
+    cgi_cache_release(e);
+}
+
+/*
+ * Name: cgi_cache_failed
+ * Description: Called from cgi_limit.c when a CGI is killed, or exits
+ * with an error.  If it was a filler's, what it sent isn't stored, and
+ * the requests waiting for it run their own rather than taking turns
+ * at failing.
+ */
+
+void cgi_cache_failed(request * req)
+{
+    if (req->cgi_cache && req->cgi_cache->filler == req)
+        cgi_cache_abandon(req, 1);
+}
+
+/*
+ * Name: cgi_cache_forget
+ * Description: Called by free_request for any request with
+ * req->cgi_cache set.  A filler gives up, and a waiter stops waiting.
+ */
+
+void cgi_cache_forget(request * req)
+{
+    struct cgi_cache_entry *e = req->cgi_cache;
+    request **p;
+
+    if (e->filler == req) {
+        cgi_cache_abandon(req, 0);
+        return;
+    }
+    /* a waiter may be freed with another status (DEAD after a failed
+     * flush), so the list is searched whatever req->status says */
+    for (p = &e->waiting; *p; p = &(*p)->cgi_cache_next) {
+        if (*p == req) {
+            *p = req->cgi_cache_next;
+            break;
+        }
+    }
+    req->cgi_cache_next = NULL;
+    req->cgi_cache = NULL;
+    cgi_cache_release(e);
+}
+
+/*
+ * Name: dump_cgi_cache
+ * Description: On a SIGHUP: forgets the CGICache and CGICacheKey lines,
+ * and everything stored, since the scripts may have changed too.
+ * Entries still being sent or filled go when they are done.
+ */
+
+void dump_cgi_cache(void)
+{
+    struct cgi_cache_rule *r;
+    struct cgi_cache_key *k;
+    int i;
+
+    while ((r = cgi_cache_rules) != NULL) {
+        cgi_cache_rules = r->next;
+        free(r->prefix);
+        free(r);
+    }
+    while ((k = cgi_cache_keys) != NULL) {
+        cgi_cache_keys = k->next;
+        free(k->name);
+        free(k->env);
+        free(k);
+    }
+    for (i = 0; i < CGI_CACHE_HASH_SIZE; ++i) {
+        while (cgi_cache_table[i])
+            cgi_cache_remove(cgi_cache_table[i]);
+    }
+}
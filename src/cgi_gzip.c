@@ -0,0 +1,418 @@
+/*
+ *  Boa, an http server
+ *  Copyright (C) 1999-2005 Larry Doolittle <ldoolitt@boa.org>
+ *  Copyright (C) 2000-2005 Jon Nelson <jnelson@boa.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 1, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/* $Id$*/
+
+/*
+ * gzip compression of CGI output (CGIGzip, CGIGzipLevel).
+ *
+ * process_cgi_header asks cgi_gzip_start whether a response is to be
+ * compressed: its Content-Type must begin with one of the CGIGzip
+ * types, it mustn't have a Content-Encoding already, and the client's
+ * Accept-Encoding must take gzip.  If so, the CGI's header goes out
+ * without its Content-Length, and with Content-Encoding and Vary
+ * added.  CGI connections are not kept alive, so the end of the
+ * compressed body is the close of the connection.
+ *
+ * Output read from the CGI is compressed, from where read_from_pipe
+ * left it in req->buffer, into a buffer of our own, which
+ * cgi_gzip_write sends.  Compressed data is only flushed out ahead of
+ * time when the CGI has nothing more to say for now, so that a slow
+ * CGI's output isn't held back, nor a fast one's cut into small
+ * deflate blocks.
+ *
+ * zlib is needed; built without it (see Makefile.in), CGIGzip is an
+ * error.
+ */
+
+#include "boa.h"
+
+struct cgi_gzip_type {
+    char *type;                 /* of Content-Type, as a prefix */
+    unsigned int len;
+    struct cgi_gzip_type *next;
+};
+
+static struct cgi_gzip_type *cgi_gzip_types = NULL;
+
+/*
+ * Name: cgi_gzip_type_add
+ * Description: For a CGIGzip line.
+ */
+
+void cgi_gzip_type_add(const char *type)
+{
+#ifdef HAVE_ZLIB
+    struct cgi_gzip_type *t;
+
+    t = malloc(sizeof (struct cgi_gzip_type));
+    if (t == NULL || (t->type = strdup(type)) == NULL)
+        DIE("out of memory adding CGIGzip");
+    t->len = strlen(type);
+    t->next = cgi_gzip_types;
+    cgi_gzip_types = t;
+#else
+    log_error_time();
+    fprintf(stderr,
+            "This version of Boa doesn't support CGIGzip.\n"
+            "Please build it with zlib (see src/Makefile).\n");
+#endif
+}
+
+/*
+ * Name: dump_cgi_gzip
+ * Description: On a SIGHUP, forgets the CGIGzip lines.
+ */
+
+void dump_cgi_gzip(void)
+{
+    struct cgi_gzip_type *t;
+
+    while ((t = cgi_gzip_types) != NULL) {
+        cgi_gzip_types = t->next;
+        free(t->type);
+        free(t);
+    }
+}
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+
+struct cgi_gzip {
+    z_stream z;
+    int eof;                    /* all of the CGI's output is in */
+    int held;                   /* zlib holds some of it back */
+    int flush;                  /* the CGI is quiet: send what is held */
+    int done;                   /* the gzip trailer is out of deflate */
+    unsigned int out_start, out_end;
+    char out[BUFFER_SIZE];
+};
+
+/* the value of req's CGI variable name (which includes the '=') */
+static const char *cgi_env_value(request * req, const char *name)
+{
+    unsigned int len = strlen(name);
+    int i;
+
+    for (i = common_cgi_env_count; i < req->cgi_env_index; ++i) {
+        if (!strncmp(req->cgi_env[i], name, len))
+            return req->cgi_env[i] + len;
+    }
+    return NULL;
+}
+
+/*
+ * Name: accepts_gzip
+ * Description: Whether an Accept-Encoding header takes gzip (or
+ * x-gzip, or *) with a q-value above 0.
+ */
+
+static int accepts_gzip(const char *s)
+{
+    while (*s) {
+        const char *name, *end;
+        unsigned int len;
+        double q = 1;
+
+        while (*s == ' ' || *s == ',')
+            ++s;
+        name = s;
+        while (*s && *s != ',' && *s != ';' && *s != ' ')
+            ++s;
+        len = s - name;
+        end = s;
+        while (*end && *end != ',')
+            ++end;
+        for (; s < end; ++s) {
+            if (*s == 'q' && s[1] == '=') {
+                q = atof(s + 2);
+                break;
+            }
+        }
+        s = end;
+
+        if (((len == 4 && !strncasecmp(name, "gzip", 4)) ||
+             (len == 6 && !strncasecmp(name, "x-gzip", 6)) ||
+             (len == 1 && *name == '*')) && q > 0)
+            return 1;
+    }
+    return 0;
+}
+
+static int gzip_type(const char *type, unsigned int len)
+{
+    struct cgi_gzip_type *t;
+
+    for (t = cgi_gzip_types; t; t = t->next) {
+        if (len >= t->len && !strncasecmp(type, t->type, t->len))
+            return 1;
+    }
+    return 0;
+}
+
+#define ADDED_HEADERS "Content-Encoding: gzip" CRLF "Vary: Accept-Encoding" CRLF
+
+/*
+ * Name: cgi_gzip_start
+ * Description: Called by process_cgi_header, once the status line and
+ * our own headers are in req->buffer, with the CGI's header lines,
+ * from start up to end (where the blank line is).  If the response is
+ * to be compressed, the header is finished off in req->buffer, and
+ * compression is set up.
+ *
+ * Return values:
+ *  0: send the response as it is
+ *  1: compress it; the body is to be read from after the blank line
+ */
+
+int cgi_gzip_start(request * req, char *start, char *end)
+{
+    const char *accept;
+    char *line, *eol, *dest, *body;
+    unsigned int need, len;
+    int type = 0;
+    struct cgi_gzip *g;
+
+    if (cgi_gzip_types == NULL || req->method == M_HEAD ||
+        (accept = cgi_env_value(req, "HTTP_ACCEPT_ENCODING=")) == NULL ||
+        !accepts_gzip(accept))
+        return 0;
+
+    /* look the header over, and see what it will take */
+    need = req->buffer_end + sizeof (ADDED_HEADERS) - 1 + 2;
+    for (line = start; line < end; line = eol + 1) {
+        eol = memchr(line, '\n', end - line);
+        if (eol == NULL)
+            eol = end - 1;
+        len = eol + 1 - line;
+        if (!strncasecmp(line, "Content-Encoding:", 17))
+            return 0;
+        if (!strncasecmp(line, "Content-Type:", 13)) {
+            char *v = line + 13;
+
+            while (*v == ' ' || *v == '\t')
+                ++v;
+            type = gzip_type(v, eol - v);
+        }
+        if (strncasecmp(line, "Content-Length:", 15))
+            need += len;
+    }
+    body = end + (*end == '\r' ? 2 : 1);
+    /* the header is rebuilt in front of the body, which stays put */
+    if (!type || req->buffer + need > body)
+        return 0;
+
+    g = malloc(sizeof (struct cgi_gzip));
+    if (g == NULL)
+        return 0;
+    memset(&g->z, 0, sizeof (g->z));
+    /* 16 + windowBits: a gzip header and trailer, not zlib's */
+    if (deflateInit2(&g->z, cgi_gzip_level, Z_DEFLATED, 15 + 16, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+        log_error_doc(req);
+        fputs("deflateInit2 failed\n", stderr);
+        free(g);
+        return 0;
+    }
+    g->eof = g->held = g->flush = g->done = 0;
+    g->out_start = g->out_end = 0;
+    req->cgi_gzip = g;
+
+    dest = req->buffer + req->buffer_end;
+    for (line = start; line < end; line = eol + 1) {
+        eol = memchr(line, '\n', end - line);
+        if (eol == NULL)
+            eol = end - 1;
+        len = eol + 1 - line;
+        if (strncasecmp(line, "Content-Length:", 15)) {
+            memmove(dest, line, len);
+            dest += len;
+        }
+    }
+    memcpy(dest, ADDED_HEADERS CRLF, sizeof (ADDED_HEADERS CRLF) - 1);
+    dest += sizeof (ADDED_HEADERS CRLF) - 1;
+    req->buffer_end = dest - req->buffer;
+
+    req->header_line = body;
+    return 1;
+}
+
+/*
+ * Name: cgi_gzip_finish
+ * Description: Called by read_from_pipe at the end of the CGI's
+ * output.
+ */
+
+void cgi_gzip_finish(request * req)
+{
+    req->cgi_gzip->eof = 1;
+}
+
+/*
+ * Name: cgi_gzip_flush
+ * Description: Called by read_from_pipe when the CGI has no more
+ * output for now.
+ *
+ * Return values: 1 if zlib is holding some of what it has had, which
+ * is now to be flushed out; else 0
+ */
+
+int cgi_gzip_flush(request * req)
+{
+    struct cgi_gzip *g = req->cgi_gzip;
+
+    if (!g->held)
+        return 0;
+    g->flush = 1;
+    return 1;
+}
+
+/*
+ * Name: cgi_gzip_write
+ * Description: write_from_pipe, for compressed output: compresses
+ * what has been read, and sends it.
+ *
+ * Return values:
+ *  -1: request blocked, move to blocked queue
+ *   0: EOF or error, close it down
+ *   1: successful write, recycle in ready queue
+ */
+
+int cgi_gzip_write(request * req)
+{
+    struct cgi_gzip *g = req->cgi_gzip;
+    int bytes_written;
+
+    /* our header first */
+    if (req->buffer_end) {
+        bytes_written = req_flush(req);
+        if (bytes_written == -2) {
+            req->status = DEAD;
+            return 0;
+        } else if (bytes_written != 0)
+            return (bytes_written == -1 ? -1 : 1);
+    }
+
+    if (g->out_start == g->out_end) {
+        int flush = (g->eof ? Z_FINISH : g->flush ? Z_SYNC_FLUSH :
+                     Z_NO_FLUSH);
+        int ret;
+
+        if (g->done)
+            return 0;           /* all sent */
+        if (req->header_line == req->header_end && flush == Z_NO_FLUSH) {
+            /* everything read has been compressed: read some more */
+            req->status = PIPE_READ;
+            req->header_line = req->header_end =
+                req->buffer + req->buffer_end;
+            return 1;
+        }
+
+        g->z.next_in = (Bytef *) req->header_line;
+        g->z.avail_in = req->header_end - req->header_line;
+        g->z.next_out = (Bytef *) g->out;
+        g->z.avail_out = sizeof (g->out);
+        ret = deflate(&g->z, flush);
+        if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+            log_error_doc(req);
+            fprintf(stderr, "deflate returned %d\n", ret);
+            req->status = DEAD;
+            return 0;
+        }
+        req->header_line = (char *) g->z.next_in;
+        g->out_start = 0;
+        g->out_end = sizeof (g->out) - g->z.avail_out;
+        if (ret == Z_STREAM_END)
+            g->done = 1;
+        if (flush == Z_NO_FLUSH)
+            g->held = 1;
+        else if (g->z.avail_out != 0) {
+            /* deflate had room for all of it */
+            g->flush = g->held = 0;
+        }
+        if (g->out_start == g->out_end)
+            return 1;
+    }
+
+    bytes_written = write(req->fd, g->out + g->out_start,
+                          g->out_end - g->out_start);
+    if (bytes_written == -1) {
+        if (errno == EWOULDBLOCK || errno == EAGAIN) {
+            req->status = PIPE_WRITE;       /* as in write_from_pipe */
+            return -1;
+        }
+        else if (errno == EINTR)
+            return 1;
+        else {
+            req->status = DEAD;
+            log_error_doc(req);
+            perror("pipe write");
+            return 0;
+        }
+    }
+
+    g->out_start += bytes_written;
+    req->bytes_written += bytes_written;
+    if (!cgi_output_ok(req)) {
+        req->status = DEAD;
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * Name: cgi_gzip_free
+ * Description: Called by free_request.
+ */
+
+void cgi_gzip_free(request * req)
+{
+    deflateEnd(&req->cgi_gzip->z);
+    free(req->cgi_gzip);
+    req->cgi_gzip = NULL;
+}
+
+#else
+
+int cgi_gzip_start(request * req, char *start, char *end)
+{
+    return 0;
+}
+
+void cgi_gzip_finish(request * req)
+{
+}
+
+int cgi_gzip_flush(request * req)
+{
+    return 0;
+}
+
+int cgi_gzip_write(request * req)
+{
+    return 0;
+}
+
+void cgi_gzip_free(request * req)
+{
+}
+
+#endif
@@ -72,6 +72,14 @@ int process_cgi_header(request * req)
             return 0;
         }
     }
+    if (req->cgi_cache) {
+        /* the header, and what has come of the body */
+        char *body = c + (*(c + 1) == '\r' ? 3 : 2);
+
+        cgi_cache_header(req, buf, c + 1);
+        if (req->cgi_cache)
+            cgi_cache_body(req, body, req->header_end - body);
+    }
     if (req->http_version == HTTP09) {
         if (*(c + 1) == '\r')
             req->header_line = c + 2;
@@ -137,6 +145,12 @@ int process_cgi_header(request * req)
         char *dest;
         unsigned int howmuch;
         send_r_request_ok(req); /* does not terminate */
+        if (cgi_gzip_start(req, req->header_line, c + 1)) {
+            /* the header is out of the way; the body which came
+             * with it is the first to compress */
+            req->status = PIPE_WRITE;
+            return 1;
+        }
         /* got to do special things because
            a) we have a single buffer divided into 2 pieces
            b) we need to merge those pieces
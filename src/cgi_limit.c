@@ -0,0 +1,382 @@
+/*
+ *  Boa, an http server
+ *  Copyright (C) 1999-2005 Larry Doolittle <ldoolitt@boa.org>
+ *  Copyright (C) 2000-2005 Jon Nelson <jnelson@boa.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 1, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/* $Id$*/
+
+/*
+ * Limits on CGI children (CGIMaxChildren, CGILimit, CGIQueue,
+ * CGITimeout, CGIMaxOutput).
+ *
+ * Every child init_cgi starts is kept here by pid until sigchld_run
+ * reaps it.  When there are CGIMaxChildren of them, or the CGILimit
+ * for the request's path is reached, the request waits in the CGI_WAIT
+ * state, parked on the blocked list with no file descriptor, much as
+ * FILE_WAIT does for io threads.  A child exiting readies the waiters
+ * which now fit.  Past CGIQueue waiters, or after REQUEST_TIMEOUT
+ * seconds of waiting, the answer is 503.
+ *
+ * Children run in their own process group, so that a CGI which has
+ * run CGITimeout seconds, or written more than CGIMaxOutput bytes, is
+ * killed along with whatever it started.
+ */
+
+#include "boa.h"
+#include <signal.h>
+
+struct cgi_limit {
+    char *prefix;               /* of the URL */
+    unsigned int prefix_len;
+    unsigned int max;
+    unsigned int running, waiting;
+    struct cgi_limit *next;
+};
+
+struct cgi_child {
+    pid_t pid;
+    time_t started;
+    int killed;
+    struct cgi_limit *limit;
+    request *req;               /* NULL once the request is gone */
+    struct cgi_child *next;
+};
+
+static struct cgi_limit *cgi_limits = NULL;
+static struct cgi_child *cgi_children = NULL;
+static unsigned int cgi_running = 0;
+
+/* FIFO of requests in CGI_WAIT, through req->cgi_wait_next */
+static request *cgi_waiting_head = NULL, *cgi_waiting_tail = NULL;
+static unsigned int cgi_waiting = 0;
+
+/*
+ * Name: cgi_limit_add
+ * Description: For a CGILimit line.  Reading the config again (on a
+ * SIGHUP) changes the limit of a path already given, since children
+ * still running are counted against it.
+ */
+
+void cgi_limit_add(const char *prefix, const char *max)
+{
+    struct cgi_limit *l;
+    char *end;
+    long n;
+
+    n = (max ? strtol(max, &end, 10) : -1);
+    if (n < 1 || *end != '\0') {
+        log_error_time();
+        fprintf(stderr, "CGILimit %s: want a number of children\n",
+                prefix);
+        exit(EXIT_FAILURE);
+    }
+
+    for (l = cgi_limits; l; l = l->next) {
+        if (!strcmp(l->prefix, prefix)) {
+            l->max = n;
+            return;
+        }
+    }
+    l = calloc(1, sizeof (struct cgi_limit));
+    if (l == NULL || (l->prefix = strdup(prefix)) == NULL)
+        DIE("out of memory adding CGILimit");
+    l->prefix_len = strlen(prefix);
+    l->max = n;
+    l->next = cgi_limits;
+    cgi_limits = l;
+}
+
+static struct cgi_limit *cgi_limit_find(request * req)
+{
+    struct cgi_limit *l;
+
+    for (l = cgi_limits; l; l = l->next) {
+        if (!strncmp(req->request_uri, l->prefix, l->prefix_len))
+            return l;
+    }
+    return NULL;
+}
+
+static int cgi_room(struct cgi_limit *l)
+{
+    return ((cgi_max_children == 0 || cgi_running < cgi_max_children) &&
+            (l == NULL || l->running < l->max));
+}
+
+static void cgi_dequeue(request * req, struct cgi_limit *l)
+{
+    request **p;
+
+    for (p = &cgi_waiting_head; *p; p = &(*p)->cgi_wait_next) {
+        if (*p == req) {
+            *p = req->cgi_wait_next;
+            break;
+        }
+    }
+    if (cgi_waiting_tail == req) {
+        request *r;
+
+        cgi_waiting_tail = NULL;
+        for (r = cgi_waiting_head; r; r = r->cgi_wait_next)
+            cgi_waiting_tail = r;
+    }
+    req->cgi_wait_next = NULL;
+    req->cgi_queued = 0;
+    cgi_waiting--;
+    if (l)
+        l->waiting--;
+}
+
+/*
+ * Name: cgi_admit
+ * Description: Called by init_cgi before starting a child, and again
+ * for a request in CGI_WAIT each time it is readied.  A new request
+ * doesn't go ahead of others waiting on the same CGILimit.
+ *
+ * Return values:
+ *  -1: wait (the request is in CGI_WAIT, to be blocked)
+ *   0: refused with a 503
+ *   1: go ahead
+ */
+
+int cgi_admit(request * req)
+{
+    struct cgi_limit *l = cgi_limit_find(req);
+
+    if (req->status == CGI_WAIT) {
+        req->cgi_woken = 0;
+        if (cgi_room(l)) {
+            cgi_dequeue(req, l);
+            req->status = WRITE;        /* as when init_cgi was called */
+            return 1;
+        }
+        if (current_time - req->time_last > REQUEST_TIMEOUT) {
+            cgi_dequeue(req, l);
+            req->status = WRITE;
+            log_error_doc(req);
+            fputs("waited too long to start CGI\n", stderr);
+            send_r_service_unavailable(req);
+            return 0;
+        }
+        return -1;
+    }
+
+    if (cgi_room(l) && (l == NULL || l->waiting == 0))
+        return 1;
+
+    if (cgi_waiting >= cgi_queue) {
+        log_error_doc(req);
+        fputs("too many CGIs waiting to start\n", stderr);
+        send_r_service_unavailable(req);
+        return 0;
+    }
+    req->status = CGI_WAIT;
+    req->cgi_queued = 1;
+    if (cgi_waiting_tail)
+        cgi_waiting_tail->cgi_wait_next = req;
+    else
+        cgi_waiting_head = req;
+    cgi_waiting_tail = req;
+    cgi_waiting++;
+    if (l)
+        l->waiting++;
+    return -1;
+}
+
+/*
+ * Name: cgi_wake
+ * Description: Readies the waiting requests which would now fit, or
+ * (with expired set) have waited too long; cgi_admit sorts them out.
+ */
+
+static void cgi_wake(int expired)
+{
+    request *req;
+
+    for (req = cgi_waiting_head; req; req = req->cgi_wait_next) {
+        if (req->cgi_woken)
+            continue;
+        if (cgi_room(cgi_limit_find(req)) ||
+            (expired && current_time - req->time_last > REQUEST_TIMEOUT)) {
+            req->cgi_woken = 1;
+            ready_request(req);
+        }
+    }
+}
+
+/*
+ * Name: cgi_started
+ * Description: Called by init_cgi with the pid of a new child.  If it
+ * writes to a pipe req reads from, req is remembered with it for
+ * CGIMaxOutput.
+ */
+
+void cgi_started(request * req, pid_t pid, int piped)
+{
+    struct cgi_child *c = malloc(sizeof (struct cgi_child));
+
+    if (c == NULL) {
+        /* it runs unwatched and uncounted, but it runs */
+        log_error_doc(req);
+        perror("malloc for cgi_child");
+        return;
+    }
+    cgi_running++;
+    c->pid = pid;
+    c->started = current_time;
+    c->killed = 0;
+    c->limit = cgi_limit_find(req);
+    if (c->limit)
+        c->limit->running++;
+    c->req = (piped ? req : NULL);
+    if (piped)
+        req->cgi_child = c;
+    c->next = cgi_children;
+    cgi_children = c;
+}
+
+/*
+ * Name: cgi_reaped
+ * Description: Called by sigchld_run for each child reaped.
+ */
+
+void cgi_reaped(pid_t pid, int status)
+{
+    struct cgi_child **p, *c;
+
+    for (p = &cgi_children; *p; p = &(*p)->next) {
+        if ((*p)->pid == pid)
+            break;
+    }
+    c = *p;
+    if (c == NULL) {
+        /* untracked (out of memory in cgi_started), or not a CGI */
+        return;
+    }
+    *p = c->next;
+    if (c->req) {
+        /* output from a CGI that failed isn't kept */
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            cgi_cache_failed(c->req);
+        c->req->cgi_child = NULL;
+    }
+    if (c->limit)
+        c->limit->running--;
+    if (WIFSIGNALED(status) && !c->killed) {
+        log_error_time();
+        fprintf(stderr, "CGI pid %d killed by signal %d\n",
+                (int) pid, WTERMSIG(status));
+    }
+    free(c);
+    cgi_running--;
+
+    if (cgi_waiting_head)
+        cgi_wake(0);
+}
+
+/*
+ * Name: cgi_kill
+ * Description: Kills a child, and any processes it started.
+ */
+
+static void cgi_kill(struct cgi_child *c, const char *why)
+{
+    if (c->killed)
+        return;
+    c->killed = 1;
+    log_error_time();
+    fprintf(stderr, "killing CGI pid %d: %s\n", (int) c->pid, why);
+    if (c->req)
+        cgi_cache_failed(c->req);   /* its output is cut short */
+    if (kill(-c->pid, SIGKILL) == -1)
+        kill(c->pid, SIGKILL);
+}
+
+/*
+ * Name: cgi_output_ok
+ * Description: Called by write_from_pipe as CGI output goes out.
+ *
+ * Return values: 0 if the CGI has sent more than CGIMaxOutput bytes,
+ * and has been killed; else 1
+ */
+
+int cgi_output_ok(request * req)
+{
+    if (cgi_max_output && req->cgi_child &&
+        req->bytes_written > (off_t) cgi_max_output) {
+        cgi_kill(req->cgi_child, "too much output");
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * Name: cgi_forget
+ * Description: Called by free_request: the request is no longer
+ * waiting, nor reading from a child.  It may still be queued with
+ * another status (a failed flush of buffered headers makes it DEAD).
+ */
+
+void cgi_forget(request * req)
+{
+    if (req->cgi_queued)
+        cgi_dequeue(req, cgi_limit_find(req));
+    if (req->cgi_child) {
+        req->cgi_child->req = NULL;
+        req->cgi_child = NULL;
+    }
+}
+
+/*
+ * Whether cgi_watchdog has anything to look out for, so the main loop
+ * must wake up for it.
+ */
+
+int cgi_watching(void)
+{
+    return ((cgi_timeout && cgi_children) || cgi_waiting_head ||
+            fcgi_watching());
+}
+
+/*
+ * Name: cgi_watchdog
+ * Description: Called from the main loop.  Once a second at most, it
+ * kills children past CGITimeout, and readies waiting requests which
+ * have waited too long, and those waiting for a FastCGI server.
+ */
+
+void cgi_watchdog(void)
+{
+    static time_t last = 0;
+    struct cgi_child *c;
+
+    if (last == current_time)
+        return;
+    last = current_time;
+
+    if (cgi_timeout) {
+        for (c = cgi_children; c; c = c->next) {
+            if (current_time - c->started > (time_t) cgi_timeout)
+                cgi_kill(c, "CGITimeout");
+        }
+    }
+    if (cgi_waiting_head)
+        cgi_wake(1);
+    fcgi_watchdog();
+}
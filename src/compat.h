@@ -91,7 +91,7 @@
 #define SOCKADDR sockaddr_in
 #define SERVER_PF PF_INET
 #define S_FAMILY sin_family
-#define BOA_NI_MAXHOST 20
+#define BOA_NI_MAXHOST 46       /* an IPv6 address from a PROXY line */
 #endif /* ifdef INET6 */
 
 #if HAVE_DIRENT_H
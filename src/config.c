@@ -33,23 +33,52 @@ gid_t server_gid;
 char *server_root;
 char *server_name;
 char *server_admin;
-char *server_ip;
 int virtualhost;
 char *vhost_root;
 const char *default_vhost;
 unsigned max_connections;
 
 char *document_root;
+char *document_pack;
+char *warmup_manifest;
+char *warmup_log;
+unsigned int warmup_count = WARMUP_COUNT;
 char *user_dir;
 char *directory_index;
 char *default_type;
 char *default_charset;
 char *dirmaker;
+int internal_dirmaker;
 char *cachedir;
 
 const char *tempdir;
 
 unsigned int cgi_umask = 027;
+unsigned int cgi_pipe_size = 0;
+unsigned int fcgi_processes = FCGI_PROCESSES;
+unsigned int cgi_max_children = 0;
+unsigned int cgi_queue = CGI_QUEUE;
+unsigned int cgi_timeout = 0;
+unsigned int cgi_max_output = 0;
+unsigned int cgi_cache_size = CGI_CACHE_SIZE;
+char *cgi_cache_spool_dir = NULL;
+unsigned int cgi_gzip_level = CGI_GZIP_LEVEL;
+unsigned int tcl_max_commands = TCL_MAX_COMMANDS;
+unsigned int tcl_max_time = TCL_MAX_TIME;
+unsigned int proxy_down_time = PROXY_DOWN_TIME;
+unsigned int io_threads = 0;
+unsigned int stream_threshold = 0;
+unsigned int stream_window = STREAM_WINDOW;
+unsigned int direct_io_threshold = 0;
+int mmap_populate = 0;
+int mmap_hugepages = 0;
+unsigned int mmap_lock_size = 0;
+#ifdef MAX_FILE_MMAP
+unsigned int max_file_mmap = MAX_FILE_MMAP;
+#endif
+unsigned int max_ranges = MAX_RANGES;
+int negative_cache = 0;
+int resolve_beneath = 0;
 
 char *pid_file;
 char *cgi_path;
@@ -84,6 +113,16 @@ static void c_add_mime_types_file(char *v1, char *v2, void *t);
 static void c_add_mime_type(char *v1, char *v2, void *t);
 static void c_add_alias(char *v1, char *v2, void *t);
 static void c_add_access(char *v1, char *v2, void *t);
+static void c_add_cache_policy(char *v1, char *v2, void *t);
+static void c_add_fastcgi(char *v1, char *v2, void *t);
+static void c_add_cgi_limit(char *v1, char *v2, void *t);
+static void c_add_cgi_cache(char *v1, char *v2, void *t);
+static void c_add_cgi_cache_key(char *v1, char *v2, void *t);
+static void c_add_cgi_gzip(char *v1, char *v2, void *t);
+static void c_add_tcl_alias(char *v1, char *v2, void *t);
+static void c_add_proxy(char *v1, char *v2, void *t);
+static void c_add_listen(char *v1, char *v2, void *t);
+static void c_add_fastcgi_spawn(char *v1, char *v2, void *t);
 
 struct ccommand {
     const char *name;
@@ -105,6 +144,9 @@ static enum ALIAS redirect_number = REDIRECT;
 static enum ALIAS alias_number = ALIAS;
 static int access_allow_number = ACCESS_ALLOW;
 static int access_deny_number = ACCESS_DENY;
+static enum CACHE_POLICY cache_path_number = CACHE_PATH;
+static enum CACHE_POLICY cache_type_number = CACHE_TYPE;
+static enum CACHE_POLICY cache_fingerprint_number = CACHE_FINGERPRINT;
 static uid_t current_uid = 0;
 
 /* Help keep the table below compact */
@@ -121,7 +163,7 @@ Command *lookup_keyword(char *c);
 
 struct ccommand clist[] = {
     {"Port", S1A, c_set_int, &server_port},
-    {"Listen", S1A, c_set_string, &server_ip},
+    {"Listen", S2A, c_add_listen, NULL},
     {"BackLog", S1A, c_set_int, &backlog},
     {"User", S1A, c_set_user, NULL},
     {"Group", S1A, c_set_group, NULL},
@@ -138,6 +180,10 @@ struct ccommand clist[] = {
     {"VHostRoot", S1A, c_set_string, &vhost_root},
     {"DefaultVHost", S1A, c_set_string, &default_vhost},
     {"DocumentRoot", S1A, c_set_string, &document_root},
+    {"DocumentPack", S1A, c_set_string, &document_pack},
+    {"WarmupManifest", S1A, c_set_string, &warmup_manifest},
+    {"WarmupLog", S1A, c_set_string, &warmup_log},
+    {"WarmupCount", S1A, c_set_int, &warmup_count},
     {"UserDir", S1A, c_set_string, &user_dir},
     {"DirectoryIndex", S1A, c_set_string, &directory_index},
     {"DirectoryMaker", S1A, c_set_string, &dirmaker},
@@ -152,9 +198,47 @@ struct ccommand clist[] = {
     {"ScriptAlias", S2A, c_add_alias, &script_number},
     {"Redirect", S2A, c_add_alias, &redirect_number},
     {"Alias", S2A, c_add_alias, &alias_number},
+    {"CachePath", S2A, c_add_cache_policy, &cache_path_number},
+    {"CacheType", S2A, c_add_cache_policy, &cache_type_number},
+    {"CacheFingerprint", S1A, c_add_cache_policy, &cache_fingerprint_number},
     {"SinglePostLimit", S1A, c_set_int, &single_post_limit},
     {"CGIPath", S1A, c_set_string, &cgi_path},
     {"CGIumask", S1A, c_set_int, &cgi_umask},
+    {"CGIPipeSize", S1A, c_set_int, &cgi_pipe_size},
+    {"CGIMaxChildren", S1A, c_set_int, &cgi_max_children},
+    {"CGILimit", S2A, c_add_cgi_limit, NULL},
+    {"CGIQueue", S1A, c_set_int, &cgi_queue},
+    {"CGITimeout", S1A, c_set_int, &cgi_timeout},
+    {"CGIMaxOutput", S1A, c_set_int, &cgi_max_output},
+    {"CGICache", S2A, c_add_cgi_cache, NULL},
+    {"CGICacheKey", S1A, c_add_cgi_cache_key, NULL},
+    {"CGICacheSize", S1A, c_set_int, &cgi_cache_size},
+    {"CGICacheSpool", S1A, c_set_string, &cgi_cache_spool_dir},
+    {"CGIGzip", S1A, c_add_cgi_gzip, NULL},
+    {"CGIGzipLevel", S1A, c_set_int, &cgi_gzip_level},
+    {"TclAlias", S2A, c_add_tcl_alias, NULL},
+    {"TclMaxCommands", S1A, c_set_int, &tcl_max_commands},
+    {"TclMaxTime", S1A, c_set_int, &tcl_max_time},
+    {"ProxyPass", S2A, c_add_proxy, NULL},
+    {"ProxyDownTime", S1A, c_set_int, &proxy_down_time},
+    {"FastCGI", S2A, c_add_fastcgi, NULL},
+    {"FastCGISpawn", S2A, c_add_fastcgi_spawn, NULL},
+    {"FastCGIProcesses", S1A, c_set_int, &fcgi_processes},
+#ifdef USE_IO_THREADS
+    {"IOThreads", S1A, c_set_int, &io_threads},
+#endif
+    {"StreamingThreshold", S1A, c_set_int, &stream_threshold},
+    {"StreamingWindow", S1A, c_set_int, &stream_window},
+    {"DirectIOThreshold", S1A, c_set_int, &direct_io_threshold},
+    {"MmapPopulate", S0A, c_set_unity, &mmap_populate},
+    {"MmapHugePages", S0A, c_set_unity, &mmap_hugepages},
+    {"MmapLockSize", S1A, c_set_int, &mmap_lock_size},
+#ifdef MAX_FILE_MMAP
+    {"MmapMaxFileSize", S1A, c_set_int, &max_file_mmap},
+#endif
+    {"MaxRanges", S1A, c_set_int, &max_ranges},
+    {"NegativeCache", S0A, c_set_unity, &negative_cache},
+    {"ResolveBeneath", S0A, c_set_unity, &resolve_beneath},
     {"MaxConnections", S1A, c_set_int, &max_connections},
     {"ConcealServerIdentity", S0A, c_set_unity, &conceal_server_identity},
     {"Allow", S1A, c_add_access, &access_allow_number},
@@ -368,6 +452,56 @@ static void c_add_access(char *v1, char *v2, void *t)
 #endif                          /* ACCESS_CONTROL */
 }
 
+static void c_add_cache_policy(char *v1, char *v2, void *t)
+{
+    cache_policy_add(*(enum CACHE_POLICY *) t, v1, v2);
+}
+
+static void c_add_cgi_limit(char *v1, char *v2, void *t)
+{
+    cgi_limit_add(v1, v2);
+}
+
+static void c_add_cgi_cache(char *v1, char *v2, void *t)
+{
+    cgi_cache_add(v1, v2);
+}
+
+static void c_add_cgi_cache_key(char *v1, char *v2, void *t)
+{
+    cgi_cache_key_add(v1);
+}
+
+static void c_add_cgi_gzip(char *v1, char *v2, void *t)
+{
+    cgi_gzip_type_add(v1);
+}
+
+static void c_add_tcl_alias(char *v1, char *v2, void *t)
+{
+    tcl_alias_add(v1, v2);
+}
+
+static void c_add_proxy(char *v1, char *v2, void *t)
+{
+    proxy_add(v1, v2);
+}
+
+static void c_add_listen(char *v1, char *v2, void *t)
+{
+    listen_add(v1, v2);
+}
+
+static void c_add_fastcgi(char *v1, char *v2, void *t)
+{
+    fcgi_add_server(v1, v2);
+}
+
+static void c_add_fastcgi_spawn(char *v1, char *v2, void *t)
+{
+    fcgi_add_spawn(v1, v2);
+}
+
 struct ccommand *lookup_keyword(char *c)
 {
     struct ccommand *p;
@@ -405,7 +539,7 @@ static void apply_command(Command * p, char *args)
         }
 
         second = args;
-        while (!isspace(*second))
+        while (*second && !isspace(*second))
             ++second;
         if (*second == '\0') {
             /* nuthin but spaces */
@@ -456,7 +590,7 @@ static void parse(FILE * f)
 
         /* look for multiple arguments */
         c = buf;
-        while (!isspace(*c))
+        while (*c && !isspace(*c))
             ++c;
 
         if (*c == '\0') {
@@ -545,6 +679,9 @@ void read_config_files(void)
         exit(EXIT_FAILURE);
     }
 
+    /* "DirectoryMaker internal" renders listings in-process */
+    internal_dirmaker = (dirmaker && !strcmp(dirmaker, "internal"));
+
     if (vhost_root && virtualhost) {
         fprintf(stderr, "Both VHostRoot and VirtualHost were enabled, and "
                 "they are mutually exclusive.\n");
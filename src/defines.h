@@ -53,6 +53,8 @@
 #define CLIENT_STREAM_SIZE                      8192
 #define BUFFER_SIZE                             4096
 #define MAX_HEADER_LENGTH			1024
+#define MAX_ETAG_LENGTH                         72 /* "dev-ino-size-mtime" */
+#define CGI_SPLICE_SIZE                         65536 /* default pipe size */
 
 #define MIME_HASHTABLE_SIZE			47
 #define ALIAS_HASHTABLE_SIZE                    17
@@ -90,6 +92,9 @@
 
 #define CGI_ENV_MAX     100
 #define CGI_ARGC_MAX 128
+/* first size of the per-request space the CGI variables are built in;
+ * it grows as needed and is kept with the request struct */
+#define CGI_ENV_ARENA 4096
 
 #define SERVER_METHOD "http"
 
@@ -98,7 +103,108 @@
 #define MMAP_LIST_MASK 255
 #define MMAP_LIST_USE_MAX 128
 
-#define MAX_FILE_MMAP 100 * 1024 /* 100K */
+#define MAX_FILE_MMAP 100 * 1024 /* 100K, default for MmapMaxFileSize */
+#define HUGEPAGE_SIZE (2 * 1024 * 1024) /* MmapHugePages from this size */
+
+/*********** WARMUP ************************************/
+/* WarmupCount default; how much of a WarmupLog is read; and the
+ * size of the table the URLs in it are counted in (a power of 2) */
+#define WARMUP_COUNT 1000
+#define WARMUP_LOG_TAIL (8 * 1024 * 1024)
+#define WARMUP_HASH_SIZE 4096
+
+/*********** ROOT DIRECTORIES **************************/
+/* directory fds kept open for document opens, see resolve.c */
+#define ROOT_CACHE_SIZE 64
+#define ROOT_CACHE_MASK 63
+/* doc_root_fd: under a root that could not be opened, with ResolveBeneath */
+#define ROOT_FD_NONE (-2)
+
+/*********** NEGATIVE CACHE ****************************/
+/* pathnames known not to exist, for NegativeCache */
+#define NEGATIVE_CACHE_SIZE 256
+#define NEGATIVE_CACHE_MASK 255
+
+/*********** CACHE CONTROL *****************************/
+/* the fewest hex digits that make a CacheFingerprint name, and how far
+ * ahead an Expires date may be (a year, RFC 2616 14.21) */
+#define CACHE_FINGERPRINT_MIN 8
+#define CACHE_EXPIRES_MAX (365 * 24 * 60 * 60)
+
+/*********** CGI LIMITS ******************************/
+/* how many requests may wait for a CGI child, by default */
+#define CGI_QUEUE 64
+
+/*********** CGI CACHE *******************************/
+/* buckets in the CGICache table; the CGICacheSize default, of which
+ * one response may take 1/CGI_CACHE_ENTRY_PART at most; and how long
+ * a response which can't be stored keeps others from waiting for it */
+#define CGI_CACHE_HASH_SIZE 256
+#define CGI_CACHE_HASH_MASK 255
+#define CGI_CACHE_SIZE (16 * 1024 * 1024)
+#define CGI_CACHE_ENTRY_PART 8
+#define CGI_CACHE_PASS_TIME 10
+
+/*********** CGI GZIP ********************************/
+/* the CGIGzipLevel default, zlib's own */
+#define CGI_GZIP_LEVEL 6
+
+/*********** TCL *************************************/
+/* the TclMaxCommands default: how many Tcl commands one script may run */
+#define TCL_MAX_COMMANDS 100000
+/* the TclMaxTime default: how many milliseconds one script may run */
+#define TCL_MAX_TIME 1000
+
+/*********** PROXY ***********************************/
+/* the ProxyDownTime default, and idle connections kept per upstream */
+#define PROXY_DOWN_TIME 10
+#define PROXY_IDLE_MAX 16
+
+/*********** FASTCGI *********************************/
+/* processes started for a FastCGISpawn line, idle connections kept
+ * per FastCGI server, and POST data sent per FCGI_STDIN record */
+#define FCGI_PROCESSES 4
+#define FCGI_IDLE_MAX 16
+#define FCGI_STDIN_CHUNK 16384
+
+/*********** SIZES *************************************/
+/* the largest off_t, in which all file sizes and offsets are kept.
+ * The Makefile asks for a 64-bit one on 32-bit machines, too. */
+#define BOA_OFF_MAX ((off_t) (((unsigned long long) 1 << \
+                               (8 * sizeof (off_t) - 1)) - 1))
+
+/*********** RANGES *************************************/
+#define MAX_RANGES 64           /* default for MaxRanges */
+/* parts of a multipart/byteranges response per writev(2), and room
+ * for the boundary and headers of each */
+#define MULTIPART_IOV_PARTS 16
+#define MULTIPART_HEADER_SIZE 512
+
+/*********** STREAMING *********************************/
+/* Files of at least StreamingThreshold bytes get readahead advice
+ * STREAM_WINDOW (StreamingWindow) bytes ahead of the send cursor,
+ * and are dropped from the page cache behind it.
+ * O_DIRECT reads (DirectIOThreshold) go through a bounce buffer of
+ * DIRECT_IO_SIZE bytes, aligned on DIRECT_IO_ALIGN.
+ */
+#define STREAM_WINDOW (1024 * 1024)
+#define DIRECT_IO_SIZE (64 * 1024)
+#define DIRECT_IO_ALIGN 4096
+
+/*********** IO THREADS *********************************/
+/* Blocking open/fstat/read can be handed to a pool of threads
+ * (IOThreads in boa.conf) when POSIX threads are available.
+ * #define NO_IO_THREADS to leave them out altogether.
+ */
+#if defined(_POSIX_THREADS) && !defined(NO_IO_THREADS)
+#define USE_IO_THREADS
+#endif
+#define IO_DEVSTATS_SIZE 16     /* devices tracked for statistics */
+
+/*********** INDEX_LIST CONSTANTS ***********************/
+/* cached listings for DirectoryMaker internal */
+#define INDEX_LIST_SIZE 64
+#define INDEX_LIST_MASK 63
 
 /*************** POLL / SELECT MACROS *******************/
 #ifdef HAVE_POLL
@@ -152,6 +258,7 @@ extern int debug_level;
 #define DEBUG_MMAP_CACHE    (1<<11)
 #define DEBUG_REQUEST       (1<<12)
 #define DEBUG_HASH          (1<<13)
+#define DEBUG_INDEX_CACHE   (1<<14)
 
 /***************** USEFUL MACROS ************************/
 
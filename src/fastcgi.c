@@ -0,0 +1,908 @@
+/*
+ *  Boa, an http server
+ *  Copyright (C) 1999-2005 Larry Doolittle <ldoolitt@boa.org>
+ *  Copyright (C) 2000-2005 Jon Nelson <jnelson@boa.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 1, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/* $Id$*/
+
+/*
+ * FastCGI responder client (FastCGI, FastCGISpawn).
+ *
+ * A CGI request under a ScriptAlias path given to FastCGI is not
+ * forked: it is sent, environment as FCGI_PARAMS and POST data as
+ * FCGI_STDIN, over a Unix socket to a FastCGI server which stays up.
+ * The request waits in FCGI_WRITE while that goes out, then in
+ * PIPE_READ/PIPE_WRITE just as for a CGI pipe; fcgi_read takes the
+ * FCGI_STDOUT data out of the records, so the CGI header parsing and
+ * the rest are shared.
+ *
+ * Connections are opened with FCGI_KEEP_CONN, and go back to a pool
+ * for the server at FCGI_END_REQUEST.  Each carries one request at a
+ * time; many requests to one server use many connections.
+ *
+ * While the server's listen backlog is full, a new connection can't
+ * be made (EAGAIN) and the request waits in FCGI_WAIT, parked with no
+ * fd like CGI_WAIT.  The connect is tried again when a connection to
+ * that server is done with, and once a second from cgi_watchdog;
+ * after REQUEST_TIMEOUT seconds the answer is 503.
+ *
+ * With FastCGISpawn, Boa starts the server itself: FastCGIProcesses
+ * copies of a program, with the listening socket on their stdin as
+ * the FastCGI spec has it, started again when one exits.
+ */
+
+#include "boa.h"
+#include <sys/un.h>
+#include <signal.h>
+
+/* from the FastCGI 1.0 specification */
+#define FCGI_VERSION_1          1
+#define FCGI_HEADER_LEN         8
+#define FCGI_BEGIN_REQUEST      1
+#define FCGI_END_REQUEST        3
+#define FCGI_PARAMS             4
+#define FCGI_STDIN              5
+#define FCGI_STDOUT             6
+#define FCGI_STDERR             7
+#define FCGI_RESPONDER          1
+#define FCGI_KEEP_CONN          1
+#define FCGI_REQUEST_COMPLETE   0
+#define FCGI_MAX_CONTENT        65535
+#define FCGI_REQUEST_ID         1       /* one request per connection */
+
+struct fcgi_conn {
+    int fd;
+    int reused;                 /* has carried a request before */
+    int sent;                   /* some of this request went out */
+    int connecting;             /* the backlog was full: connect again */
+    struct fcgi_server *server;
+
+    /* records to send */
+    unsigned char *out;
+    unsigned int out_size, out_start, out_end;
+    int stdin_done;
+
+    /* the record coming in */
+    unsigned char head[FCGI_HEADER_LEN];
+    unsigned int head_got;
+    unsigned int content_left, padding_left;
+    unsigned char end_body[8];
+    unsigned int end_got;
+
+    struct fcgi_conn *next;
+};
+
+struct fcgi_server {
+    char *prefix;               /* of the URL: a ScriptAlias */
+    unsigned int prefix_len;
+    struct sockaddr_un addr;
+    struct fcgi_conn *idle;
+    unsigned int idle_count;
+    struct fcgi_server *next;
+};
+
+struct fcgi_spawn {
+    char *socket;
+    char *program;
+    int listen_fd;
+    pid_t *pids;
+    time_t *started;
+    struct fcgi_spawn *next;
+};
+
+static struct fcgi_server *fcgi_servers = NULL;
+static struct fcgi_spawn *fcgi_spawns = NULL;
+
+/* requests parked in FCGI_WAIT, through req->fcgi_wait_next */
+static request *fcgi_waiting = NULL;
+
+static int fcgi_socket_name(struct sockaddr_un *addr, const char *path)
+{
+    memset(addr, 0, sizeof (*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof (addr->sun_path)) {
+        log_error_time();
+        fprintf(stderr, "FastCGI socket name too long: %s\n", path);
+        return 0;
+    }
+    strcpy(addr->sun_path, path);
+    return 1;
+}
+
+/*
+ * Name: fcgi_add_server
+ * Description: For a FastCGI line.  A path already given (as when
+ * the config is read again on a SIGHUP) is left as it was.
+ */
+
+void fcgi_add_server(const char *prefix, const char *socket)
+{
+    struct fcgi_server *s;
+
+    if (socket == NULL) {
+        log_error_time();
+        fprintf(stderr, "FastCGI %s: no socket given\n", prefix);
+        exit(EXIT_FAILURE);
+    }
+    for (s = fcgi_servers; s; s = s->next) {
+        if (!strcmp(s->prefix, prefix))
+            return;
+    }
+
+    s = calloc(1, sizeof (struct fcgi_server));
+    if (s == NULL || (s->prefix = strdup(prefix)) == NULL)
+        DIE("out of memory adding FastCGI server");
+    if (!fcgi_socket_name(&s->addr, socket))
+        exit(EXIT_FAILURE);
+    s->prefix_len = strlen(prefix);
+    s->next = fcgi_servers;
+    fcgi_servers = s;
+}
+
+/*
+ * Name: fcgi_add_spawn
+ * Description: For a FastCGISpawn line; as fcgi_add_server, a socket
+ * already given is left alone.
+ */
+
+void fcgi_add_spawn(const char *socket, const char *program)
+{
+    struct fcgi_spawn *sp;
+
+    if (program == NULL) {
+        log_error_time();
+        fprintf(stderr, "FastCGISpawn %s: no program given\n", socket);
+        exit(EXIT_FAILURE);
+    }
+    for (sp = fcgi_spawns; sp; sp = sp->next) {
+        if (!strcmp(sp->socket, socket))
+            return;
+    }
+
+    sp = calloc(1, sizeof (struct fcgi_spawn));
+    if (sp == NULL || (sp->socket = strdup(socket)) == NULL ||
+        (sp->program = strdup(program)) == NULL)
+        DIE("out of memory adding FastCGISpawn");
+    sp->listen_fd = -1;
+    sp->next = fcgi_spawns;
+    fcgi_spawns = sp;
+}
+
+/*
+ * Name: fcgi_start_one
+ * Description: Starts process i of sp.
+ */
+
+static void fcgi_start_one(struct fcgi_spawn *sp, unsigned int i)
+{
+    pid_t pid = fork();
+
+    if (pid == -1) {
+        log_error_time();
+        perror("fork (FastCGISpawn)");
+        sp->pids[i] = 0;
+        return;
+    }
+    if (pid == 0) {
+        char *argv[2];
+        int null_fd;
+
+        reset_signals();
+        /* FCGI_LISTENSOCK_FILENO is 0 */
+        if (dup2(sp->listen_fd, STDIN_FILENO) == -1)
+            _exit(EXIT_FAILURE);
+        null_fd = open("/dev/null", O_WRONLY);
+        if (null_fd != -1)
+            dup2(null_fd, STDOUT_FILENO);
+        if (cgi_log_fd)
+            dup2(cgi_log_fd, STDERR_FILENO);
+        umask(cgi_umask);
+
+        argv[0] = sp->program;
+        argv[1] = NULL;
+        execve(sp->program, argv, common_env());
+        log_error_time();
+        fprintf(stderr, "FastCGISpawn: unable to execve \"%s\": %s\n",
+                sp->program, strerror(errno));
+        _exit(EXIT_FAILURE);
+    }
+    sp->pids[i] = pid;
+    sp->started[i] = current_time;
+    if (verbose_cgi_logs) {
+        log_error_time();
+        fprintf(stderr, "FastCGISpawn: started \"%s\" pid %d\n",
+                sp->program, (int) pid);
+    }
+}
+
+/*
+ * Name: fcgi_init
+ * Description: Makes the listening sockets for FastCGISpawn lines,
+ * and starts the processes on them.  Called once, after privileges
+ * are dropped, so they run as Boa's User.
+ */
+
+void fcgi_init(void)
+{
+    struct fcgi_spawn *sp;
+    struct sockaddr_un addr;
+    unsigned int i;
+
+    if (fcgi_processes < 1)
+        fcgi_processes = 1;
+
+    for (sp = fcgi_spawns; sp; sp = sp->next) {
+        if (!fcgi_socket_name(&addr, sp->socket))
+            exit(EXIT_FAILURE);
+        unlink(sp->socket);     /* left over from the last run */
+        sp->listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (sp->listen_fd == -1 ||
+            bind(sp->listen_fd, (struct sockaddr *) &addr,
+                 sizeof (addr)) == -1 ||
+            listen(sp->listen_fd, backlog) == -1) {
+            log_error_time();
+            fprintf(stderr, "FastCGISpawn %s: %s\n", sp->socket,
+                    strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        /* only the FastCGI processes should have it */
+        fcntl(sp->listen_fd, F_SETFD, FD_CLOEXEC);
+
+        sp->pids = calloc(fcgi_processes, sizeof (pid_t));
+        sp->started = calloc(fcgi_processes, sizeof (time_t));
+        if (sp->pids == NULL || sp->started == NULL)
+            DIE("out of memory starting FastCGI processes");
+        for (i = 0; i < fcgi_processes; ++i)
+            fcgi_start_one(sp, i);
+    }
+}
+
+/*
+ * Name: fcgi_reaped
+ * Description: Called by sigchld_run for each child reaped; starts
+ * another if it was a FastCGI process.  One which died within a
+ * second of starting is not, to keep a broken program from looping.
+ */
+
+void fcgi_reaped(pid_t pid)
+{
+    struct fcgi_spawn *sp;
+    unsigned int i;
+
+    for (sp = fcgi_spawns; sp; sp = sp->next) {
+        for (i = 0; sp->pids && i < fcgi_processes; ++i) {
+            if (sp->pids[i] != pid)
+                continue;
+            sp->pids[i] = 0;
+            if (sigterm_flag)
+                return;
+            time(&current_time);
+            if (current_time - sp->started[i] < 1) {
+                log_error_time();
+                fprintf(stderr, "FastCGISpawn: \"%s\" exited at once; "
+                        "not restarting it\n", sp->program);
+                return;
+            }
+            fcgi_start_one(sp, i);
+            return;
+        }
+    }
+}
+
+/*
+ * Name: fcgi_stop
+ * Description: At exit: stops the FastCGI processes and removes their
+ * sockets.
+ */
+
+void fcgi_stop(void)
+{
+    struct fcgi_spawn *sp;
+    unsigned int i;
+
+    for (sp = fcgi_spawns; sp; sp = sp->next) {
+        for (i = 0; sp->pids && i < fcgi_processes; ++i) {
+            if (sp->pids[i])
+                kill(sp->pids[i], SIGTERM);
+        }
+        if (sp->listen_fd != -1) {
+            close(sp->listen_fd);
+            unlink(sp->socket);
+        }
+    }
+}
+
+/*
+ * Name: fcgi_find_server
+ * Description: The server for a request to a ScriptAlias path, if
+ * there is one.
+ */
+
+static struct fcgi_server *fcgi_find_server(request * req)
+{
+    struct fcgi_server *s;
+
+    for (s = fcgi_servers; s; s = s->next) {
+        if (!strncmp(req->request_uri, s->prefix, s->prefix_len))
+            return s;
+    }
+    return NULL;
+}
+
+static void fcgi_close(struct fcgi_conn *c)
+{
+    close(c->fd);
+    free(c->out);
+    free(c);
+}
+
+/*
+ * Name: fcgi_try_connect
+ * Description: Connects c to its server.  A Unix socket connects at
+ * once, or, when the server's listen backlog is full, fails with
+ * EAGAIN and is left unconnected: nothing completes it, as for TCP's
+ * EINPROGRESS, and it polls as writable all the same, so connect has
+ * to be called again later.
+ *
+ * Return values: -1 on error, 0 if c is still connecting, else 1
+ */
+
+static int fcgi_try_connect(struct fcgi_conn *c)
+{
+    struct fcgi_server *s = c->server;
+
+    if (connect(c->fd, (struct sockaddr *) &s->addr,
+                sizeof (s->addr)) == 0 || errno == EISCONN) {
+        c->connecting = 0;
+        return 1;
+    }
+    if (errno == EAGAIN || errno == EINTR) {
+        c->connecting = 1;
+        return 0;
+    }
+    return -1;
+}
+
+/*
+ * Name: fcgi_connect
+ * Description: An idle connection to s, or a new one, which may still
+ * be connecting.
+ *
+ * Return values: it, or NULL (logged)
+ */
+
+static struct fcgi_conn *fcgi_connect(struct fcgi_server *s, int fresh)
+{
+    struct fcgi_conn *c;
+    char probe;
+
+    while (!fresh && (c = s->idle) != NULL) {
+        s->idle = c->next;
+        s->idle_count--;
+        /* the server may have closed it meanwhile: then it reads as
+         * end of file, and nothing else should be there to read */
+        if (recv(c->fd, &probe, 1, MSG_PEEK | MSG_DONTWAIT) == -1 &&
+            (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            c->next = NULL;
+            c->reused = 1;
+            c->sent = 0;
+            c->head_got = c->end_got = 0;
+            c->content_left = c->padding_left = 0;
+            c->out_start = c->out_end = 0;
+            c->stdin_done = 0;
+            return c;
+        }
+        fcgi_close(c);
+    }
+
+    c = calloc(1, sizeof (struct fcgi_conn));
+    if (c == NULL) {
+        log_error_time();
+        perror("FastCGI connection");
+        return NULL;
+    }
+    c->server = s;
+    c->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (c->fd == -1) {
+        log_error_time();
+        perror("FastCGI socket");
+        free(c);
+        return NULL;
+    }
+    fcntl(c->fd, F_SETFD, FD_CLOEXEC);
+    if (set_nonblock_fd(c->fd) == -1 || fcgi_try_connect(c) == -1) {
+        log_error_time();
+        fprintf(stderr, "FastCGI connect to %s: %s\n", s->addr.sun_path,
+                strerror(errno));
+        close(c->fd);
+        free(c);
+        return NULL;
+    }
+    return c;
+}
+
+/*
+ * Name: fcgi_record
+ * Description: Puts a record of type and len bytes of data at the
+ * end of c->out, padded to a multiple of 8.
+ *
+ * Return values: 0 if out of memory, else 1
+ */
+
+static int fcgi_record(struct fcgi_conn *c, int type,
+                       const void *data, unsigned int len)
+{
+    unsigned int padding = (8 - len % 8) % 8;
+    unsigned int need = c->out_end + FCGI_HEADER_LEN + len + padding;
+    unsigned char *h;
+
+    if (need > c->out_size) {
+        unsigned int size = (c->out_size ? c->out_size : 4096);
+        unsigned char *n;
+
+        while (size < need)
+            size *= 2;
+        n = realloc(c->out, size);
+        if (n == NULL)
+            return 0;
+        c->out = n;
+        c->out_size = size;
+    }
+    h = c->out + c->out_end;
+    h[0] = FCGI_VERSION_1;
+    h[1] = type;
+    h[2] = FCGI_REQUEST_ID >> 8;
+    h[3] = FCGI_REQUEST_ID & 0xff;
+    h[4] = len >> 8;
+    h[5] = len & 0xff;
+    h[6] = padding;
+    h[7] = 0;
+    if (len)
+        memcpy(h + FCGI_HEADER_LEN, data, len);
+    memset(h + FCGI_HEADER_LEN + len, 0, padding);
+    c->out_end = need;
+    return 1;
+}
+
+/* a name or value length, as the spec encodes it */
+static unsigned char *fcgi_length(unsigned char *p, unsigned int len)
+{
+    if (len < 128) {
+        *p++ = len;
+    } else {
+        *p++ = (len >> 24) | 0x80;
+        *p++ = len >> 16;
+        *p++ = len >> 8;
+        *p++ = len;
+    }
+    return p;
+}
+
+/* a name-value pair, encoded at p */
+static unsigned char *fcgi_pair(unsigned char *p, const char *name,
+                                unsigned int name_len, const char *value)
+{
+    unsigned int value_len = strlen(value);
+
+    p = fcgi_length(p, name_len);
+    p = fcgi_length(p, value_len);
+    memcpy(p, name, name_len);
+    memcpy(p + name_len, value, value_len);
+    return p + name_len + value_len;
+}
+
+/*
+ * Name: fcgi_params
+ * Description: Encodes req's CGI environment, and SCRIPT_FILENAME,
+ * as FCGI_PARAMS records.
+ *
+ * Return values: 0 if out of memory, else 1
+ */
+
+static int fcgi_params(request * req, struct fcgi_conn *c)
+{
+    unsigned char *buf, *p;
+    unsigned int size, len, done;
+    int i, ok = 1;
+
+    /* what a FastCGI server needs to find the script */
+    size = strlen(req->pathname) + 32;
+    for (i = 0; i < req->cgi_env_index; ++i)
+        size += strlen(req->cgi_env[i]) + 8;
+
+    buf = malloc(size);
+    if (buf == NULL)
+        return 0;
+    p = fcgi_pair(buf, "SCRIPT_FILENAME", 15, req->pathname);
+    for (i = 0; i < req->cgi_env_index; ++i) {
+        char *eq = strchr(req->cgi_env[i], '=');
+
+        if (eq)
+            p = fcgi_pair(p, req->cgi_env[i], eq - req->cgi_env[i], eq + 1);
+    }
+
+    for (done = 0; ok && done < (unsigned) (p - buf); done += len) {
+        len = p - buf - done;
+        if (len > FCGI_MAX_CONTENT - 7)
+            len = FCGI_MAX_CONTENT - 7;
+        ok = fcgi_record(c, FCGI_PARAMS, buf + done, len);
+    }
+    free(buf);
+    return ok && fcgi_record(c, FCGI_PARAMS, NULL, 0);
+}
+
+/*
+ * Name: fcgi_start
+ * Description: Called by init_cgi for a CGI request which has a
+ * FastCGI server.
+ *
+ * Return values: -1 if there is none (fork it, then), 0 on error
+ * (answered), 1 if the request is on its way
+ */
+
+int fcgi_start(request * req)
+{
+    struct fcgi_server *s = fcgi_find_server(req);
+    struct fcgi_conn *c;
+    unsigned char begin[8];
+
+    if (s == NULL)
+        return -1;
+
+    c = fcgi_connect(s, 0);
+    if (c == NULL) {
+        send_r_service_unavailable(req);
+        return 0;
+    }
+
+    memset(begin, 0, sizeof (begin));
+    begin[1] = FCGI_RESPONDER;
+    begin[2] = FCGI_KEEP_CONN;
+    if (!fcgi_record(c, FCGI_BEGIN_REQUEST, begin, sizeof (begin)) ||
+        !fcgi_params(req, c)) {
+        fcgi_close(c);
+        boa_perror(req, "out of memory for FastCGI request");
+        return 0;
+    }
+    if (req->method == M_POST)
+        lseek(req->post_data_fd, 0, SEEK_SET);
+
+    req->fcgi_conn = c;
+    req->data_fd = c->fd;
+    req->status = (c->connecting ? FCGI_WAIT : FCGI_WRITE);
+    return 1;
+}
+
+/* takes req off the FCGI_WAIT list, if it is there */
+static void fcgi_unpark(request * req)
+{
+    request **r;
+
+    for (r = &fcgi_waiting; *r; r = &(*r)->fcgi_wait_next) {
+        if (*r == req) {
+            *r = req->fcgi_wait_next;
+            req->fcgi_wait_next = NULL;
+            return;
+        }
+    }
+}
+
+/*
+ * Name: fcgi_wake
+ * Description: Readies the requests in FCGI_WAIT for server s, or for
+ * any server if s is NULL, so that fcgi_write tries connecting again.
+ */
+
+static void fcgi_wake(struct fcgi_server *s)
+{
+    request **r = &fcgi_waiting, *req;
+
+    while ((req = *r) != NULL) {
+        if (s == NULL || req->fcgi_conn->server == s) {
+            *r = req->fcgi_wait_next;
+            req->fcgi_wait_next = NULL;
+            ready_request(req);
+        } else
+            r = &req->fcgi_wait_next;
+    }
+}
+
+/*
+ * Name: fcgi_wait
+ * Description: For a request in FCGI_WAIT: connects if the server has
+ * room now, else parks the request until fcgi_wake, or gives up after
+ * REQUEST_TIMEOUT seconds.
+ *
+ * Return values: as for fcgi_write
+ */
+
+static int fcgi_wait(request * req)
+{
+    int err;
+
+    switch (fcgi_try_connect(req->fcgi_conn)) {
+    case 1:
+        req->status = FCGI_WRITE;
+        return 1;
+    case 0:
+        if (current_time - req->time_last <= REQUEST_TIMEOUT) {
+            req->fcgi_wait_next = fcgi_waiting;
+            fcgi_waiting = req;
+            return -1;
+        }
+        err = EAGAIN;
+        break;
+    default:
+        err = errno;
+        break;
+    }
+    req->status = WRITE;
+    log_error_doc(req);
+    fprintf(stderr, "FastCGI connect to %s: %s\n",
+            req->fcgi_conn->server->addr.sun_path, strerror(err));
+    send_r_service_unavailable(req);
+    return 0;
+}
+
+/*
+ * Name: fcgi_watching
+ * Description: Whether fcgi_watchdog has requests to wake, so the
+ * main loop must wake up for it.
+ */
+
+int fcgi_watching(void)
+{
+    return (fcgi_waiting != NULL);
+}
+
+/*
+ * Name: fcgi_watchdog
+ * Description: Called by cgi_watchdog once a second: has the requests
+ * in FCGI_WAIT try connecting again, or time out.
+ */
+
+void fcgi_watchdog(void)
+{
+    fcgi_wake(NULL);
+}
+
+/*
+ * Name: fcgi_write
+ * Description: Sends the request's records, and its POST data in
+ * FCGI_STDIN records as they are read from the temporary file; then
+ * turns to reading the answer.
+ *
+ * Return values:
+ *  -1: request blocked, move to blocked queue
+ *   0: error, close it down
+ *   1: successful write, recycle in ready queue
+ */
+
+int fcgi_write(request * req)
+{
+    struct fcgi_conn *c = req->fcgi_conn;
+    int n;
+
+    if (req->status == FCGI_WAIT)
+        return fcgi_wait(req);
+
+    if (c->out_start == c->out_end) {
+        char buf[FCGI_STDIN_CHUNK];
+
+        if (c->stdin_done) {
+            req->status = PIPE_READ;
+            req->cgi_status = CGI_PARSE;
+            /* as for a CGI pipe: the top half of the buffer */
+            req->header_line = req->header_end =
+                (req->buffer + BUFFER_SIZE / 2);
+            req->filepos = 0;
+            return 1;
+        }
+        c->out_start = c->out_end = 0;
+        n = 0;
+        if (req->method == M_POST) {
+            n = read(req->post_data_fd, buf, sizeof (buf));
+            if (n == -1) {
+                boa_perror(req, "read of POST data for FastCGI");
+                return 0;
+            }
+        }
+        if (!fcgi_record(c, FCGI_STDIN, buf, n)) {
+            boa_perror(req, "out of memory for FastCGI request");
+            return 0;
+        }
+        if (n == 0)
+            c->stdin_done = 1;
+    }
+
+    n = write(c->fd, c->out + c->out_start, c->out_end - c->out_start);
+    if (n == -1) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return -1;
+        if (errno == EINTR)
+            return 1;
+        if (c->reused && !c->sent &&
+            (errno == EPIPE || errno == ECONNRESET)) {
+            /* the server closed an idle connection: start over on
+             * a new one, with the same records */
+            struct fcgi_conn *fresh = fcgi_connect(c->server, 1);
+
+            if (fresh) {
+                fresh->out = c->out;
+                fresh->out_size = c->out_size;
+                fresh->out_start = c->out_start;
+                fresh->out_end = c->out_end;
+                fresh->stdin_done = c->stdin_done;
+                c->out = NULL;
+                fcgi_close(c);
+                req->fcgi_conn = fresh;
+                req->data_fd = fresh->fd;
+                if (fresh->connecting)
+                    req->status = FCGI_WAIT;
+                return 1;
+            }
+        }
+        log_error_doc(req);
+        perror("FastCGI write");
+        send_r_bad_gateway(req);
+        return 0;
+    }
+    c->sent = 1;
+    c->out_start += n;
+    return 1;
+}
+
+/*
+ * Name: fcgi_release
+ * Description: Done with req's connection: back to the pool if the
+ * request ended as it should, else closed.
+ */
+
+static void fcgi_release(request * req, int reusable)
+{
+    struct fcgi_conn *c = req->fcgi_conn;
+    struct fcgi_server *s = c->server;
+    int connected = !c->connecting;
+
+    req->fcgi_conn = NULL;
+    req->data_fd = 0;
+    if (reusable && s->idle_count < FCGI_IDLE_MAX) {
+        c->next = s->idle;
+        s->idle = c;
+        s->idle_count++;
+    } else
+        fcgi_close(c);
+    /* the server has a process free, or a place in its backlog */
+    if (connected)
+        fcgi_wake(s);
+}
+
+/*
+ * Name: fcgi_read
+ * Description: Like read() on a CGI pipe: up to len bytes of the
+ * FastCGI server's FCGI_STDOUT into buf.  FCGI_STDERR goes to the
+ * error log.
+ *
+ * Return values: the number of bytes, 0 at FCGI_END_REQUEST, or -1
+ * with errno set
+ */
+
+int fcgi_read(request * req, char *buf, unsigned int len)
+{
+    struct fcgi_conn *c = req->fcgi_conn;
+    int n = -1;
+
+    if (c == NULL)
+        return 0;
+
+    while (1) {
+        unsigned char *h = c->head;
+
+        if (c->head_got < FCGI_HEADER_LEN) {
+            n = read(c->fd, h + c->head_got, FCGI_HEADER_LEN - c->head_got);
+            if (n <= 0)
+                break;
+            c->head_got += n;
+            if (c->head_got < FCGI_HEADER_LEN)
+                continue;
+            c->content_left = (h[4] << 8) | h[5];
+            c->padding_left = h[6];
+        }
+
+        if (h[1] == FCGI_STDOUT && c->content_left) {
+            if (len > c->content_left)
+                len = c->content_left;
+            n = read(c->fd, buf, len);
+            if (n <= 0)
+                break;
+            c->content_left -= n;
+            if (c->content_left == 0 && c->padding_left == 0)
+                c->head_got = 0;
+            return n;
+        }
+
+        if (c->content_left || c->padding_left) {
+            char skip[512];
+            unsigned int want = (c->content_left ? c->content_left :
+                                 c->padding_left);
+
+            if (want > sizeof (skip))
+                want = sizeof (skip);
+            n = read(c->fd, skip, want);
+            if (n <= 0)
+                break;
+            if (c->content_left) {
+                if (h[1] == FCGI_STDERR) {
+                    log_error_doc(req);
+                    fwrite(skip, 1, n, stderr);
+                    if (skip[n - 1] != '\n')
+                        fputc('\n', stderr);
+                } else if (h[1] == FCGI_END_REQUEST) {
+                    int i;
+
+                    for (i = 0; i < n && c->end_got < 8; ++i)
+                        c->end_body[c->end_got++] = skip[i];
+                }
+                c->content_left -= n;
+            } else
+                c->padding_left -= n;
+            if (c->content_left || c->padding_left)
+                continue;
+        }
+
+        /* a whole record is in */
+        c->head_got = 0;
+        if (h[1] == FCGI_END_REQUEST) {
+            int ok = (c->end_got == 8 &&
+                      c->end_body[4] == FCGI_REQUEST_COMPLETE);
+
+            if (!ok) {
+                log_error_doc(req);
+                fprintf(stderr, "FastCGI request refused (status %d)\n",
+                        c->end_got == 8 ? c->end_body[4] : -1);
+            }
+            fcgi_release(req, ok);
+            return 0;
+        }
+    }
+
+    if (n == 0) {
+        /* closed before FCGI_END_REQUEST: what came is all there is */
+        log_error_doc(req);
+        fputs("FastCGI server closed the connection\n", stderr);
+        fcgi_release(req, 0);
+        return 0;
+    }
+    return -1;
+}
+
+/*
+ * Name: fcgi_abort
+ * Description: For free_request: a request that still has its
+ * connection did not finish, so the connection can't be used again.
+ */
+
+void fcgi_abort(request * req)
+{
+    if (req->fcgi_conn) {
+        if (req->fcgi_conn->connecting)
+            fcgi_unpark(req);
+        fcgi_release(req, 0);
+    }
+}
@@ -37,6 +37,14 @@
 
 /* local prototypes */
 static int get_cachedir_file(request * req, struct stat *statbuf);
+static int get_dir_listing(request * req, struct stat *statbuf);
+static void set_etag(request * req, struct stat *statbuf);
+static int etag_match(const char *list, const char *etag, int weak);
+static int ifrange_match(request * req);
+static int process_get_multipart(request * req);
+static int check_entity(request * req);
+static int start_entity(request * req);
+static int init_get_pack(request * req);
 static int index_directory(request * req, char *dest_filename);
 
 /*
@@ -52,10 +60,31 @@ int init_get(request * req)
 {
     int data_fd, saved_errno;
     struct stat statbuf;
-    volatile unsigned int bytes_free;
 
-    data_fd = open(req->pathname, O_RDONLY);
-    saved_errno = errno;        /* might not get used */
+    if (req->pack_entry_var)
+        return init_get_pack(req);
+
+#ifdef USE_IO_THREADS
+    if (io_open_result(req, &data_fd, &statbuf)) {
+        /* back from an io thread, which did the open and fstat */
+        saved_errno = errno;
+    } else
+#endif
+    if (negative_lookup(req->pathname)) {
+        data_fd = -1;
+        saved_errno = ENOENT;
+    }
+#ifdef USE_IO_THREADS
+    else if (io_notify_fd != -1)
+        return io_submit_open(req);
+#endif
+    else {
+        data_fd = doc_open(req, req->pathname);
+        saved_errno = errno;    /* might not get used */
+    }
+    if (data_fd == -1 && saved_errno == ENOENT)
+        negative_add(req->pathname);
+    errno = saved_errno;
 
 #ifdef GUNZIP
     if (data_fd == -1 && errno == ENOENT) {
@@ -76,7 +105,7 @@ int init_get(request * req)
         memcpy(gzip_pathname, req->pathname, len);
         memcpy(gzip_pathname + len, ".gz", 3);
         gzip_pathname[len + 3] = '\0';
-        data_fd = open(gzip_pathname, O_RDONLY);
+        data_fd = negative_open(req, gzip_pathname);
         if (data_fd != -1) {
             close(data_fd);
 
@@ -112,8 +141,8 @@ int init_get(request * req)
 
         if (saved_errno == ENOENT)
             send_r_not_found(req);
-        else if (saved_errno == EACCES)
-            send_r_forbidden(req);
+        else if (saved_errno == EACCES || saved_errno == EXDEV)
+            send_r_forbidden(req);  /* EXDEV: outside, see ResolveBeneath */
         else
             send_r_bad_request(req);
         return 0;
@@ -126,7 +155,10 @@ int init_get(request * req)
     }
 #endif
 
-    fstat(data_fd, &statbuf);
+#ifdef USE_IO_THREADS
+    if (io_notify_fd == -1)
+#endif
+        fstat(data_fd, &statbuf);
 
     if (S_ISDIR(statbuf.st_mode)) { /* directory */
         close(data_fd);         /* close dir */
@@ -223,43 +255,113 @@ int init_get(request * req)
         return 0;
     }
 
-    /* If-UnModified-Since asks
-     *  is the file newer than date located in time_cval
+    req->filesize = statbuf.st_size;
+    req->last_modified = statbuf.st_mtime;
+    set_etag(req, &statbuf);
+
+    if (!check_entity(req)) {
+        close(data_fd);
+        return 0;
+    }
+
+#ifdef MAX_FILE_MMAP
+    if (req->filesize > max_file_mmap) {
+        req->data_fd = data_fd;
+        req->status = IOSHUFFLE;
+    } else
+#endif
+    {
+        /* NOTE: I (Jon Nelson) tried performing a read(2)
+         * into the output buffer provided the file data would
+         * fit, before mmapping, and if successful, writing that
+         * and stopping there -- all to avoid the cost
+         * of a mmap.  Oddly, it was *slower* in benchmarks.
+         */
+        req->mmap_entry_var = find_mmap(data_fd, &statbuf);
+        if (req->mmap_entry_var == NULL) {
+            req->data_fd = data_fd;
+            req->status = IOSHUFFLE;
+        } else {
+            req->data_mem = req->mmap_entry_var->mmap;
+            close(data_fd);             /* close data file */
+        }
+    }
+
+    /* We lose statbuf here, so make sure response has been sent */
+    return start_entity(req);
+}
+
+/*
+ * Name: init_get_pack
+ * Description: init_get for a document in the DocumentPack, where
+ * everything is known already: nothing is opened or stat()ed.
+ */
+
+static int init_get_pack(request * req)
+{
+    char *data = pack_entity(req); /* sets the size, date and ETag */
+
+    if (!check_entity(req))
+        return 0;
+
+    req->data_mem = data;
+    return start_entity(req);
+}
+
+/*
+ * Name: check_entity
+ * Description: The conditional request and Range checks, once the
+ * size, date and entity tag of the document are known.
+ *
+ * Return values:
+ *   0: a response (412, 304, 200/204 for an empty document, or 416)
+ *      has been sent
+ *   1: go on and send the document
+ */
+
+static int check_entity(request * req)
+{
+    /* If-Unmodified-Since asks
+     *  is the file newer than the date given?
      *  yes -> return 412
+     *   no -> carry on
+     *
+     * If-None-Match asks
+     *  does the ETag match any of the ones given?
+     *  yes -> return 304
      *   no -> return 200
      *
      * If-Modified-Since asks
-     *  is the file date less than or same as the date located in time_cval
+     *  is the file date less than or same as the date given?
      *  yes -> return 304
      *  no  -> return 200
      *
-     * If-Unmodified-Since overrides If-Modified-Since
+     * If-None-Match overrides If-Modified-Since
      */
 
-    /*
-    if (req->headers[H_IF_UNMODIFIED_SINCE] &&
-        modified_since(&(statbuf.st_mtime),
-                       req->headers[H_IF_UNMODIFIED_SINCE])) {
+    if (req->if_unmodified_since &&
+        modified_since(&req->last_modified, req->if_unmodified_since) == 1) {
         send_r_precondition_failed(req);
         return 0;
-    } else
-    */
-    if (req->if_modified_since &&
-        !modified_since(&(statbuf.st_mtime), req->if_modified_since)) {
+    }
+
+    if (req->if_none_match) {
+        if (etag_match(req->if_none_match, req->etag, 1)) {
+            send_r_not_modified(req);
+            return 0;
+        }
+    } else if (req->if_modified_since &&
+        !modified_since(&req->last_modified, req->if_modified_since)) {
         send_r_not_modified(req);
-        close(data_fd);
         return 0;
     }
 
-    req->filesize = statbuf.st_size;
-    req->last_modified = statbuf.st_mtime;
-
-    /* ignore if-range without range */
-    if (req->header_ifrange && !req->ranges)
-        req->header_ifrange = NULL;
-
-    /* we don't support it yet */
-    req->header_ifrange = NULL;
+    /* If the entity tag (or date) given in If-Range matches, serve
+     * the Range as usual; otherwise the client gets the whole entity
+     * with a 200.  If-Range without Range is ignored.
+     */
+    if (req->header_ifrange && req->ranges && !ifrange_match(req))
+        ranges_reset(req);
 
     /* parse ranges now */
     /* we have to wait until req->filesize exists to fix them up */
@@ -271,62 +373,29 @@ int init_get(request * req)
     if (req->filesize == 0) {
         if (req->http_version < HTTP11) {
             send_r_request_ok(req);
-            close(data_fd);
             return 0;
         }
         send_r_no_content(req);
-        close(data_fd);
         return 0;
     }
 
-    if (req->ranges && !ranges_fixup(req)) {
-        close(data_fd);
+    if (req->ranges && !ranges_fixup(req))
         return 0;
-    }
-
-    /* if no range has been set, use default range */
-#if 0
-    DEBUG(DEBUG_RANGE) {
-        log_error_time();
-        fprintf(stderr, "if-range: %s\time_cval: %d\tmtime: %d\n",
-                req->header_ifrange, req->time_cval, statbuf->st_mtime);
-    }
-#endif
 
-    /*
-     If the entity tag given in the If-Range header matches the current
-     entity tag for the entity, then the server should provide the
-     specified sub-range of the entity using a 206 (Partial content)
-     response.
-
-     If the entity tag does not match, then the server should
-     return the entire entity using a 200 (OK) response.
-     */
-    /* IF we have range data *and* no if-range or if-range matches... */
+    return 1;
+}
 
-#ifdef MAX_FILE_MMAP
-    if (req->filesize > MAX_FILE_MMAP) {
-        req->data_fd = data_fd;
-        req->status = IOSHUFFLE;
-    } else
-#endif
-    {
-        /* NOTE: I (Jon Nelson) tried performing a read(2)
-         * into the output buffer provided the file data would
-         * fit, before mmapping, and if successful, writing that
-         * and stopping there -- all to avoid the cost
-         * of a mmap.  Oddly, it was *slower* in benchmarks.
-         */
-        req->mmap_entry_var = find_mmap(data_fd, &statbuf);
-        if (req->mmap_entry_var == NULL) {
-            req->data_fd = data_fd;
-            req->status = IOSHUFFLE;
-        } else {
-            req->data_mem = req->mmap_entry_var->mmap;
-            close(data_fd);             /* close data file */
-        }
-    }
+/*
+ * Name: start_entity
+ * Description: Sends the header for a document which passed
+ * check_entity, and whose data_mem or data_fd is set up.
+ *
+ * Return values: as for init_get
+ */
 
+static int start_entity(request * req)
+{
+    /* if no range has been set, use default range */
     if (!req->ranges) {
         req->ranges = range_pool_pop();
         req->ranges->start = 0;
@@ -336,85 +405,22 @@ int init_get(request * req)
         }
         send_r_request_ok(req);
     } else {
-        /* FIXME: support if-range header here, by the following logic:
-         * if !req->header_ifrange || st_mtime > header_ifrange,
-         *   send_r_partial_content
-         * else
-         *   reset-ranges, etc...
-         */
-        if (!req->header_ifrange) {
-            send_r_partial_content(req);
-        } else {
-            /* either no if-range or the if-range does not match */
-            ranges_reset(req);
-            req->ranges = range_pool_pop();
-            req->ranges->start = 0;
-            req->ranges->stop = -1;
-            if (!ranges_fixup(req)) {
-                return 0;
-            }
-            send_r_request_ok(req);
-        }
+        /* any If-Range has already been checked above */
+        send_r_partial_content(req);
     }
 
     if (req->method == M_HEAD) {
         return complete_response(req);
     }
 
-    bytes_free = 0;
-    if (req->data_mem) {
-        /* things can really go tilt if req->buffer_end > BUFFER_SIZE,
-         * but basically that can't happen
-         */
-
-        /* We lose statbuf here, so make sure response has been sent */
-        bytes_free = BUFFER_SIZE - req->buffer_end;
-        /* 256 bytes for the **trailing** headers */
-
-        /* bytes is now how much the buffer can hold
-         * after the headers
-         */
-    }
-
-    if (req->data_mem && bytes_free > 256) {
-        unsigned int want;
-        Range *r;
-
-        r = req->ranges;
-
-        want = (r->stop - r->start) + 1;
+    if (req->status == IOSHUFFLE)
+        stream_init(req);
 
-        if (bytes_free > want)
-            bytes_free = want;
-        else {
-            /* bytes_free <= want */
-            ;
-        }
-
-        if (setjmp(env) == 0) {
-            handle_sigbus = 1;
-            memcpy(req->buffer + req->buffer_end,
-                   req->data_mem + r->start, bytes_free);
-            handle_sigbus = 0;
-            /* OK, SIGBUS **after** this point is very bad! */
-        } else {
-            /* sigbus! */
-            log_error_doc(req);
-            reset_output_buffer(req);
-            send_r_error(req);
-            log_error("Got SIGBUS in memcpy\n");
-            return 0;
-        }
-        req->buffer_end += bytes_free;
-        req->bytes_written += bytes_free;
-        r->start += bytes_free;
-        if (bytes_free == want) {
-            /* this will fit due to the 256 extra bytes_free */
-            return complete_response(req);
-        }
-    }
-
-    /* We lose statbuf here, so make sure response has been sent */
+    /* mmapped data is not copied into the buffer here: process_get
+     * sends it straight from the mapping, in the same writev as the
+     * headers.  The kernel does the reading, so a file truncated
+     * under us costs an EFAULT, not a SIGBUS.
+     */
     return 1;
 }
 
@@ -431,45 +437,51 @@ int init_get(request * req)
 int process_get(request * req)
 {
     int bytes_written;
-    volatile unsigned int bytes_to_write;
+    unsigned int bytes_to_write;
+    unsigned int header_bytes;
+    off_t left;
+    struct iovec iov[2];
 
     if (req->method == M_HEAD) {
         return complete_response(req);
     }
 
-    bytes_to_write = (req->ranges->stop - req->ranges->start) + 1;
+    if (req->response_status == R_PARTIAL_CONTENT && req->numranges > 1)
+        return process_get_multipart(req);
 
-    if (bytes_to_write > system_bufsize)
-        bytes_to_write = system_bufsize;
+    left = (req->ranges->stop - req->ranges->start) + 1;
+    bytes_to_write = (left > system_bufsize ? system_bufsize : left);
 
-    if (setjmp(env) == 0) {
-        handle_sigbus = 1;
-        bytes_written = write(req->fd, req->data_mem + req->ranges->start,
-                              bytes_to_write);
-        handle_sigbus = 0;
-        /* OK, SIGBUS **after** this point is very bad! */
-    } else {
-        /* sigbus! */
-        req->status = DEAD;
-        log_error_doc(req);
-        fprintf(stderr, "%sGot SIGBUS in write(2)!\n",
-                get_commonlog_time());
-        /* sending an error here is inappropriate
-         * if we are here, the file is mmapped, and thus,
-         * a content-length has been sent. If we send fewer bytes
-         * the client knows there has been a problem.
-         * We run the risk of accidentally sending the right number
-         * of bytes (or a few too many) and the client
-         * won't be the wiser.
-         */
-        return 0;
-    }
+    /* process_requests leaves any pending headers (or multipart
+     * boundary) in the buffer for us, so that they go out in the
+     * same writev as the body
+     */
+    header_bytes = req->buffer_end - req->buffer_start;
+    iov[0].iov_base = req->buffer + req->buffer_start;
+    iov[0].iov_len = header_bytes;
+    iov[1].iov_base = req->data_mem + req->ranges->start;
+    iov[1].iov_len = bytes_to_write;
+
+    if (header_bytes)
+        bytes_written = writev(req->fd, iov, 2);
+    else
+        bytes_written = write(req->fd, iov[1].iov_base, bytes_to_write);
 
     if (bytes_written < 0) {
         if (errno == EWOULDBLOCK || errno == EAGAIN)
             return -1;
         /* request blocked at the pipe level, but keep going */
-        else {
+        else if (errno == EFAULT) {
+            /* the file was truncated after it was mapped.
+             * Sending an error here is inappropriate: a
+             * content-length has been sent, so the short response
+             * tells the client there has been a problem.
+             */
+            log_error_doc(req);
+            fputs("file truncated while being sent\n", stderr);
+            req->status = DEAD;
+            return 0;
+        } else {
 #ifdef QUIET_DISCONNECT
             if (errno != EPIPE) {
 #else
@@ -485,6 +497,15 @@ int process_get(request * req)
         }
     }
 
+    if (header_bytes) {
+        if ((unsigned int) bytes_written < header_bytes) {
+            req->buffer_start += bytes_written;
+            return 1;
+        }
+        req->buffer_start = req->buffer_end = 0;
+        bytes_written -= header_bytes;
+    }
+
     req->bytes_written += bytes_written;
     req->ranges->start += bytes_written;
 
@@ -495,6 +516,183 @@ int process_get(request * req)
     return 1;               /* more to do */
 }
 
+/*
+ * Name: process_get_multipart
+ * Description: process_get for multipart/byteranges responses.  The
+ * pending buffer, then up to MULTIPART_IOV_PARTS ranges, each followed
+ * by the boundary and headers of the next one (or the closing
+ * boundary), go out in a single writev.  A part header which only
+ * partly fits is put back in the buffer, to lead the next writev.
+ *
+ * Return values: as process_get
+ */
+
+static int process_get_multipart(request * req)
+{
+    static char part[MULTIPART_IOV_PARTS][MULTIPART_HEADER_SIZE];
+    unsigned int part_len[MULTIPART_IOV_PARTS];
+    struct iovec iov[1 + 2 * MULTIPART_IOV_PARTS];
+    size_t pending, left, seg;
+    int bytes_written, n = 0, i;
+    Range *r;
+
+    pending = req->buffer_end - req->buffer_start;
+    if (pending) {
+        iov[n].iov_base = req->buffer + req->buffer_start;
+        iov[n++].iov_len = pending;
+    }
+    for (r = req->ranges, i = 0; r && i < MULTIPART_IOV_PARTS;
+         r = r->next, ++i) {
+        iov[n].iov_base = req->data_mem + r->start;
+        iov[n++].iov_len = r->stop - r->start + 1;
+        part_len[i] = multipart_header(req, r->next, part[i],
+                                       MULTIPART_HEADER_SIZE);
+        iov[n].iov_base = part[i];
+        iov[n++].iov_len = part_len[i];
+    }
+
+    bytes_written = writev(req->fd, iov, n);
+    if (bytes_written < 0) {
+        if (errno == EWOULDBLOCK || errno == EAGAIN)
+            return -1;
+        if (errno == EFAULT) {
+            log_error_doc(req);
+            fputs("file truncated while being sent\n", stderr);
+        } else {
+#ifdef QUIET_DISCONNECT
+            if (errno != EPIPE) {
+#else
+            if (1) {
+#endif
+                log_error_doc(req);
+                perror("writev");
+            }
+        }
+        req->status = DEAD;
+        return 0;
+    }
+
+    left = bytes_written;
+    if (pending) {
+        if (left < pending) {
+            req->buffer_start += left;
+            return 1;
+        }
+        left -= pending;
+        req->buffer_start = req->buffer_end = 0;
+    }
+    for (i = 0; req->ranges && i < MULTIPART_IOV_PARTS; ++i) {
+        r = req->ranges;
+        seg = r->stop - r->start + 1;
+        if (left < seg) {
+            r->start += left;
+            req->bytes_written += left;
+            return 1;
+        }
+        req->bytes_written += seg;
+        left -= seg;
+        req->ranges = r->next;
+        range_pool_push(r);
+
+        if (left < part_len[i]) {
+            req_write(req, part[i] + left);
+            if (req->ranges == NULL)
+                req->status = DONE; /* just the closing boundary left */
+            return 1;
+        }
+        left -= part_len[i];
+    }
+    if (req->ranges == NULL) {
+        req->status = DONE;
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * Name: set_etag
+ * Description: Builds the strong entity tag for the file described by
+ * statbuf into req->etag.  It changes whenever the file is replaced
+ * (dev/ino), or rewritten in place (size/mtime).
+ */
+
+static void set_etag(request * req, struct stat *statbuf)
+{
+    snprintf(req->etag, sizeof (req->etag), "\"%lx-%lx-%llx-%lx\"",
+             (unsigned long) statbuf->st_dev,
+             (unsigned long) statbuf->st_ino,
+             (unsigned long long) statbuf->st_size,
+             (unsigned long) statbuf->st_mtime);
+}
+
+/*
+ * Name: etag_match
+ * Description: Checks etag against a comma-separated list of entity
+ * tags, as found in If-None-Match or If-Range.  "*" matches anything.
+ * With weak set, W/ tags are compared as if they were strong
+ * (the weak comparison function); otherwise they never match.
+ *
+ * Return values: 1 if one of the tags matches, 0 otherwise
+ */
+
+static int etag_match(const char *list, const char *etag, int weak)
+{
+    unsigned int len = strlen(etag);
+    const char *p = list;
+    int is_weak;
+
+    if (len == 0)
+        return 0;
+
+    while (*p) {
+        while (*p == ' ' || *p == '\t' || *p == ',')
+            ++p;
+        if (*p == '*')
+            return 1;
+
+        is_weak = 0;
+        if (p[0] == 'W' && p[1] == '/') {
+            is_weak = 1;
+            p += 2;
+        }
+        if ((weak || !is_weak) && !strncmp(p, etag, len) &&
+            (p[len] == '\0' || p[len] == ',' ||
+             p[len] == ' ' || p[len] == '\t'))
+            return 1;
+
+        /* skip the rest of this tag */
+        if (*p == '"') {
+            p = strchr(p + 1, '"');
+            if (p == NULL)
+                return 0;
+            ++p;
+        }
+        while (*p && *p != ',')
+            ++p;
+    }
+    return 0;
+}
+
+/*
+ * Name: ifrange_match
+ * Description: Evaluates req->header_ifrange, which is either an entity
+ * tag (compared strongly) or an HTTP-date that must not be older than
+ * the file.
+ *
+ * Return values: 1 if the Range may be honored, 0 if the whole entity
+ * must be sent instead
+ */
+
+static int ifrange_match(request * req)
+{
+    const char *v = req->header_ifrange;
+
+    if (*v == '"' || (v[0] == 'W' && v[1] == '/'))
+        return etag_match(v, req->etag, 0);
+
+    return (modified_since(&req->last_modified, v) == 0);
+}
+
 /*
  * Name: get_dir
  * Description: Called from process_get if the request is a directory.
@@ -531,7 +729,7 @@ int get_dir(request * req, struct stat *statbuf)
         memcpy(pathname_with_index, req->pathname, l1); /* doesn't copy NUL */
         memcpy(pathname_with_index + l1, directory_index, l2 + 1); /* does */
 
-        data_fd = open(pathname_with_index, O_RDONLY);
+        data_fd = negative_open(req, pathname_with_index);
 
         if (data_fd != -1) {    /* user's index file */
             /* We have to assume that directory_index will fit, because
@@ -555,7 +753,7 @@ int get_dir(request * req, struct stat *statbuf)
          * try index.html.gz
          */
         strcat(pathname_with_index, ".gz");
-        data_fd = open(pathname_with_index, O_RDONLY);
+        data_fd = negative_open(req, pathname_with_index);
         if (data_fd != -1) {    /* user's index file */
             close(data_fd);
 
@@ -586,7 +784,9 @@ int get_dir(request * req, struct stat *statbuf)
     }
 
     /* only here if index.html, index.html.gz don't exist */
-    if (dirmaker != NULL) {     /* don't look for index.html... maybe automake? */
+    if (internal_dirmaker) {
+        return get_dir_listing(req, statbuf);
+    } else if (dirmaker != NULL) { /* don't look for index.html... maybe automake? */
         req->response_status = R_REQUEST_OK;
         SQUASH_KA(req);
 
@@ -612,6 +812,78 @@ int get_dir(request * req, struct stat *statbuf)
     }
 }
 
+/*
+ * Name: get_dir_listing
+ * Description: Serves the listing rendered (or cached) by find_index
+ * from memory, like a mmapped file, so it gets a Content-Length and
+ * the connection may be kept alive.  Its head, which has the URL in
+ * it, goes in the buffer after the response header.  Range is ignored
+ * for listings.
+ *
+ * Return values: as for get_dir, never a file descriptor
+ */
+
+static int get_dir_listing(request * req, struct stat *statbuf)
+{
+    char *head;
+    unsigned int head_len;
+
+    req->index_entry_var = find_index(req, statbuf);
+    if (req->index_entry_var == NULL)
+        return -1;              /* errors reported by find_index */
+    head = index_head_html(req, &head_len);
+    if (head == NULL)
+        return 0;
+    if (head_len > BUFFER_SIZE / 2) {
+        free(head);
+        send_r_request_uri_too_long(req);
+        return 0;
+    }
+
+    req->data_mem = req->index_entry_var->data;
+    req->filesize = head_len + req->index_entry_var->len;
+    req->last_modified = statbuf->st_mtime;
+    statbuf->st_size = req->filesize;
+    set_etag(req, statbuf);
+
+    if (req->if_none_match) {
+        if (etag_match(req->if_none_match, req->etag, 1)) {
+            free(head);
+            send_r_not_modified(req);
+            return 0;
+        }
+    } else if (req->if_modified_since &&
+        !modified_since(&(statbuf->st_mtime), req->if_modified_since)) {
+        free(head);
+        send_r_not_modified(req);
+        return 0;
+    }
+
+    ranges_reset(req);
+    req->ranges = range_pool_pop();
+    req->ranges->start = 0;
+    req->ranges->stop = -1;
+    if (!ranges_fixup(req)) {
+        free(head);
+        return 0;
+    }
+    send_r_request_ok(req);
+
+    if (req->method == M_HEAD) {
+        free(head);
+        return complete_response(req);
+    }
+    if (req_write(req, head) == -1) {
+        free(head);
+        return 0;
+    }
+    free(head);
+    /* the rest is the cached entry's */
+    req->filesize = req->index_entry_var->len;
+    req->ranges->stop = req->filesize - 1;
+    return 1;
+}
+
 static int get_cachedir_file(request * req, struct stat *statbuf)
 {
 
@@ -38,7 +38,13 @@ enum REQ_STATUS { READ_HEADER, ONE_CR, ONE_LF, TWO_CR,
     BODY_READ, BODY_WRITE,
     WRITE,
     PIPE_READ, PIPE_WRITE,
+    FCGI_WRITE,                 /* request going to a FastCGI server */
+    FCGI_WAIT,                  /* parked until a FastCGI server has room */
+    PROXY_WRITE,                /* request going to a ProxyPass upstream */
     IOSHUFFLE,
+    FILE_WAIT,                  /* parked while an io thread works */
+    CGI_WAIT,                   /* parked until a CGI child may start */
+    CGI_CACHE_WAIT,             /* parked until a cached CGI has run */
     DONE,
     TIMED_OUT,
     DEAD
@@ -81,21 +87,24 @@ enum RESPONSE_CODE { R_CONTINUE = 100,
                      R_BAD_VERSION };
 
 /************* ALIAS TYPES (aliasp->type) ***************/
-enum ALIAS { ALIAS, SCRIPTALIAS, REDIRECT };
+enum ALIAS { ALIAS, SCRIPTALIAS, REDIRECT, TCLALIAS, PROXYALIAS };
+
+/*********** CACHE POLICIES (cache_policy_add) **********/
+enum CACHE_POLICY { CACHE_PATH, CACHE_TYPE, CACHE_FINGERPRINT };
 
 /*********** KEEPALIVE CONSTANTS (req->keepalive) *******/
 enum KA_STATUS { KA_INACTIVE, KA_ACTIVE, KA_STOPPED };
 
 /********* CGI STATUS CONSTANTS (req->cgi_status) *******/
-enum CGI_STATUS { CGI_PARSE, CGI_BUFFER, CGI_DONE };
+enum CGI_STATUS { CGI_PARSE, CGI_BUFFER, CGI_DONE, CGI_SPLICE };
 
 /************** CGI TYPE (req->is_cgi) ******************/
 enum CGI_TYPE { NPH = 1, CGI };
 
 /**************** STRUCTURES ****************************/
 struct range {
-    unsigned long start;
-    unsigned long stop;
+    off_t start;                /* -1 for a suffix range, "-N" */
+    off_t stop;                 /* -1 for an open one, "N-" */
     struct range *next;
 };
 
@@ -107,6 +116,53 @@ struct mmap_entry {
     char *mmap;
     int use_count;
     off_t len;
+    time_t mtime;
+    int locked;                 /* mlock()ed: stays mapped when unused */
+};
+
+#ifdef USE_IO_THREADS
+/******************* IO THREAD JOBS ******************/
+enum IO_JOB_TYPE { IO_OPEN, IO_READ };
+enum IO_JOB_STATE { IO_IDLE, IO_QUEUED, IO_DONE };
+
+struct io_job {
+    enum IO_JOB_TYPE type;
+    enum IO_JOB_STATE state;
+    struct request *req;
+    int fd;                     /* IO_OPEN: result; IO_READ: file */
+    int dirfd;                  /* IO_OPEN: see doc_openat */
+    const char *rel;
+    int error;                  /* errno, as seen by the io thread */
+    struct stat statbuf;        /* IO_OPEN: fstat of the result */
+    char *buf;                  /* IO_READ: destination */
+    size_t len;
+    off_t offset;
+    int result;                 /* IO_READ: bytes read, or -1 */
+    dev_t dev;                  /* for the per-device statistics */
+    struct timeval queued, started, finished;
+    struct io_job *next;
+};
+#endif
+
+struct pack_entry;               /* see pack.h */
+struct fcgi_conn;                /* see fastcgi.c */
+struct cgi_child;                /* see cgi_limit.c */
+struct cgi_cache_entry;          /* see cgi_cache.c */
+struct cgi_gzip;                 /* see cgi_gzip.c */
+struct tcl_response;             /* see tcl_handler.c */
+struct stream_file;              /* see pipe.c */
+struct proxy_pass;               /* see proxy.c */
+struct proxy_conn;               /* see proxy.c */
+
+struct index_entry {
+    dev_t dev;
+    ino_t ino;
+    time_t mtime;
+    char *path;                 /* of the directory */
+    char *data;                 /* the rendered HTML, less its head */
+    unsigned int len;
+    int use_count;
+    int cached;                 /* still in the index_list table */
 };
 
 struct request {                /* pending requests */
@@ -125,16 +181,25 @@ struct request {                /* pending requests */
 #endif
 
     char *pathname;             /* pathname of requested file */
+    unsigned int root_len;      /* pathname[0..root_len) is its root dir */
 
     Range *ranges;              /* our Ranges */
     int numranges;
 
     int data_fd;                /* fd of data */
-    unsigned long filesize;     /* filesize */
-    unsigned long filepos;      /* position in file */
-    unsigned long bytes_written; /* total bytes written (sans header) */
+    off_t filesize;             /* filesize */
+    off_t filepos;              /* position in file */
+    off_t bytes_written;        /* total bytes written (sans header) */
     char *data_mem;             /* mmapped/malloced char array */
 
+    int streaming;              /* StreamingThreshold policy applies */
+    off_t stream_ahead;         /* WILLNEED has been given up to here */
+    off_t stream_behind;        /* DONTNEED has been given up to here */
+    struct stream_file *stream_file; /* counts who else streams it */
+    char *direct_buf;           /* O_DIRECT bounce buffer, or NULL */
+    off_t direct_offset;        /* file offset of direct_buf[0] */
+    int direct_len;             /* bytes valid in direct_buf */
+
     char *logline;              /* line to log file */
 
     char *header_line;          /* beginning of un or incompletely processed header line */
@@ -145,10 +210,14 @@ struct request {                /* pending requests */
     int buffer_end;             /* where the buffer ends */
 
     char *if_modified_since;    /* If-Modified-Since */
+    char *if_unmodified_since;  /* If-Unmodified-Since */
+    char *if_none_match;        /* If-None-Match */
     time_t last_modified;       /* Last-modified: */
+    char etag[MAX_ETAG_LENGTH]; /* ETag:, empty if none */
 
     /* CGI vars */
     int cgi_env_index;          /* index into array */
+    unsigned int cgi_env_used;  /* of cgi_env_arena */
 
     /* Agent and referer for logfiles */
     char *header_host;
@@ -158,6 +227,20 @@ struct request {                /* pending requests */
     char *host;                 /* what we end up using for 'host', no matter the contents of header_host */
 
     int post_data_fd;           /* fd for post data tmpfile */
+    struct fcgi_conn *fcgi_conn; /* while talking to a FastCGI server */
+    struct request *fcgi_wait_next; /* in FCGI_WAIT */
+    struct cgi_child *cgi_child; /* the child writing to data_fd */
+    struct request *cgi_wait_next; /* in CGI_WAIT */
+    int cgi_woken;              /* readied from CGI_WAIT */
+    int cgi_queued;             /* on the CGI_WAIT queue */
+    struct cgi_cache_entry *cgi_cache; /* stored response being sent,
+                                        * filled or waited for */
+    struct request *cgi_cache_next; /* in CGI_CACHE_WAIT */
+    struct cgi_gzip *cgi_gzip;  /* compressing the CGI's output */
+    int tcl_alias;              /* the script is under a TclAlias */
+    struct tcl_response *tcl_response; /* what the Tcl script said */
+    struct proxy_pass *proxy_pass; /* under a ProxyPass path */
+    struct proxy_conn *proxy_conn; /* while talking to its upstream */
 
     char *path_info;            /* env variable */
     char *path_translated;      /* env variable */
@@ -167,6 +250,11 @@ struct request {                /* pending requests */
     char *content_length;       /* env variable */
 
     struct mmap_entry *mmap_entry_var;
+    struct index_entry *index_entry_var;
+    const struct pack_entry *pack_entry_var; /* in the DocumentPack */
+#ifdef USE_IO_THREADS
+    struct io_job *io_job;      /* open/read offloaded to an io thread */
+#endif
 
     /* everything **above** this line is zeroed in sanitize_request */
     /* this may include 'fd' */
@@ -179,6 +267,7 @@ struct request {                /* pending requests */
     char local_ip_addr[BOA_NI_MAXHOST]; /* for virtualhost */
     char remote_ip_addr[BOA_NI_MAXHOST]; /* after inet_ntoa */
     unsigned int remote_port;            /* could be used for ident */
+    int proxy_protocol;         /* a PROXY line is to come first */
 
     unsigned int kacount;                /* keepalive count */
     int client_stream_pos;      /* how much have we read... */
@@ -188,6 +277,8 @@ struct request {                /* pending requests */
     char request_uri[MAX_HEADER_LENGTH + 1]; /* uri */
     char client_stream[CLIENT_STREAM_SIZE]; /* data from client - fit or be hosed */
     char *cgi_env[CGI_ENV_MAX + 4]; /* CGI environment */
+    char *cgi_env_arena;        /* the strings in cgi_env past the common ones */
+    unsigned int cgi_env_arena_size;
 
 #ifdef ACCEPT_ON
     char accept[MAX_ACCEPT_LENGTH]; /* Accept: fields */
@@ -221,6 +312,21 @@ extern fd_set block_write_fdset; /* fds blocked on write */
 extern int max_fd;
 #endif
 
+/* a socket connections are taken from (Listen) */
+struct listener {
+    int fd;
+    int pending;                /* the loop saw a connection waiting */
+    int proxy_protocol;         /* connections begin with a PROXY line */
+    char *ip;                   /* to bind to, or NULL for any */
+    char *path;                 /* of a Unix domain socket, else NULL */
+#ifdef HAVE_POLL
+    int pfd;                    /* its place in pfds */
+#endif
+    struct listener *next;
+};
+
+extern struct listener *listeners;
+
 /* global server variables */
 
 extern char *access_log_name;
@@ -235,14 +341,18 @@ extern gid_t server_gid;
 extern char *server_admin;
 extern char *server_root;
 extern char *server_name;
-extern char *server_ip;
 
 extern char *document_root;
+extern char *document_pack;
+extern char *warmup_manifest;
+extern char *warmup_log;
+extern unsigned int warmup_count;
 extern char *user_dir;
 extern char *directory_index;
 extern char *default_type;
 extern char *default_charset;
 extern char *dirmaker;
+extern int internal_dirmaker;
 extern char *mime_types;
 extern char *pid_file;
 extern char *cachedir;
@@ -279,8 +389,32 @@ extern const char *default_vhost;
 extern unsigned total_connections;
 extern unsigned int system_bufsize;      /* Default size of SNDBUF given by system */
 
-extern sigjmp_buf env;
-extern int handle_sigbus;
 extern unsigned int cgi_umask;
+extern unsigned int cgi_pipe_size;
+extern unsigned int fcgi_processes;
+extern unsigned int cgi_max_children;
+extern unsigned int cgi_queue;
+extern unsigned int cgi_timeout;
+extern unsigned int cgi_max_output;
+extern unsigned int cgi_cache_size;
+extern char *cgi_cache_spool_dir;
+extern unsigned int cgi_gzip_level;
+extern unsigned int tcl_max_commands;
+extern unsigned int tcl_max_time;
+extern unsigned int proxy_down_time;
+extern unsigned int io_threads;
+extern unsigned int stream_threshold;
+extern unsigned int stream_window;
+extern unsigned int direct_io_threshold;
+extern int mmap_populate;
+extern int mmap_hugepages;
+extern unsigned int mmap_lock_size;
+extern unsigned int max_file_mmap;
+extern unsigned int max_ranges;
+extern int negative_cache;
+extern int resolve_beneath;
+extern int negative_notify_fd;
+extern int io_notify_fd;
+extern int signal_fd;
 
 #endif
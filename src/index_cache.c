@@ -0,0 +1,149 @@
+/*
+ *  Boa, an http server
+ *  Copyright (C) 1999-2005 Larry Doolittle <ldoolitt@boa.org>
+ *  Copyright (C) 2000-2004 Jon Nelson <jnelson@boa.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 1, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/* $Id$*/
+
+/*
+ * In-process directory listings (DirectoryMaker internal).
+ * Rendered listings are kept in a small direct-mapped table keyed by
+ * the directory alone: its path and dev/ino/mtime.  What is cached is
+ * the entries and the end of the page; the head, with the URL in it
+ * (one directory may be reachable through several), is made for each
+ * request by index_head_html.  An entry displaced from the table
+ * lives on until the last request sending it lets go.
+ */
+
+#include "boa.h"
+#include "index_dir.h"
+
+#define INDEX_LIST_HASH(dev,ino) ((ino)&INDEX_LIST_MASK)
+
+static struct index_entry *index_list[INDEX_LIST_SIZE];
+
+static void free_index(struct index_entry *e)
+{
+    free(e->path);
+    free(e->data);
+    free(e);
+}
+
+/*
+ * Name: find_index
+ * Description: Returns the listing of req->pathname, less its head,
+ * rendering it if there is no current one in the cache.  s is the
+ * stat of the directory.
+ *
+ * Return values: the entry, with its use_count incremented, or NULL
+ * (in which case an error response has been sent)
+ */
+
+struct index_entry *find_index(request * req, struct stat *s)
+{
+    struct index_entry *e;
+    struct index_buf listing;
+    int i, ret;
+
+    i = INDEX_LIST_HASH(s->st_dev, s->st_ino);
+    e = index_list[i];
+    if (e && e->dev == s->st_dev && e->ino == s->st_ino &&
+        e->mtime == s->st_mtime && !strcmp(e->path, req->pathname)) {
+        e->use_count++;
+        DEBUG(DEBUG_INDEX_CACHE) {
+            log_error_time();
+            fprintf(stderr, "index_list entry %d hit, use_count now %d\n",
+                    i, e->use_count);
+        }
+        return e;
+    }
+
+    memset(&listing, 0, sizeof (listing));
+    ret = index_rows(req->pathname, &listing);
+    if (ret) {
+        log_error_doc(req);
+        fprintf(stderr, "unable to index directory (error %d)\n", ret);
+        if (ret == INDEX_ERR_CHDIR && errno == EACCES)
+            send_r_forbidden(req);
+        else
+            send_r_error(req);
+        return NULL;
+    }
+
+    e = malloc(sizeof (struct index_entry));
+    if (e == NULL || (e->path = strdup(req->pathname)) == NULL) {
+        if (e)
+            free(e);
+        free(listing.data);
+        boa_perror(req, "malloc for index_entry");
+        return NULL;
+    }
+    e->dev = s->st_dev;
+    e->ino = s->st_ino;
+    e->mtime = s->st_mtime;
+    e->data = listing.data;
+    e->len = listing.len;
+    e->use_count = 1;
+    e->cached = 1;
+
+    /* displace whatever was there */
+    if (index_list[i]) {
+        index_list[i]->cached = 0;
+        if (index_list[i]->use_count == 0)
+            free_index(index_list[i]);
+    }
+    index_list[i] = e;
+
+    DEBUG(DEBUG_INDEX_CACHE) {
+        log_error_time();
+        fprintf(stderr, "index_list entry %d rendered (%u bytes)\n",
+                i, e->len);
+    }
+    return e;
+}
+
+/*
+ * Name: index_head_html
+ * Description: The head of req's listing, titled with its URL, to be
+ * sent ahead of what find_index returned.
+ *
+ * Return values: the HTML, malloced, with its length in *len; or NULL
+ * (in which case an error response has been sent)
+ */
+
+char *index_head_html(request * req, unsigned int *len)
+{
+    struct index_buf head;
+
+    memset(&head, 0, sizeof (head));
+    if (index_head(req->request_uri, &head)) {
+        boa_perror(req, "index_head");
+        return NULL;
+    }
+    *len = head.len;
+    return head.data;
+}
+
+void release_index(struct index_entry *e)
+{
+    if (!e)
+        return;
+    if (!--(e->use_count) && !e->cached)
+        free_index(e);
+}
@@ -19,7 +19,10 @@
 
 /* $Id: index_dir.c,v 1.32.2.7 2005/02/22 03:00:24 jnelson Exp $*/
 
+#include "config.h"
 #include <stdio.h>
+#include <stdarg.h>
+#include <errno.h>
 #include <sys/stat.h>
 #include <limits.h>             /* for PATH_MAX */
 #include <time.h>
@@ -36,15 +39,10 @@
   ((((x)-10)>=0)?('A'+((x)-10)):('0'+(x)))
 
 #include "escape.h"
+#include "index_dir.h"
 
-char *html_escape_string(const char *inp, char *dest,
-                         const unsigned int len);
-char *http_escape_string(const char *inp, char *buf,
-                         const unsigned int len);
-
-int select_files(const struct dirent *d);
-int index_directory(char *dir, char *title);
-void send_error(int error);
+static int select_files(const struct dirent *d);
+static int index_printf(struct index_buf *out, const char *fmt, ...);
 
 /*
  * Name: html_escape_string
@@ -152,39 +150,7 @@ char *http_escape_string(const char *inp, char *buf,
     return buf;
 }
 
-void send_error(int error)
-{
-    const char *the_error;
-
-    switch (error) {
-
-    case 1:
-        the_error = "Not enough arguments were passed to the indexer.";
-        break;
-    case 2:
-        the_error = "The Directory Sorter ran out of Memory";
-        break;
-    case 3:
-        the_error =
-            "The was a problem changing to the appropriate directory.";
-        break;
-    case 4:
-        the_error = "There was an error escaping a string.";
-    case 5:
-        the_error = "Too many arguments were passed to the indexer.";
-        break;
-    case 6:
-        the_error = "No files in this directory.";
-        break;
-    default:
-        the_error = "An unknown error occurred producing the directory.";
-        break;
-    }
-    printf("<html>\n<head>\n<title>\n%s\n</title>\n"
-           "<body>\n%s\n</body>\n</html>\n", the_error, the_error);
-}
-
-int select_files(const struct dirent *dirbuf)
+static int select_files(const struct dirent *dirbuf)
 {
     if (dirbuf->d_name[0] == '.')
         return 0;
@@ -192,57 +158,161 @@ int select_files(const struct dirent *dirbuf)
         return 1;
 }
 
+/*
+ * Name: index_printf
+ * Description: printf onto the end of out, growing it as needed
+ * returns -1 if out of memory, else 0
+ */
+
+static int index_printf(struct index_buf *out, const char *fmt, ...)
+{
+    va_list ap;
+    int len;
+
+    while (1) {
+        va_start(ap, fmt);
+        len = vsnprintf(out->data + out->len, out->size - out->len, fmt, ap);
+        va_end(ap);
+
+        if (len < 0)
+            return -1;
+        if (out->len + len < out->size) {
+            out->len += len;
+            return 0;
+        }
+        /* didn't fit (including the NUL); grow and try again */
+        {
+            char *p;
+            unsigned int newsize = out->size * 2;
+
+            if (newsize < out->len + len + 1)
+                newsize = out->len + len + 1;
+            p = realloc(out->data, newsize);
+            if (p == NULL)
+                return -1;
+            out->data = p;
+            out->size = newsize;
+        }
+    }
+}
+
 /*
  * Name: index_directory
- * Description: Called from get_dir_mapping if a directory html
- * has to be generated on the fly
- * If no_slash is true, prepend slashes to hrefs
- * returns -1 for problem, else 0
+ * Description: Renders the HTML listing of dir, under title, into
+ * out, which should be zeroed by the caller.  Used by boa_indexer.
+ * On failure, out->data is freed.
+ * returns 0 for success, or one of the INDEX_ERR_ codes
+ */
+
+int index_directory(const char *dir, const char *title,
+                    struct index_buf *out)
+{
+    int ret = index_head(title, out);
+
+    return (ret ? ret : index_rows(dir, out));
+}
+
+/*
+ * Name: index_head
+ * Description: Renders the top of a listing into out: the title, and
+ * a link to the parent directory unless title is "/".  This is the
+ * part which depends on the URL the directory was reached by; Boa
+ * itself (DirectoryMaker "internal") caches what index_rows makes,
+ * and sends a head of its own with it.
+ * On failure, out->data is freed.
+ * returns 0 for success, or one of the INDEX_ERR_ codes
+ */
+
+int index_head(const char *title, struct index_buf *out)
+{
+    char *html_title;
+    int ret = 0;
+
+    /* a title isn't bounded by MAX_FILE_LENGTH, as names are */
+    html_title = html_escape_string(title, NULL, strlen(title));
+    if (html_title == NULL)
+        return INDEX_ERR_ESCAPE;
+
+    if (index_printf(out, "<html>\n"
+           "<head>\n<title>Index of %s</title>\n</head>\n\n"
+           "<body bgcolor=\"#ffffff\">\n"
+           "<H2>Index of %s</H2>\n"
+           "<table>\n%s",
+           html_title, html_title,
+           (strcmp(title, "/") == 0 ? "" :
+            "<tr><td colspan=3><h3>Directories</h3></td></tr>"
+            "<tr><td colspan=3><a href=\"../\">Parent Directory</a></td></tr>\n"))) {
+        ret = INDEX_ERR_NOMEM;
+        free(out->data);
+        out->data = NULL;
+        out->len = out->size = 0;
+    }
+    free(html_title);
+    return ret;
+}
+
+/*
+ * Name: index_rows
+ * Description: Renders the entries of dir, and the end of the page,
+ * onto the end of out.
+ * On failure, out->data is freed.
+ * returns 0 for success, or one of the INDEX_ERR_ codes
  */
 
-int index_directory(char *dir, char *title)
+int index_rows(const char *dir, struct index_buf *out)
 {
     struct dirent *dirbuf;
-    int numdir;
-    struct dirent **array;
+    int numdir = 0;
+    struct dirent **array = NULL;
     struct stat statbuf;
+    char pathname[MAX_PATH_LENGTH];
     char http_filename[MAX_FILE_LENGTH * 3];
     char html_filename[MAX_FILE_LENGTH * 6];
     char escaped_filename[MAX_FILE_LENGTH * 18]; /* *both* http and html escape */
-    int i;
+    unsigned int dirlen;
+    int i, n, ret = 0;
+    time_t timep;
+    struct tm *timeptr;
+    char now[26];
 
-    if (chdir(dir) == -1) {
-        send_error(3);
-        return -1;
+    dirlen = strlen(dir);
+    if (dirlen + 1 + MAX_FILE_LENGTH + 1 > sizeof (pathname)) {
+        ret = INDEX_ERR_CHDIR;
+        goto out;
     }
-    numdir = scandir(".", &array, select_files, alphasort);
-    if (numdir == -1) {
-        send_error(2);
-        return -1;
-    } else if (numdir == -2) {
-        send_error(6);
-        return -1;
+    memcpy(pathname, dir, dirlen);
+    if (dirlen == 0 || pathname[dirlen - 1] != '/')
+        pathname[dirlen++] = '/';
+
+    n = scandir(dir, &array, select_files, alphasort);
+    if (n == -1) {
+        ret = (errno == ENOMEM ? INDEX_ERR_NOMEM : INDEX_ERR_CHDIR);
+        array = NULL;
+        goto out;
+    } else if (n == -2) {
+        ret = INDEX_ERR_EMPTY;
+        array = NULL;
+        goto out;
     }
+    numdir = n;
 
-    if (html_escape_string(title, html_filename, strlen(title)) == NULL) {
-        send_error(4);
-        return -1;
-    }
+    /* directory entries are ~200 bytes apiece */
+    if (out->size < out->len + 1024 + numdir * 256) {
+        char *p = realloc(out->data, out->len + 1024 + numdir * 256);
 
-    printf("<html>\n"
-           "<head>\n<title>Index of %s</title>\n</head>\n\n"
-           "<body bgcolor=\"#ffffff\">\n"
-           "<H2>Index of %s</H2>\n"
-           "<table>\n%s",
-           html_filename, html_filename,
-           (strcmp(title, "/") == 0 ? "" :
-            "<tr><td colspan=3><h3>Directories</h3></td></tr>"
-            "<tr><td colspan=3><a href=\"../\">Parent Directory</a></td></tr>\n"));
+        if (p == NULL) {
+            ret = INDEX_ERR_NOMEM;
+            goto out;
+        }
+        out->data = p;
+        out->size = out->len + 1024 + numdir * 256;
+    }
 
     for (i = 0; i < numdir; ++i) {
         dirbuf = array[i];
 
-        if (stat(dirbuf->d_name, &statbuf) == -1)
+        memcpy(pathname + dirlen, dirbuf->d_name, NAMLEN(dirbuf) + 1);
+        if (stat(pathname, &statbuf) == -1)
             continue;
 
         if (!S_ISDIR(statbuf.st_mode))
@@ -250,36 +320,43 @@ int index_directory(char *dir, char *title)
 
         if (html_escape_string(dirbuf->d_name, html_filename,
                                NAMLEN(dirbuf)) == NULL) {
-            send_error(4);
-            return -1;
+            ret = INDEX_ERR_ESCAPE;
+            goto out;
         }
         if (http_escape_string(dirbuf->d_name, http_filename,
                                NAMLEN(dirbuf)) == NULL) {
-            send_error(4);
-            return -1;
+            ret = INDEX_ERR_ESCAPE;
+            goto out;
         }
         if (html_escape_string(http_filename, escaped_filename,
                                strlen(http_filename)) == NULL) {
-            send_error(4);
-            return -1;
+            ret = INDEX_ERR_ESCAPE;
+            goto out;
         }
-        printf("<tr>"
+        if (index_printf(out, "<tr>"
                "<td width=\"40%%\"><a href=\"%s/\">%s/</a></td>"
                "<td align=right>%s</td>"
-               "<td align=right>%ld bytes</td>"
+               "<td align=right>%lld bytes</td>"
                "</tr>\n",
                escaped_filename, html_filename,
-               ctime(&statbuf.st_mtime), (long) statbuf.st_size);
+               ctime(&statbuf.st_mtime), (long long) statbuf.st_size)) {
+            ret = INDEX_ERR_NOMEM;
+            goto out;
+        }
     }
 
-    printf
-        ("<tr><td colspan=3>&nbsp;</td></tr>\n<tr><td colspan=3><h3>Files</h3></td></tr>\n");
+    if (index_printf(out,
+         "<tr><td colspan=3>&nbsp;</td></tr>\n<tr><td colspan=3><h3>Files</h3></td></tr>\n")) {
+        ret = INDEX_ERR_NOMEM;
+        goto out;
+    }
 
     for (i = 0; i < numdir; ++i) {
         int len;
         dirbuf = array[i];
 
-        if (stat(dirbuf->d_name, &statbuf) == -1)
+        memcpy(pathname + dirlen, dirbuf->d_name, NAMLEN(dirbuf) + 1);
+        if (stat(pathname, &statbuf) == -1)
             continue;
 
 
@@ -288,13 +365,13 @@ int index_directory(char *dir, char *title)
 
         if (html_escape_string(dirbuf->d_name, html_filename,
                                NAMLEN(dirbuf)) == NULL) {
-            send_error(4);
-            return -1;
+            ret = INDEX_ERR_ESCAPE;
+            goto out;
         }
         if (http_escape_string(dirbuf->d_name, http_filename,
                                NAMLEN(dirbuf)) == NULL) {
-            send_error(4);
-            return -1;
+            ret = INDEX_ERR_ESCAPE;
+            goto out;
         }
 
         len = strlen(http_filename);
@@ -304,70 +381,42 @@ int index_directory(char *dir, char *title)
             html_filename[strlen(html_filename) - 3] = '\0';
             if (html_escape_string(http_filename, escaped_filename,
                                    strlen(http_filename)) == NULL) {
-                send_error(4);
-                return -1;
+                ret = INDEX_ERR_ESCAPE;
+                goto out;
             }
 
-            printf("<tr>"
+            if (index_printf(out, "<tr>"
                    "<td width=\"40%%\"><a href=\"%s\">%s</a> "
                    "<a href=\"%s.gz\">(.gz)</a></td>"
                    "<td align=right>%s</td>"
-                   "<td align=right>%ld bytes</td>"
+                   "<td align=right>%lld bytes</td>"
                    "</tr>\n",
                    escaped_filename, html_filename, http_filename,
-                   ctime(&statbuf.st_mtime), (long) statbuf.st_size);
+                   ctime(&statbuf.st_mtime), (long long) statbuf.st_size)) {
+                ret = INDEX_ERR_NOMEM;
+                goto out;
+            }
         } else {
 #endif
             if (html_escape_string(http_filename, escaped_filename,
                                    strlen(http_filename)) == NULL) {
-                send_error(4);
-                return -1;
+                ret = INDEX_ERR_ESCAPE;
+                goto out;
             }
-            printf("<tr>"
+            if (index_printf(out, "<tr>"
                    "<td width=\"40%%\"><a href=\"%s\">%s</a></td>"
                    "<td align=right>%s</td>"
-                   "<td align=right>%ld bytes</td>"
+                   "<td align=right>%lld bytes</td>"
                    "</tr>\n",
                    escaped_filename, html_filename,
-                   ctime(&statbuf.st_mtime), (long) statbuf.st_size);
+                   ctime(&statbuf.st_mtime), (long long) statbuf.st_size)) {
+                ret = INDEX_ERR_NOMEM;
+                goto out;
+            }
 #ifdef GUNZIP
         }
 #endif
     }
-    /* hey -- even though this is a one-shot deal, we should
-     * still free memory we ought to free
-     * You never know -- this code might get used elsewhere!
-     */
-    for (i = 0; i < numdir; ++i) {
-        free(array[i]);
-        array[i] = NULL;
-    }
-    free(array);
-    array = NULL;
-
-    return 0;                   /* success */
-}
-
-int main(int argc, char *argv[])
-{
-    time_t timep;
-    struct tm *timeptr;
-    char *now;
-
-    if (argc < 3) {
-        send_error(1);
-        return -1;
-    } else if (argc > 3) {
-        send_error(5);
-        return -1;
-    }
-
-    build_needs_escape();
-
-    if (argv[2] == NULL)
-        index_directory(argv[1], argv[1]);
-    else
-        index_directory(argv[1], argv[2]);
 
     time(&timep);
 #ifdef USE_LOCALTIME
@@ -375,17 +424,32 @@ int main(int argc, char *argv[])
 #else
     timeptr = gmtime(&timep);
 #endif
-    now = strdup(asctime(timeptr));
+    strncpy(now, asctime(timeptr), sizeof (now) - 1);
+    now[sizeof (now) - 1] = '\0';
     now[strlen(now) - 1] = '\0';
 #ifdef USE_LOCALTIME
-    printf("</table>\n<hr noshade>\nIndex generated %s %s\n"
+    if (index_printf(out, "</table>\n<hr noshade>\nIndex generated %s %s\n"
            "<!-- This program is part of the Boa Webserver Copyright (C) 1991-2002 http://www.boa.org -->\n"
-           "</body>\n</html>\n", now, TIMEZONE(timeptr));
+           "</body>\n</html>\n", now, TIMEZONE(timeptr)))
 #else
-    printf("</table>\n<hr noshade>\nIndex generated %s UTC\n"
+    if (index_printf(out, "</table>\n<hr noshade>\nIndex generated %s UTC\n"
            "<!-- This program is part of the Boa Webserver Copyright (C) 1991-2002 http://www.boa.org -->\n"
-           "</body>\n</html>\n", now);
+           "</body>\n</html>\n", now))
 #endif
+        ret = INDEX_ERR_NOMEM;
 
-    return 0;
+  out:
+    for (i = 0; i < numdir; ++i) {
+        free(array[i]);
+        array[i] = NULL;
+    }
+    free(array);
+    array = NULL;
+
+    if (ret && out->data) {
+        free(out->data);
+        out->data = NULL;
+        out->len = out->size = 0;
+    }
+    return ret;
 }
@@ -0,0 +1,51 @@
+/*
+ *  Boa, an http server
+ *  Copyright (C) 1997-2005 Jon Nelson <jnelson@boa.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 1, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/* $Id$ */
+
+#ifndef _INDEX_DIR_H
+#define _INDEX_DIR_H
+
+/* shared by boa_indexer and the in-process DirectoryMaker */
+
+/* index_directory return values, other than 0 for success */
+#define INDEX_ERR_ARGS          1
+#define INDEX_ERR_NOMEM         2
+#define INDEX_ERR_CHDIR         3
+#define INDEX_ERR_ESCAPE        4
+#define INDEX_ERR_TOO_MANY_ARGS 5
+#define INDEX_ERR_EMPTY         6
+
+struct index_buf {
+    char *data;                 /* malloced, NUL terminated */
+    unsigned int len;           /* bytes used, sans NUL */
+    unsigned int size;          /* bytes allocated */
+};
+
+char *html_escape_string(const char *inp, char *dest,
+                         const unsigned int len);
+char *http_escape_string(const char *inp, char *buf,
+                         const unsigned int len);
+int index_directory(const char *dir, const char *title,
+                    struct index_buf *out);
+int index_head(const char *title, struct index_buf *out);
+int index_rows(const char *dir, struct index_buf *out);
+
+#endif
@@ -0,0 +1,420 @@
+/*
+ *  Boa, an http server
+ *  Copyright (C) 1999-2005 Larry Doolittle <ldoolitt@boa.org>
+ *  Copyright (C) 2000-2005 Jon Nelson <jnelson@boa.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 1, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/* $Id$*/
+
+/*
+ * A small pool of threads for open/fstat/read calls which may block
+ * for a long time on cold or remote storage.
+ *
+ * A request hands its job to the pool and parks itself on the blocked
+ * list in the FILE_WAIT state, with no file descriptor to wait on.
+ * The io thread does the work and writes a byte down io_notify_fd;
+ * the main loop then calls io_pool_collect, which moves the request
+ * back to the ready list, where io_resume picks up where it left off.
+ *
+ * The io threads only ever touch the job and, for reads, the part of
+ * req->buffer they were given.  Everything else stays in the main
+ * thread.
+ */
+
+#include "boa.h"
+
+#ifdef USE_IO_THREADS
+#include <pthread.h>
+#include <signal.h>
+
+int io_notify_fd = -1;
+static int io_notify_write_fd = -1;
+
+static pthread_mutex_t io_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t io_wakeup = PTHREAD_COND_INITIALIZER;
+static struct io_job *io_pending_head = NULL, *io_pending_tail = NULL;
+static struct io_job *io_finished = NULL;
+
+static unsigned int io_threads_running = 0;
+static unsigned int io_queue_length = 0;
+static unsigned int io_queue_length_max = 0;
+
+static struct io_devstat {
+    dev_t dev;
+    unsigned long jobs;
+    unsigned long wait_usec;    /* time spent queued */
+    unsigned long service_usec; /* time spent in open/fstat/read */
+    unsigned long service_usec_max;
+} io_devstats[IO_DEVSTATS_SIZE];
+
+static void *io_thread(void *arg);
+static void io_submit(request * req);
+static void io_account(struct io_job *job);
+
+#define USEC_BETWEEN(a,b) \
+    ((unsigned long) (((b).tv_sec - (a).tv_sec) * 1000000L + \
+                      ((b).tv_usec - (a).tv_usec)))
+
+/*
+ * Name: io_pool_init
+ * Description: Starts io_threads threads.  Must be called after the
+ * server has forked into the background, since threads don't survive
+ * fork(2).  IOThreads is only looked at here, so changing it requires
+ * a restart rather than a SIGHUP.
+ */
+
+void io_pool_init(void)
+{
+    int fds[2];
+    unsigned int i;
+    sigset_t all, old;
+
+    if (io_threads == 0)
+        return;
+
+    if (pipe(fds) == -1)
+        DIE("unable to create io thread notification pipe");
+    if (set_nonblock_fd(fds[0]) == -1 || set_nonblock_fd(fds[1]) == -1)
+        DIE("fcntl: unable to set io notification pipe non-blocking");
+    if (fcntl(fds[0], F_SETFD, 1) == -1 || fcntl(fds[1], F_SETFD, 1) == -1)
+        DIE("fcntl: unable to set close-on-exec for io notification pipe");
+    io_notify_fd = fds[0];
+    io_notify_write_fd = fds[1];
+
+    /* signals (SIGBUS in particular) belong to the main thread */
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    for (i = 0; i < io_threads; ++i) {
+        pthread_t tid;
+
+        if (pthread_create(&tid, NULL, io_thread, NULL) != 0) {
+            log_error_time();
+            fprintf(stderr, "unable to start io thread %u of %u\n",
+                    i + 1, io_threads);
+            break;
+        }
+        pthread_detach(tid);
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    io_threads_running = i;
+    if (io_threads_running == 0) {
+        close(io_notify_fd);
+        close(io_notify_write_fd);
+        io_notify_fd = io_notify_write_fd = -1;
+    }
+}
+
+/*
+ * Name: io_thread
+ * Description: The body of each io thread.
+ */
+
+static void *io_thread(void *arg)
+{
+    struct io_job *job;
+    char c = 0;
+
+    while (1) {
+        pthread_mutex_lock(&io_lock);
+        while (io_pending_head == NULL)
+            pthread_cond_wait(&io_wakeup, &io_lock);
+        job = io_pending_head;
+        io_pending_head = job->next;
+        if (io_pending_head == NULL)
+            io_pending_tail = NULL;
+        io_queue_length--;
+        pthread_mutex_unlock(&io_lock);
+
+        gettimeofday(&job->started, NULL);
+        switch (job->type) {
+        case IO_OPEN:
+            job->fd = doc_openat(job->dirfd, job->rel, job->req->pathname);
+            job->error = errno;
+            if (job->dirfd >= 0)
+                close(job->dirfd);
+            if (job->fd != -1) {
+                if (fstat(job->fd, &job->statbuf) == -1) {
+                    job->error = errno;
+                    close(job->fd);
+                    job->fd = -1;
+                } else
+                    job->dev = job->statbuf.st_dev;
+            }
+            break;
+        case IO_READ:
+            do {
+                job->result = pread(job->fd, job->buf, job->len,
+                                    job->offset);
+            } while (job->result == -1 && errno == EINTR);
+            job->error = errno;
+            break;
+        }
+        gettimeofday(&job->finished, NULL);
+
+        pthread_mutex_lock(&io_lock);
+        job->state = IO_DONE;
+        job->next = io_finished;
+        io_finished = job;
+        pthread_mutex_unlock(&io_lock);
+
+        /* if the pipe is full, the main thread is already on its way */
+        write(io_notify_write_fd, &c, 1);
+    }
+    return arg;
+}
+
+static void io_submit(request * req)
+{
+    struct io_job *job = req->io_job;
+
+    job->req = req;
+    job->state = IO_QUEUED;
+    job->next = NULL;
+    gettimeofday(&job->queued, NULL);
+
+    pthread_mutex_lock(&io_lock);
+    if (io_pending_tail)
+        io_pending_tail->next = job;
+    else
+        io_pending_head = job;
+    io_pending_tail = job;
+    if (++io_queue_length > io_queue_length_max)
+        io_queue_length_max = io_queue_length;
+    pthread_cond_signal(&io_wakeup);
+    pthread_mutex_unlock(&io_lock);
+
+    req->status = FILE_WAIT;
+}
+
+static struct io_job *io_job_get(request * req)
+{
+    if (req->io_job == NULL) {
+        req->io_job = malloc(sizeof (struct io_job));
+        if (req->io_job == NULL)
+            return NULL;
+        memset(req->io_job, 0, sizeof (struct io_job));
+    }
+    return req->io_job;
+}
+
+/*
+ * Name: io_submit_open
+ * Description: Hands doc_open(req->pathname) and fstat to an io thread.
+ * When it is done, init_get is called again, and picks up the result
+ * with io_open_result.
+ *
+ * Return values: -1 (the request is parked), 0 on error
+ */
+
+int io_submit_open(request * req)
+{
+    struct io_job *job = io_job_get(req);
+
+    if (job == NULL) {
+        boa_perror(req, "malloc for io_job");
+        return 0;
+    }
+    job->type = IO_OPEN;
+    job->dirfd = doc_root_fd(req, req->pathname, &job->rel);
+    /* the root's fd may be closed before the job runs, and its number
+     * reused: the job gets one of its own, which the io thread closes */
+    if (job->dirfd >= 0) {
+        job->dirfd = fcntl(job->dirfd, F_DUPFD_CLOEXEC, 0);
+        if (job->dirfd == -1 && resolve_beneath)
+            job->dirfd = ROOT_FD_NONE;
+    }
+    io_submit(req);
+    return -1;
+}
+
+/*
+ * Name: io_submit_read
+ * Description: Hands pread(data_fd, buf, len, offset) to an io thread.
+ * When it is done, io_shuffle is called again, and picks up the
+ * result with io_read_result.  The response is already under way, so
+ * errors are left to the caller to log.
+ *
+ * Return values: -1 (the request is parked), 0 on error (errno set)
+ */
+
+int io_submit_read(request * req, char *buf, size_t len, off_t offset)
+{
+    struct io_job *job = io_job_get(req);
+
+    if (job == NULL) {
+        errno = ENOMEM;
+        return 0;
+    }
+    job->type = IO_READ;
+    job->fd = req->data_fd;
+    job->buf = buf;
+    job->len = len;
+    job->offset = offset;
+    io_submit(req);
+    return -1;
+}
+
+/*
+ * Name: io_open_result
+ * Description: If an open job for req has finished, hands over the
+ * descriptor (sets errno, and fills in statbuf).
+ *
+ * Return values: 1 if there was a finished open job, 0 otherwise
+ */
+
+int io_open_result(request * req, int *fd, struct stat *statbuf)
+{
+    struct io_job *job = req->io_job;
+
+    if (job == NULL || job->state != IO_DONE || job->type != IO_OPEN)
+        return 0;
+
+    job->state = IO_IDLE;
+    *fd = job->fd;
+    if (job->fd != -1)
+        memcpy(statbuf, &job->statbuf, sizeof (struct stat));
+    errno = job->error;
+    return 1;
+}
+
+/*
+ * Name: io_read_result
+ * Description: As io_open_result, for read jobs.
+ */
+
+int io_read_result(request * req, int *bytes_read)
+{
+    struct io_job *job = req->io_job;
+
+    if (job == NULL || job->state != IO_DONE || job->type != IO_READ)
+        return 0;
+
+    job->state = IO_IDLE;
+    *bytes_read = job->result;
+    errno = job->error;
+    return 1;
+}
+
+/*
+ * Name: io_resume
+ * Description: Called by process_requests for a request coming back
+ * from an io thread.  Restores the state it was parked in, and calls
+ * the function that parked it.
+ */
+
+int io_resume(request * req)
+{
+    if (req->io_job == NULL) {
+        req->status = DEAD;
+        return 0;
+    }
+    switch (req->io_job->type) {
+    case IO_OPEN:
+        req->status = WRITE;
+        return init_get(req);
+    case IO_READ:
+        req->status = IOSHUFFLE;
+        return io_shuffle(req);
+    }
+    return 0;
+}
+
+/*
+ * Name: io_pool_collect
+ * Description: Called from the main loop when io_notify_fd is
+ * readable.  Moves every request whose job has finished back to the
+ * ready list.
+ */
+
+void io_pool_collect(void)
+{
+    char buf[64];
+    struct io_job *job, *next;
+
+    while (read(io_notify_fd, buf, sizeof (buf)) > 0);
+
+    pthread_mutex_lock(&io_lock);
+    job = io_finished;
+    io_finished = NULL;
+    pthread_mutex_unlock(&io_lock);
+
+    for (; job; job = next) {
+        next = job->next;
+        io_account(job);
+        job->req->time_last = current_time;
+        ready_request(job->req);
+    }
+}
+
+/*
+ * Name: io_job_free
+ * Description: Called from free_request.  A request is never freed
+ * while it is parked, so the job is ours to free.
+ */
+
+void io_job_free(request * req)
+{
+    if (req->io_job) {
+        free(req->io_job);
+        req->io_job = NULL;
+    }
+}
+
+static void io_account(struct io_job *job)
+{
+    int i;
+    unsigned long service;
+
+    for (i = 0; i < IO_DEVSTATS_SIZE; ++i) {
+        if (io_devstats[i].jobs == 0 || io_devstats[i].dev == job->dev)
+            break;
+    }
+    if (i == IO_DEVSTATS_SIZE)
+        return;                 /* too many devices; not tracked */
+
+    service = USEC_BETWEEN(job->started, job->finished);
+    io_devstats[i].dev = job->dev;
+    io_devstats[i].jobs++;
+    io_devstats[i].wait_usec += USEC_BETWEEN(job->queued, job->started);
+    io_devstats[i].service_usec += service;
+    if (service > io_devstats[i].service_usec_max)
+        io_devstats[i].service_usec_max = service;
+}
+
+void io_pool_show_stats(void)
+{
+    int i;
+
+    if (io_threads_running == 0)
+        return;
+
+    log_error_time();
+    fprintf(stderr, "io threads: %u, queued now: %u, max queued: %u\n",
+            io_threads_running, io_queue_length, io_queue_length_max);
+    for (i = 0; i < IO_DEVSTATS_SIZE && io_devstats[i].jobs; ++i) {
+        log_error_time();
+        fprintf(stderr, "io device 0x%lx: %lu jobs, avg wait %lu us, "
+                "avg service %lu us, max service %lu us\n",
+                (unsigned long) io_devstats[i].dev, io_devstats[i].jobs,
+                io_devstats[i].wait_usec / io_devstats[i].jobs,
+                io_devstats[i].service_usec / io_devstats[i].jobs,
+                io_devstats[i].service_usec_max);
+    }
+}
+#endif                          /* USE_IO_THREADS */
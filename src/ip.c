@@ -46,15 +46,28 @@ globals.h:
 #include "boa.h"
 #include <arpa/inet.h>          /* inet_ntoa */
 
-/* Binds to the existing server_s, based on the configuration string
-   in server_ip.  IPv6 version doesn't pay attention to server_ip yet.  */
+/* Binds the server socket sock, based on the configuration string
+   ip (from a Listen line), or to any address if it is NULL.  The IPv6
+   version takes an IPv4 address as an IPv4-mapped one.  */
 int bind_server(int sock, char *ip, unsigned int port)
 {
 #ifdef INET6
     struct sockaddr_in6 server_sockaddr;
+    memset(&server_sockaddr, 0, sizeof server_sockaddr);
     server_sockaddr.sin6_family = PF_INET6;
-    memcpy(&server_sockaddr.sin6_addr, &in6addr_any, sizeof (in6addr_any));
-    server_sockaddr.sin6_port = htons(server_port);
+    if (ip == NULL) {
+        memcpy(&server_sockaddr.sin6_addr, &in6addr_any,
+               sizeof (in6addr_any));
+    } else if (inet_pton(AF_INET6, ip, &server_sockaddr.sin6_addr) != 1) {
+        char mapped[BOA_NI_MAXHOST];
+
+        snprintf(mapped, sizeof (mapped), "::ffff:%s", ip);
+        if (inet_pton(AF_INET6, mapped, &server_sockaddr.sin6_addr) != 1) {
+            errno = EINVAL;
+            return -1;
+        }
+    }
+    server_sockaddr.sin6_port = htons(port);
 #else
     struct sockaddr_in server_sockaddr;
     memset(&server_sockaddr, 0, sizeof server_sockaddr);
@@ -82,6 +95,13 @@ int bind_server(int sock, char *ip, unsigned int port)
 
 char *ascii_sockaddr(struct SOCKADDR *s, char *dest, unsigned int len)
 {
+    /* a Unix domain socket's peer is on this machine */
+    if (((struct sockaddr *) s)->sa_family == AF_UNIX) {
+        if (len < sizeof ("127.0.0.1"))
+            return NULL;
+        strcpy(dest, "127.0.0.1");
+        return dest;
+    }
 #ifdef INET6
     if (getnameinfo((struct sockaddr *) s,
                     sizeof (struct SOCKADDR),
@@ -125,6 +145,8 @@ int net_port(struct SOCKADDR *s)
 #ifdef INET6
     char serv[NI_MAXSERV];
 
+    if (((struct sockaddr *) s)->sa_family == AF_UNIX)
+        return 0;
     if (getnameinfo((struct sockaddr *) s,
                     sizeof (struct SOCKADDR),
                     NULL, 0, serv, sizeof (serv), NI_NUMERICSERV)) {
@@ -133,6 +155,8 @@ int net_port(struct SOCKADDR *s)
         p = atoi(serv);
     }
 #else
+    if (s->sin_family == AF_UNIX)
+        return 0;
     p = ntohs(s->sin_port);
 #endif
     return p;
@@ -0,0 +1,250 @@
+/*
+ *  Boa, an http server
+ *  Copyright (C) 1999-2005 Larry Doolittle <ldoolitt@boa.org>
+ *  Copyright (C) 2000-2005 Jon Nelson <jnelson@boa.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 1, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/* $Id$*/
+
+/*
+ * The sockets Boa takes connections on (Listen).
+ *
+ * Each Listen line adds one: an address to listen on at Port, or
+ * "unix:" and the path of a Unix domain socket.  A front end on the
+ * same machine can hand requests over the latter without going
+ * through TCP.  With no Listen line, Boa listens on Port for any
+ * address, as it always has.  The sockets are opened once, as root;
+ * a restart leaves them as they are.
+ *
+ * Connections to a Unix domain socket come from this machine, and
+ * are logged, and shown to CGIs, as from 127.0.0.1.  A Listen line's
+ * "proxy" option has each connection begin with a PROXY line (version
+ * 1 of the PROXY protocol, which HAProxy and nginx send), from which
+ * the client's address and port, and the address it connected to,
+ * are taken instead of the front end's.
+ */
+
+#include "boa.h"
+#include <sys/un.h>
+#include <arpa/inet.h>
+
+struct listener *listeners = NULL;
+
+static int sock_opt = 1;
+
+/*
+ * Name: listen_add
+ * Description: For a Listen line.  address is NULL for any address.
+ */
+
+void listen_add(const char *address, const char *option)
+{
+    struct listener *l, **end;
+    struct sockaddr_un sa;
+
+    /* a restart keeps the sockets which are open */
+    if (listeners != NULL && listeners->fd != -1)
+        return;
+
+    if (option != NULL && strcmp(option, "proxy")) {
+        log_error_time();
+        fprintf(stderr, "Listen %s: unknown option \"%s\"\n", address,
+                option);
+        exit(EXIT_FAILURE);
+    }
+
+    l = malloc(sizeof (struct listener));
+    if (l == NULL)
+        DIE("out of memory adding Listen");
+    l->fd = -1;
+    l->pending = 0;
+    l->proxy_protocol = (option != NULL);
+    l->ip = l->path = NULL;
+    if (address != NULL && !strncmp(address, "unix:", 5)) {
+        address += 5;
+        if (*address == '\0' || strlen(address) >= sizeof (sa.sun_path)) {
+            log_error_time();
+            fprintf(stderr, "Listen unix:%s: bad socket path\n", address);
+            exit(EXIT_FAILURE);
+        }
+        l->path = strdup(address);
+        if (l->path == NULL)
+            DIE("out of memory adding Listen");
+    } else if (address != NULL) {
+        l->ip = strdup(address);
+        if (l->ip == NULL)
+            DIE("out of memory adding Listen");
+    }
+
+    l->next = NULL;
+    for (end = &listeners; *end != NULL; end = &(*end)->next)
+        ;
+    *end = l;
+}
+
+/*
+ * Name: bind_unix
+ * Description: Binds sock to a Unix domain socket at path, in place of
+ * one left there by an earlier run.  Anyone may connect to it: who
+ * can get at it is up to the permissions of the directory it is in.
+ */
+
+static int bind_unix(int sock, const char *path)
+{
+    struct sockaddr_un sa;
+    struct stat statbuf;
+
+    if (lstat(path, &statbuf) == 0 && S_ISSOCK(statbuf.st_mode))
+        unlink(path);
+
+    memset(&sa, 0, sizeof (sa));
+    sa.sun_family = AF_UNIX;
+    strcpy(sa.sun_path, path);  /* its length was checked by listen_add */
+    if (bind(sock, (struct sockaddr *) &sa, sizeof (sa)) == -1)
+        return -1;
+    /* umask(077) in main left it to root alone */
+    return chmod(path, 0666);
+}
+
+/*
+ * Name: listen_open
+ * Description: Opens the sockets of the Listen lines (or the one for
+ * any address, if there were none).
+ */
+
+void listen_open(void)
+{
+    struct listener *l;
+
+    if (listeners == NULL)
+        listen_add(NULL, NULL);
+
+    for (l = listeners; l != NULL; l = l->next) {
+        if (l->path != NULL)
+            l->fd = socket(PF_UNIX, SOCK_STREAM, 0);
+        else
+            l->fd = socket(SERVER_PF, SOCK_STREAM, IPPROTO_TCP);
+        if (l->fd == -1) {
+            DIE("unable to create socket");
+        }
+
+        /* server socket is nonblocking */
+        if (set_nonblock_fd(l->fd) == -1) {
+            DIE("fcntl: unable to set server socket to nonblocking");
+        }
+
+        /* close server socket on exec so CGIs can't write to it */
+        if (fcntl(l->fd, F_SETFD, 1) == -1) {
+            DIE("can't set close-on-exec on server socket!");
+        }
+
+        if (l->path != NULL) {
+            if (bind_unix(l->fd, l->path) == -1) {
+                log_error_time();
+                fprintf(stderr, "unix:%s: ", l->path);
+                DIE("unable to bind");
+            }
+        } else {
+            /* reuse socket addr */
+            if ((setsockopt(l->fd, SOL_SOCKET, SO_REUSEADDR,
+                            (void *) &sock_opt, sizeof (sock_opt))) == -1) {
+                DIE("setsockopt");
+            }
+
+            /* Internet family-specific code encapsulated in bind_server()  */
+            if (bind_server(l->fd, l->ip, server_port) == -1) {
+                DIE("unable to bind");
+            }
+        }
+
+        /* listen: large number just in case your kernel is nicely tweaked */
+        if (listen(l->fd, backlog) == -1) {
+            DIE("unable to listen");
+        }
+    }
+}
+
+/*
+ * Name: listen_close
+ * Description: Closes the sockets, on a SIGTERM.
+ */
+
+void listen_close(void)
+{
+    struct listener *l;
+
+    for (l = listeners; l != NULL; l = l->next) {
+        if (l->fd != -1) {
+            close(l->fd);
+            l->fd = -1;
+        }
+        l->pending = 0;
+    }
+}
+
+/*
+ * Name: listen_proxy_line
+ * Description: Called by read_header with the first line from a
+ * connection to a "proxy" Listen socket, which must be a PROXY line:
+ *   PROXY TCP4 <client> <server> <client port> <server port>
+ * or TCP6 for IPv6, or UNKNOWN for a connection the front end made
+ * itself, which keeps the addresses it has.
+ *
+ * Return values: 0 if it isn't one (and a bad request has been sent);
+ * else 1
+ */
+
+int listen_proxy_line(request * req)
+{
+    char proto[5], client[INET6_ADDRSTRLEN], dest[INET6_ADDRSTRLEN];
+    unsigned int client_port, dest_port;
+    unsigned char addr[sizeof (struct in6_addr)];
+    int family;
+
+    req->proxy_protocol = 0;
+    if (!strcmp(req->header_line, "PROXY UNKNOWN") ||
+        !strncmp(req->header_line, "PROXY UNKNOWN ", 14))
+        return 1;
+
+    if (sscanf(req->header_line, "PROXY %4s %45s %45s %u %u",
+               proto, client, dest, &client_port, &dest_port) != 5)
+        goto bad;
+    if (!strcmp(proto, "TCP4"))
+        family = AF_INET;
+    else if (!strcmp(proto, "TCP6"))
+        family = AF_INET6;
+    else
+        goto bad;
+    if (inet_pton(family, client, addr) != 1 ||
+        inet_pton(family, dest, addr) != 1 ||
+        client_port > 65535 || dest_port > 65535 ||
+        strlen(client) >= sizeof (req->remote_ip_addr) ||
+        strlen(dest) >= sizeof (req->local_ip_addr))
+        goto bad;
+
+    strcpy(req->remote_ip_addr, client);
+    strcpy(req->local_ip_addr, dest);
+    req->remote_port = client_port;
+    return 1;
+
+  bad:
+    log_error_doc(req);
+    fprintf(stderr, "Bad PROXY line: \"%s\"\n", req->header_line);
+    send_r_bad_request(req);
+    return 0;
+}
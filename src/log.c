@@ -146,12 +146,12 @@ void log_access(request * req)
     } else if (vhost_root) {
         printf("%s ", (req->host ? req->host : "(null)"));
     }
-    printf("%s - - %s\"%s\" %d %ld \"%s\" \"%s\"\n",
+    printf("%s - - %s\"%s\" %d %lld \"%s\" \"%s\"\n",
            req->remote_ip_addr,
            get_commonlog_time(),
            req->logline ? req->logline : "-",
            req->response_status,
-           req->bytes_written,
+           (long long) req->bytes_written,
            (req->header_referer ? req->header_referer : "-"),
            (req->header_user_agent ? req->header_user_agent : "-"));
 }
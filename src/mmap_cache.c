@@ -33,52 +33,79 @@ static int mmap_list_hash_bounces = 0;
 /* define local table variable */
 static struct mmap_entry mmap_list[MMAP_LIST_SIZE];
 
+/* bytes currently mlock()ed, against MmapLockSize */
+static unsigned long mmap_locked_bytes = 0;
+
+static void mmap_prepare(struct mmap_entry *e);
+static void mmap_drop(struct mmap_entry *e);
+static int mmap_evict(int start);
+
 struct mmap_entry *find_mmap(int data_fd, struct stat *s)
 {
     void *m;
-    int i, start;
+    int i, start, flags, hole = -1;
     mmap_list_total_requests++;
     i = start = MMAP_LIST_HASH(s->st_dev, s->st_ino, s->st_size);
-    for (; mmap_list[i].use_count;) {
-        if (mmap_list[i].dev == s->st_dev &&
-            mmap_list[i].ino == s->st_ino &&
-            mmap_list[i].len == s->st_size) {
-            mmap_list[i].use_count++;
-            DEBUG(DEBUG_MMAP_CACHE) {
-                fprintf(stderr,
-                        "Old mmap_list entry %d use_count now %d (hash was %d)\n",
-                        i, mmap_list[i].use_count, start);
+    do {
+        if (!mmap_list[i].mmap) {
+            if (hole == -1)
+                hole = i;
+            /* release_mmap leaves holes in front of pinned entries,
+             * so with any entry locked the whole table is searched */
+            if (!mmap_locked_bytes)
+                break;
+        } else if (mmap_list[i].dev == s->st_dev &&
+                   mmap_list[i].ino == s->st_ino) {
+            if (mmap_list[i].len == s->st_size &&
+                mmap_list[i].mtime == s->st_mtime) {
+                mmap_list[i].use_count++;
+                DEBUG(DEBUG_MMAP_CACHE) {
+                    fprintf(stderr,
+                            "Old mmap_list entry %d use_count now %d (hash was %d)\n",
+                            i, mmap_list[i].use_count, start);
+                }
+                return mmap_list + i;
+            }
+            if (mmap_list[i].use_count == 0) {
+                /* a pinned mapping of an older version of the file */
+                mmap_drop(mmap_list + i);
+                if (hole == -1)
+                    hole = i;
             }
-            return mmap_list + i;
         }
         mmap_list_hash_bounces++;
         i = MMAP_LIST_NEXT(i);
-        if (i == start) {
-            /* didn't find an entry that matches our dev/inode/size.
-             There might be an entry that matches later in the table,
-             but that _should_ be rare.  The worst case is that we
-             needlessly mmap() a file that is already mmap'd, but we
-             did that all the time before this code was written,
-             so it shouldn't be _too_ bad.
-             */
-            /* we've looped, and found neither a free one nor a
-             * match. Thus, there is no room for a new entry.
-             */
+    } while (i != start);
+
+    if (hole == -1) {
+        /* we've looped, and found neither a free one nor a
+         * match. Thus, there is no room for a new entry,
+         * unless a pinned entry nobody is using can go.
+         */
+        hole = mmap_evict(start);
+        if (hole == -1) {
 /*        WARN("mmap hash table is full. Consider enlarging."); */
             return NULL;
         }
     }
+    i = hole;
 
     /* Enforce a size limit here */
     /* Disallow more entries than MMAP_LIST_USE_MAX, despite
      * having found an available slot.
      */
-    if (mmap_list_entries_used > MMAP_LIST_USE_MAX) {
+    if (mmap_list_entries_used > MMAP_LIST_USE_MAX &&
+        mmap_evict(start) == -1) {
 /*        WARN("Too many entries in mmap hash table."); */
         return NULL;
     }
 
-    m = mmap(0, s->st_size, PROT_READ, MAP_OPTIONS, data_fd, 0);
+    flags = MAP_OPTIONS;
+#ifdef MAP_POPULATE
+    if (mmap_populate)
+        flags |= MAP_POPULATE;  /* fault it all in now, not in process_get */
+#endif
+    m = mmap(0, s->st_size, PROT_READ, flags, data_fd, 0);
 
     if ((long) m == -1) {
         int saved_errno = errno;
@@ -113,11 +140,87 @@ struct mmap_entry *find_mmap(int data_fd, struct stat *s)
     mmap_list[i].dev = s->st_dev;
     mmap_list[i].ino = s->st_ino;
     mmap_list[i].len = s->st_size;
+    mmap_list[i].mtime = s->st_mtime;
     mmap_list[i].mmap = m;
     mmap_list[i].use_count = 1;
+    mmap_list[i].locked = 0;
+    mmap_prepare(mmap_list + i);
     return mmap_list + i;
 }
 
+/*
+ * Name: mmap_prepare
+ * Description: Applies MmapPopulate, MmapHugePages and MmapLockSize
+ * to a new mapping.  None of them is fatal if the kernel says no.
+ */
+
+static void mmap_prepare(struct mmap_entry *e)
+{
+    static int mlock_warned = 0;
+
+#if defined(HAVE_MADVISE) && !defined(MAP_POPULATE) && defined(MADV_WILLNEED)
+    if (mmap_populate)
+        madvise(e->mmap, e->len, MADV_WILLNEED);
+#endif
+#if defined(HAVE_MADVISE) && defined(MADV_HUGEPAGE)
+    if (mmap_hugepages && e->len >= HUGEPAGE_SIZE)
+        madvise(e->mmap, e->len, MADV_HUGEPAGE);
+#endif
+
+    if (mmap_lock_size &&
+        mmap_locked_bytes + e->len <= mmap_lock_size) {
+        if (mlock(e->mmap, e->len) == 0) {
+            e->locked = 1;
+            mmap_locked_bytes += e->len;
+        } else if (!mlock_warned) {
+            /* most likely RLIMIT_MEMLOCK; say so once */
+            mlock_warned = 1;
+            log_error_time();
+            perror("mlock (MmapLockSize)");
+        }
+    }
+}
+
+/*
+ * Name: mmap_drop
+ * Description: Unmaps an entry which nobody is using, and frees
+ * its slot.
+ */
+
+static void mmap_drop(struct mmap_entry *e)
+{
+    if (e->locked) {
+        munlock(e->mmap, e->len);
+        mmap_locked_bytes -= e->len;
+        e->locked = 0;
+    }
+    munmap(e->mmap, e->len);
+    e->mmap = NULL;
+    mmap_list_entries_used--;
+}
+
+/*
+ * Name: mmap_evict
+ * Description: Drops the first pinned entry nobody is using, looking
+ * from start onwards.
+ *
+ * Return values: the freed slot, or -1 if there was none
+ */
+
+static int mmap_evict(int start)
+{
+    int i = start;
+
+    do {
+        if (mmap_list[i].mmap && mmap_list[i].use_count == 0) {
+            mmap_drop(mmap_list + i);
+            return i;
+        }
+        i = MMAP_LIST_NEXT(i);
+    } while (i != start);
+    return -1;
+}
+
 void release_mmap(struct mmap_entry *e)
 {
     if (!e)
@@ -129,8 +232,10 @@ void release_mmap(struct mmap_entry *e)
         return;
     }
     if (!--(e->use_count)) {
-        munmap(e->mmap, e->len);
-        mmap_list_entries_used--;
+        /* locked entries are the pinned working set: keep them
+         * mapped for the next request */
+        if (!e->locked)
+            mmap_drop(e);
     }
 }
 
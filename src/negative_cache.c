@@ -0,0 +1,300 @@
+/*
+ *  Boa, an http server
+ *  Copyright (C) 1999-2005 Larry Doolittle <ldoolitt@boa.org>
+ *  Copyright (C) 2000-2005 Jon Nelson <jnelson@boa.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 1, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/* $Id$*/
+
+/*
+ * Negative lookup cache (NegativeCache).
+ * Translated pathnames which open(2) reported as ENOENT -- documents,
+ * and index.html or .gz probes -- are remembered in a small
+ * direct-mapped table, so repeated misses cost no filesystem calls.
+ *
+ * An entry is only good while nothing can have appeared at its path.
+ * Each one watches the nearest existing ancestor directory of the
+ * path with inotify, and is dropped as soon as anything is created in
+ * or moved into that directory, or the directory itself goes away.
+ * Without inotify (or when out of watches), the ancestor's mtime is
+ * checked on every hit instead, which is still one stat(2) in place
+ * of one or two failed opens.
+ *
+ * A watch sees nothing of what happens above its directory: the
+ * document root being renamed away, or a symlink above it switched
+ * to a new tree, as deploys do.  So the ancestor's path is also
+ * stat()ed at most once a second, and the entry dropped if it no
+ * longer leads to the same directory.
+ */
+
+#include "boa.h"
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#define NEGATIVE_EVENTS (IN_CREATE | IN_MOVED_TO | IN_DELETE_SELF | \
+                         IN_MOVE_SELF | IN_ONLYDIR)
+#endif
+
+struct negative_entry {
+    char *path;                 /* malloced, NULL if the slot is free */
+    unsigned int hash;
+    unsigned int dirlen;        /* path[0..dirlen) is the ancestor */
+    int wd;                     /* inotify watch on it, or -1 */
+    time_t dir_mtime;           /* its mtime, when there is no watch */
+    dev_t dev;                  /* which directory it is */
+    ino_t ino;
+    time_t checked;             /* when that was last looked at */
+};
+
+static struct negative_entry negative_list[NEGATIVE_CACHE_SIZE];
+
+int negative_notify_fd = -1;
+
+static unsigned long negative_hits = 0, negative_misses = 0;
+
+static unsigned int negative_hash(const char *str)
+{
+    unsigned int hash = 2166136261U;
+
+    while (*str) {
+        hash ^= (unsigned char) *str++;
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
+static void negative_drop(struct negative_entry *e)
+{
+#ifdef __linux__
+    if (e->wd != -1) {
+        int i, wd = e->wd;
+
+        e->wd = -1;
+        for (i = 0; i < NEGATIVE_CACHE_SIZE; ++i) {
+            if (negative_list[i].path && negative_list[i].wd == wd)
+                break;
+        }
+        if (i == NEGATIVE_CACHE_SIZE)
+            inotify_rm_watch(negative_notify_fd, wd); /* last user */
+    }
+#endif
+    free(e->path);
+    e->path = NULL;
+}
+
+/*
+ * Name: negative_cache_init
+ * Description: Sets up the inotify descriptor, if negative caching
+ * is on and inotify is available.  Called at startup; the cache is
+ * simply left empty otherwise.
+ */
+
+void negative_cache_init(void)
+{
+    int i;
+
+    for (i = 0; i < NEGATIVE_CACHE_SIZE; ++i)
+        negative_list[i].wd = -1;
+
+    if (!negative_cache)
+        return;
+#ifdef __linux__
+    negative_notify_fd = inotify_init();
+    if (negative_notify_fd == -1) {
+        log_error_time();
+        perror("inotify_init (NegativeCache will stat directories)");
+        return;
+    }
+    if (set_nonblock_fd(negative_notify_fd) == -1 ||
+        fcntl(negative_notify_fd, F_SETFD, 1) == -1) {
+        close(negative_notify_fd);
+        negative_notify_fd = -1;
+    }
+#endif
+}
+
+/*
+ * Name: negative_lookup
+ * Description: Is path known not to exist?
+ *
+ * Return values: 1 if so, 0 if it might exist
+ */
+
+int negative_lookup(const char *path)
+{
+    unsigned int hash;
+    struct negative_entry *e;
+
+    if (!negative_cache)
+        return 0;
+
+    hash = negative_hash(path);
+    e = negative_list + (hash & NEGATIVE_CACHE_MASK);
+    if (e->path == NULL || e->hash != hash || strcmp(e->path, path)) {
+        negative_misses++;
+        return 0;
+    }
+
+    if (e->wd == -1 || e->checked != current_time) {
+        struct stat statbuf;
+        char c = e->path[e->dirlen];
+        int ret;
+
+        e->path[e->dirlen] = '\0';
+        ret = stat(e->path, &statbuf);
+        e->path[e->dirlen] = c;
+        if (ret == -1 || statbuf.st_dev != e->dev ||
+            statbuf.st_ino != e->ino ||
+            (e->wd == -1 && statbuf.st_mtime != e->dir_mtime)) {
+            negative_drop(e);
+            negative_misses++;
+            return 0;
+        }
+        e->checked = current_time;
+    }
+    negative_hits++;
+    return 1;
+}
+
+/*
+ * Name: negative_add
+ * Description: Remembers that path doesn't exist (open(2) just said
+ * ENOENT).  Finds the nearest ancestor directory which does, to watch.
+ */
+
+void negative_add(const char *path)
+{
+    unsigned int hash;
+    struct negative_entry *e;
+    struct stat statbuf;
+    char *copy, *slash;
+
+    if (!negative_cache)
+        return;
+
+    hash = negative_hash(path);
+    e = negative_list + (hash & NEGATIVE_CACHE_MASK);
+    if (e->path && e->hash == hash && !strcmp(e->path, path))
+        return;                 /* already here */
+
+    if (e->path)
+        negative_drop(e);       /* direct-mapped: the newcomer wins */
+
+    copy = strdup(path);
+    if (copy == NULL)
+        return;
+
+    /* walk up to an ancestor that exists */
+    while ((slash = strrchr(copy, '/')) != NULL && slash != copy) {
+        *slash = '\0';
+        if (stat(copy, &statbuf) == 0) {
+            if (!S_ISDIR(statbuf.st_mode))
+                break;
+            e->wd = -1;
+            e->dir_mtime = statbuf.st_mtime;
+            e->dev = statbuf.st_dev;
+            e->ino = statbuf.st_ino;
+            e->checked = current_time;
+#ifdef __linux__
+            /* else (out of watches, say) the mtime is checked instead */
+            if (negative_notify_fd != -1)
+                e->wd = inotify_add_watch(negative_notify_fd, copy,
+                                          NEGATIVE_EVENTS);
+#endif
+            goto found;
+        }
+        if (errno != ENOENT)
+            break;
+    }
+    free(copy);
+    return;
+
+  found:
+    e->dirlen = strlen(copy);
+    strcpy(copy, path);         /* same length as path: it fits */
+    e->path = copy;
+    e->hash = hash;
+}
+
+/*
+ * Name: negative_open
+ * Description: doc_open(req, path), unless path is known not to
+ * exist.  A fresh ENOENT is remembered.
+ */
+
+int negative_open(request * req, const char *path)
+{
+    int fd;
+
+    if (negative_lookup(path)) {
+        errno = ENOENT;
+        return -1;
+    }
+    fd = doc_open(req, path);
+    if (fd == -1 && errno == ENOENT) {
+        negative_add(path);
+        errno = ENOENT;
+    }
+    return fd;
+}
+
+/*
+ * Name: negative_collect
+ * Description: Called from the main loop when negative_notify_fd is
+ * readable.  Drops every entry watching a directory which changed.
+ */
+
+void negative_collect(void)
+{
+#ifdef __linux__
+    char buf[4096]
+        __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    int len, i;
+
+    while ((len = read(negative_notify_fd, buf, sizeof (buf))) > 0) {
+        char *p;
+
+        for (p = buf; p < buf + len;) {
+            struct inotify_event *ev = (struct inotify_event *) p;
+
+            for (i = 0; i < NEGATIVE_CACHE_SIZE; ++i) {
+                struct negative_entry *e = negative_list + i;
+
+                if (e->path == NULL)
+                    continue;
+                /* on overflow we can't tell what changed */
+                if (ev->mask & IN_Q_OVERFLOW || e->wd == ev->wd) {
+                    if (ev->mask & IN_IGNORED)
+                        e->wd = -1; /* the kernel already removed it */
+                    negative_drop(e);
+                }
+            }
+            p += sizeof (struct inotify_event) + ev->len;
+        }
+    }
+#endif
+}
+
+void negative_show_stats(void)
+{
+    if (!negative_cache)
+        return;
+    log_error_time();
+    fprintf(stderr, "negative cache: %lu hits, %lu misses\n",
+            negative_hits, negative_misses);
+}
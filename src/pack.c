@@ -0,0 +1,208 @@
+/*
+ *  Boa, an http server
+ *  Copyright (C) 1999-2005 Larry Doolittle <ldoolitt@boa.org>
+ *  Copyright (C) 2000-2005 Jon Nelson <jnelson@boa.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 1, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/* $Id$*/
+
+/*
+ * DocumentPack: a whole document tree in one immutable file, made by
+ * boa_mkpack.  It is mapped once at startup and checked then, so a
+ * request for something in it costs a hash lookup: no open, no stat,
+ * no get_mime_type, and the data is written straight from the map.
+ *
+ * A pack may also be linked into the binary (boa_mkpack -c), for
+ * devices without a writable filesystem; it is used when there is no
+ * DocumentPack line.
+ */
+
+#include "boa.h"
+#include "pack.h"
+
+static const char *pack_base = NULL;
+static uint64_t pack_size = 0;
+static const uint32_t *pack_buckets;
+static const struct pack_entry *pack_entries;
+static uint32_t pack_mask;
+
+#ifdef __GNUC__
+extern const unsigned char boa_builtin_pack[] __attribute__ ((weak));
+extern const unsigned long boa_builtin_pack_size __attribute__ ((weak));
+#endif
+
+static int pack_string_ok(uint64_t off)
+{
+    return off < pack_size &&
+        memchr(pack_base + off, '\0', pack_size - off) != NULL;
+}
+
+/*
+ * Name: pack_check
+ * Description: Makes sure nothing in the pack points outside it, so
+ * that lookups need not.
+ *
+ * Return values: NULL if it is fine, else what is wrong
+ */
+
+static const char *pack_check(void)
+{
+    const struct pack_header *h = (const struct pack_header *) pack_base;
+    uint64_t tables;
+    uint32_t i;
+
+    if (pack_size < sizeof (struct pack_header) ||
+        memcmp(h->magic, PACK_MAGIC, sizeof (h->magic)) != 0)
+        return "not a pack (or made on a different kind of machine)";
+    if (h->size != pack_size)
+        return "truncated";
+    if (h->nbuckets == 0 || (h->nbuckets & (h->nbuckets - 1)) != 0)
+        return "bad bucket count";
+
+    tables = sizeof (struct pack_header) +
+        (uint64_t) h->nbuckets * sizeof (uint32_t) +
+        (uint64_t) h->nentries * sizeof (struct pack_entry);
+    if (tables > pack_size)
+        return "truncated tables";
+
+    pack_buckets = (const uint32_t *) (pack_base + sizeof (*h));
+    pack_entries = (const struct pack_entry *)
+        (pack_buckets + h->nbuckets);
+    pack_mask = h->nbuckets - 1;
+
+    for (i = 0; i < h->nbuckets; ++i) {
+        if (pack_buckets[i] > h->nentries)
+            return "bad bucket";
+    }
+    for (i = 0; i < h->nentries; ++i) {
+        const struct pack_entry *e = pack_entries + i;
+
+        /* chains only go forward, so a lookup can't loop */
+        if (e->next > h->nentries || (e->next && e->next <= i + 1) ||
+            !pack_string_ok(e->path) ||
+            !pack_string_ok(e->mime) ||
+            e->offset > pack_size || e->length > pack_size - e->offset ||
+            memchr(e->etag, '\0', sizeof (e->etag)) == NULL ||
+            strlen(e->etag) >= MAX_ETAG_LENGTH)
+            return "bad entry";
+    }
+    return NULL;
+}
+
+/*
+ * Name: pack_init
+ * Description: Maps DocumentPack, or picks up a linked-in pack.
+ * Called once at startup; a new pack needs a restart.
+ */
+
+void pack_init(void)
+{
+    const char *problem;
+    struct stat statbuf;
+    int fd, flags = MAP_SHARED;
+
+    if (document_pack == NULL) {
+#ifdef __GNUC__
+        if (boa_builtin_pack && &boa_builtin_pack_size) {
+            pack_base = (const char *) boa_builtin_pack;
+            pack_size = boa_builtin_pack_size;
+            if ((problem = pack_check()) != NULL) {
+                log_error_time();
+                fprintf(stderr, "built-in pack: %s\n", problem);
+                exit(EXIT_FAILURE);
+            }
+        }
+#endif
+        return;
+    }
+
+    fd = open(document_pack, O_RDONLY);
+    if (fd == -1 || fstat(fd, &statbuf) == -1) {
+        log_error_time();
+        perror(document_pack);
+        exit(EXIT_FAILURE);
+    }
+#ifdef MAP_POPULATE
+    if (mmap_populate)
+        flags |= MAP_POPULATE;
+#endif
+    pack_size = statbuf.st_size;
+    pack_base = mmap(NULL, pack_size, PROT_READ, flags, fd, 0);
+    close(fd);
+    if (pack_base == MAP_FAILED) {
+        log_error_time();
+        perror("mmap DocumentPack");
+        exit(EXIT_FAILURE);
+    }
+    if ((problem = pack_check()) != NULL) {
+        log_error_time();
+        fprintf(stderr, "%s: %s\n", document_pack, problem);
+        exit(EXIT_FAILURE);
+    }
+}
+
+/*
+ * Name: pack_lookup
+ * Description: Finds uri (already unescaped and cleaned up) in the
+ * pack.
+ *
+ * Return values: the entry, or NULL
+ */
+
+const struct pack_entry *pack_lookup(const char *uri)
+{
+    uint32_t hash, i;
+
+    if (pack_base == NULL)
+        return NULL;
+
+    hash = pack_hash(uri);
+    for (i = pack_buckets[hash & pack_mask]; i;
+         i = pack_entries[i - 1].next) {
+        const struct pack_entry *e = pack_entries + i - 1;
+
+        if (e->hash == hash && !strcmp(pack_base + e->path, uri))
+            return e;
+    }
+    return NULL;
+}
+
+/*
+ * Name: pack_entity
+ * Description: Fills in the size, date and entity tag of the
+ * document req found in the pack.
+ *
+ * Return values: its data, for req->data_mem
+ */
+
+char *pack_entity(request * req)
+{
+    const struct pack_entry *e = req->pack_entry_var;
+
+    req->filesize = e->length;
+    req->last_modified = e->mtime;
+    strcpy(req->etag, e->etag); /* pack_check made sure it fits */
+
+    /* data_mem isn't const, but nothing writes through it */
+    return (char *) (uintptr_t) (pack_base + e->offset);
+}
+
+const char *pack_mime(const struct pack_entry *e)
+{
+    return pack_base + e->mime;
+}
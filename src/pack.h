@@ -0,0 +1,76 @@
+/*
+ *  Boa, an http server
+ *  Copyright (C) 1999-2005 Larry Doolittle <ldoolitt@boa.org>
+ *  Copyright (C) 2000-2005 Jon Nelson <jnelson@boa.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 1, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/* $Id$ */
+
+#ifndef _PACK_H
+#define _PACK_H
+
+/* shared by boa_mkpack and the DocumentPack code (pack.c) */
+
+#include <stdint.h>
+
+/*
+ * A pack file is, in the byte order of the machine that made it:
+ *
+ *   struct pack_header
+ *   uint32_t buckets[nbuckets]    index + 1 of the first entry, or 0
+ *   struct pack_entry entries[nentries]
+ *   strings                       NUL terminated, found by offset
+ *   data                          each document, PACK_ALIGN aligned
+ *
+ * All offsets are from the start of the pack.
+ */
+
+#define PACK_MAGIC              "BOAPACK1"
+#define PACK_ALIGN              8
+#define PACK_ETAG_LENGTH        40
+
+struct pack_header {
+    char magic[8];
+    uint32_t nbuckets;          /* a power of two */
+    uint32_t nentries;
+    uint64_t size;              /* of the whole pack */
+};
+
+struct pack_entry {
+    uint32_t hash;              /* pack_hash(path) */
+    uint32_t next;              /* index + 1 of the next in the bucket */
+    uint32_t path;              /* URI path, e.g. "/sub/" */
+    uint32_t mime;              /* Content-Type, sans charset */
+    uint64_t offset;
+    uint64_t length;
+    int64_t mtime;
+    char etag[PACK_ETAG_LENGTH]; /* quoted, NUL terminated */
+};
+
+static uint32_t pack_hash(const char *str)
+{
+    uint32_t hash = 2166136261U;
+
+    while (*str) {
+        hash ^= (unsigned char) *str++;
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
+#endif
@@ -23,8 +23,36 @@
 
 /* $Id: pipe.c,v 1.39.2.16 2005/02/22 14:13:03 jnelson Exp $*/
 
+#ifdef __linux__
+#define _GNU_SOURCE             /* splice */
+#endif
+
 #include "boa.h"
 
+#ifdef SPLICE_F_NONBLOCK
+#include <sys/ioctl.h>          /* FIONREAD */
+
+/* set if the kernel refuses to splice into our sockets */
+static int splice_broken = 0;
+
+static int splice_from_pipe(request * req);
+#endif
+
+/* files being streamed, and by how many requests: DONTNEED for one
+ * reader's pages would drop them from under the others */
+struct stream_file {
+    dev_t dev;
+    ino_t ino;
+    unsigned int readers;
+    struct stream_file *next;
+};
+
+static struct stream_file *stream_files = NULL;
+
+static void stream_advise(request * req);
+static int shuffle_read(request * req, int len);
+static int direct_copy(request * req, int len);
+
 /*
  * Name: read_from_pipe
  * Description: Reads data from a pipe
@@ -40,6 +68,23 @@ int read_from_pipe(request * req)
     int bytes_read; /* signed */
     unsigned int bytes_to_read; /* unsigned */
 
+#ifdef SPLICE_F_NONBLOCK
+    /* once the header is out and nothing is left in the buffer,
+     * let the kernel move the rest of the output */
+    if (req->cgi_status == CGI_SPLICE)
+        return splice_from_pipe(req);
+    if (req->cgi_status != CGI_PARSE && !splice_broken &&
+        !req->fcgi_conn &&      /* FastCGI output comes in records */
+        !req->cgi_cache &&      /* the output is being kept */
+        !req->cgi_gzip &&       /* or compressed */
+        !req->tcl_response &&   /* there is no pipe */
+        !req->proxy_conn &&     /* nor plain output */
+        req->buffer_end == 0 && req->header_line == req->header_end) {
+        req->cgi_status = CGI_SPLICE;
+        return splice_from_pipe(req);
+    }
+#endif
+
     bytes_to_read = BUFFER_SIZE - (req->header_end - req->buffer - 1);
 
     if (bytes_to_read == 0) {   /* buffer full */
@@ -56,7 +101,14 @@ int read_from_pipe(request * req)
         return 1;
     }
 
-    bytes_read = read(req->data_fd, req->header_end, bytes_to_read);
+    if (req->fcgi_conn)
+        bytes_read = fcgi_read(req, req->header_end, bytes_to_read);
+    else if (req->proxy_conn)
+        bytes_read = proxy_read(req, req->header_end, bytes_to_read);
+    else if (req->tcl_response)
+        bytes_read = tcl_read(req, req->header_end, bytes_to_read);
+    else
+        bytes_read = read(req->data_fd, req->header_end, bytes_to_read);
 #ifdef FASCIST_LOGGING
     if (bytes_read > 0) {
         *(req->header_end + bytes_read) = '\0';
@@ -71,9 +123,14 @@ int read_from_pipe(request * req)
     if (bytes_read == -1) {
         if (errno == EINTR)
             return 1;
-        else if (errno == EWOULDBLOCK || errno == EAGAIN)
+        else if (errno == EWOULDBLOCK || errno == EAGAIN) {
+            /* nothing more for now: send what compression holds back */
+            if (req->cgi_gzip && cgi_gzip_flush(req)) {
+                req->status = PIPE_WRITE;
+                return 1;
+            }
             return -1;          /* request blocked at the pipe level, but keep going */
-        else {
+        } else {
             req->status = DEAD;
             log_error_doc(req);
             perror("pipe read");
@@ -83,16 +140,24 @@ int read_from_pipe(request * req)
     *(req->header_end + bytes_read) = '\0';
 
     if (bytes_read == 0) {      /* eof, write rest of buffer */
+        int retval = 1;
+
         req->status = PIPE_WRITE;
         if (req->cgi_status == CGI_PARSE) { /* hasn't processed header yet */
             req->cgi_status = CGI_DONE;
             *req->header_end = '\0'; /* points to end of read data */
-            return process_cgi_header(req); /* cgi_status will change */
-        }
-        req->cgi_status = CGI_DONE;
-        return 1;
+            retval = process_cgi_header(req); /* cgi_status will change */
+        } else
+            req->cgi_status = CGI_DONE;
+        if (req->cgi_cache)
+            cgi_cache_finish(req);
+        if (req->cgi_gzip)
+            cgi_gzip_finish(req);
+        return retval;
     }
 
+    if (req->cgi_cache && req->cgi_status != CGI_PARSE)
+        cgi_cache_body(req, req->header_end, bytes_read);
     req->header_end += bytes_read;
 
     if (req->cgi_status != CGI_PARSE)
@@ -131,6 +196,9 @@ int write_from_pipe(request * req)
     int bytes_written;
     size_t bytes_to_write = req->header_end - req->header_line;
 
+    if (req->cgi_gzip)
+        return cgi_gzip_write(req);
+
     if (bytes_to_write == 0) {
         if (req->cgi_status == CGI_DONE)
             return 0;
@@ -143,8 +211,12 @@ int write_from_pipe(request * req)
     bytes_written = write(req->fd, req->header_line, bytes_to_write);
 
     if (bytes_written == -1) {
-        if (errno == EWOULDBLOCK || errno == EAGAIN)
+        if (errno == EWOULDBLOCK || errno == EAGAIN) {
+            /* called from read_from_pipe, we may still be in PIPE_READ:
+             * it is the socket to wait for */
+            req->status = PIPE_WRITE;
             return -1;          /* request blocked at the pipe level, but keep going */
+        }
         else if (errno == EINTR)
             return 1;
         else {
@@ -157,6 +229,10 @@ int write_from_pipe(request * req)
 
     req->header_line += bytes_written;
     req->bytes_written += bytes_written;
+    if (!cgi_output_ok(req)) {
+        req->status = DEAD;
+        return 0;
+    }
 
     /* if there won't be anything to write next time, switch state */
     if ((unsigned) bytes_written == bytes_to_write) {
@@ -167,39 +243,113 @@ int write_from_pipe(request * req)
     return 1;
 }
 
+#ifdef SPLICE_F_NONBLOCK
+/*
+ * Name: splice_from_pipe
+ * Description: Moves CGI output from the pipe straight to the socket,
+ * without copying it through req->buffer.
+ *
+ * Return values:
+ *  -1: request blocked, move to blocked queue
+ *   0: EOF or error, close it down
+ *   1: successful splice, recycle in ready queue
+ */
+
+static int splice_from_pipe(request * req)
+{
+    int bytes_written;
+    int pending;
+
+    bytes_written = splice(req->data_fd, NULL, req->fd, NULL,
+                           (cgi_pipe_size ? cgi_pipe_size : CGI_SPLICE_SIZE),
+                           SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+
+    if (bytes_written == -1) {
+        if (errno == EINTR)
+            return 1;
+        else if (errno == EWOULDBLOCK || errno == EAGAIN) {
+            /* Either the pipe is empty or the socket is full.
+             * Block on whichever one it was.
+             */
+            if (ioctl(req->data_fd, FIONREAD, &pending) == 0 && pending > 0)
+                req->status = PIPE_WRITE;
+            else
+                req->status = PIPE_READ;
+            return -1;
+        } else if (errno == EINVAL || errno == ENOSYS) {
+            /* fall back to read_from_pipe/write_from_pipe for good */
+            splice_broken = 1;
+            req->cgi_status = CGI_DONE;
+            return 1;
+        } else {
+            req->status = DEAD;
+#ifdef QUIET_DISCONNECT
+            if (0)
+#else
+            if (errno != EPIPE && errno != ECONNRESET)
+#endif
+            {
+                log_error_doc(req);
+                perror("pipe splice");
+            }
+            return 0;
+        }
+    }
+
+    if (bytes_written == 0)     /* eof */
+        return 0;
+
+    req->bytes_written += bytes_written;
+    if (!cgi_output_ok(req)) {
+        req->status = DEAD;
+        return 0;
+    }
+    req->status = PIPE_READ;
+    return 1;
+}
+#endif
+
 #ifdef HAVE_SENDFILE
 int io_shuffle_sendfile(request * req)
 {
     int bytes_written;
     size_t bytes_to_write;
-    off_t sendfile_offset;
+    off_t sendfile_offset, left;
 
     if (req->method == M_HEAD) {
         return complete_response(req);
     }
 
-    /* XXX trouble if range is exactly 4G on a 32-bit machine? */
-    bytes_to_write = (req->ranges->stop - req->ranges->start) + 1;
+    /* Pending headers (or a multipart boundary) are sent with
+     * MSG_MORE, so they leave in the same segment as the start
+     * of the body.
+     */
+    if (req->buffer_end) {
+        bytes_written = req_flush_more(req);
+        if (bytes_written == -2) {
+            req->status = DEAD;
+            return 0;
+        } else if (bytes_written != 0) {
+            /* blocked, or only part of the headers went out */
+            return (bytes_written == -1 ? -1 : 1);
+        }
+    }
 
-    if (bytes_to_write > system_bufsize)
-        bytes_to_write = system_bufsize;
+    /* what is left may not fit in a size_t on a 32-bit machine */
+    left = (req->ranges->stop - req->ranges->start) + 1;
+    bytes_to_write = (left > system_bufsize ? system_bufsize : left);
 
 retrysendfile:
     if (bytes_to_write == 0) {
         /* shouldn't get here, but... */
         bytes_written = 0;
     } else {
-	/* arg 3 of sendfile should have type "off_t *"
-	 * struct range element start has type "unsigned long"
-	 * Where POSIX got the idea that an offset into a file
-	 * should be signed, I'll never know.
-	 */
 	sendfile_offset = req->ranges->start;
 	if (sendfile_offset < 0) {
 		req->status = DEAD;
 		log_error_doc(req);
-		fprintf(stderr, "impossible offset (%lu) requested of sendfile\n",
-				 req->ranges->start);
+		fprintf(stderr, "impossible offset (%lld) requested of sendfile\n",
+				 (long long) req->ranges->start);
 		return 0;
 	}
         bytes_written = sendfile(req->fd, req->data_fd,
@@ -209,11 +359,12 @@ retrysendfile:
 		req->status = DEAD;
 		log_error_doc(req);
 		fprintf(stderr,
-			"bad craziness in sendfile offset, returned %ld\n",
-			(long) sendfile_offset);
+			"bad craziness in sendfile offset, returned %lld\n",
+			(long long) sendfile_offset);
 		return 0;
 	}
 	req->ranges->start = sendfile_offset;
+        stream_advise(req);
         if (bytes_written < 0) {
             if (errno == EWOULDBLOCK || errno == EAGAIN) {
                 return -1;          /* request blocked at the pipe level, but keep going */
@@ -266,6 +417,7 @@ int io_shuffle(request * req)
 {
     int bytes_to_read;
     int bytes_written, bytes_to_write;
+    off_t left;
 
     if (req->method == M_HEAD) {
         return complete_response(req);
@@ -279,32 +431,19 @@ int io_shuffle(request * req)
      */
     bytes_to_read = BUFFER_SIZE - req->buffer_end - 256;
 
-    bytes_to_write = (req->ranges->stop - req->ranges->start) + 1;
-
-    if (bytes_to_read > bytes_to_write)
-        bytes_to_read = bytes_to_write;
+    left = (req->ranges->stop - req->ranges->start) + 1;
+    if (bytes_to_read > left)
+        bytes_to_read = left;
 
     if (bytes_to_read > 0 && req->data_fd) {
         int bytes_read;
-        off_t temp;
 
-        temp = lseek(req->data_fd, req->ranges->start, SEEK_SET);
-        if (temp < 0) {
-            req->status = DEAD;
-            log_error_doc(req);
-            perror("ioshuffle lseek");
-            return 0;
-        }
-
-      restartread:
-        bytes_read =
-            read(req->data_fd, req->buffer + req->buffer_end,
-                 bytes_to_read);
+        bytes_read = shuffle_read(req, bytes_to_read);
+        if (bytes_read == -2)
+            return -1;          /* parked until an io thread is done */
 
         if (bytes_read == -1) {
-            if (errno == EINTR)
-                goto restartread;
-            else if (errno == EWOULDBLOCK || errno == EAGAIN) {
+            if (errno == EWOULDBLOCK || errno == EAGAIN) {
                 /* not a fatal error, don't worry about it */
                 /* buffer is empty, we're blocking on read! */
                 if (req->buffer_end - req->buffer_start == 0)
@@ -322,6 +461,7 @@ int io_shuffle(request * req)
             req->buffer_end += bytes_read;
 
             req->ranges->start += bytes_read;
+            stream_advise(req);
 
             if ((req->ranges->stop + 1 - req->ranges->start) == 0) {
                 return complete_response(req);
@@ -364,3 +504,218 @@ int io_shuffle(request * req)
 
     return 1;
 }
+
+/*
+ * Name: stream_init
+ * Description: Called by init_get for documents which are served with
+ * io_shuffle (or io_shuffle_sendfile) rather than from the mmap cache.
+ * Big one-off downloads shouldn't push everybody else's files out of
+ * the page cache: past StreamingThreshold, the kernel is told the file
+ * is read sequentially, and pages we have sent are dropped (see
+ * stream_advise) unless another request is streaming the same file.
+ * Past DirectIOThreshold, and only without sendfile,
+ * the file is read with O_DIRECT and never enters the page cache.
+ */
+
+void stream_init(request * req)
+{
+    req->stream_ahead = req->stream_behind = req->ranges->start;
+
+#if !defined(HAVE_SENDFILE) && defined(O_DIRECT)
+    if (direct_io_threshold && req->filesize >= direct_io_threshold) {
+        void *p;
+        int flags = fcntl(req->data_fd, F_GETFL);
+
+        if (flags != -1 &&
+            posix_memalign(&p, DIRECT_IO_ALIGN, DIRECT_IO_SIZE) == 0) {
+            if (fcntl(req->data_fd, F_SETFL, flags | O_DIRECT) == -1)
+                free(p);        /* not supported here; no matter */
+            else {
+                req->direct_buf = p;
+                return;
+            }
+        }
+    }
+#endif
+
+    if (stream_threshold && req->filesize >= stream_threshold) {
+        struct stat statbuf;
+        struct stream_file *f = NULL;
+
+        req->streaming = 1;
+        if (fstat(req->data_fd, &statbuf) == 0) {
+            for (f = stream_files; f; f = f->next) {
+                if (f->dev == statbuf.st_dev && f->ino == statbuf.st_ino)
+                    break;
+            }
+            if (f == NULL && (f = malloc(sizeof (*f))) != NULL) {
+                f->dev = statbuf.st_dev;
+                f->ino = statbuf.st_ino;
+                f->readers = 0;
+                f->next = stream_files;
+                stream_files = f;
+            }
+        }
+        /* without an entry, no DONTNEED: there may be other readers */
+        if (f != NULL) {
+            f->readers++;
+            req->stream_file = f;
+        }
+#ifdef POSIX_FADV_SEQUENTIAL
+        posix_fadvise(req->data_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+        stream_advise(req);
+    }
+}
+
+/*
+ * Name: stream_done
+ * Description: Called by free_request for a request which was
+ * streaming a file: one reader fewer.
+ */
+
+void stream_done(request * req)
+{
+    struct stream_file *f = req->stream_file, **p;
+
+    req->stream_file = NULL;
+    if (--f->readers)
+        return;
+    for (p = &stream_files; *p != f; p = &(*p)->next);
+    *p = f->next;
+    free(f);
+}
+
+/*
+ * Name: stream_advise
+ * Description: Keeps WILLNEED advice StreamingWindow bytes ahead of
+ * the send cursor, renewing it when half of it has been used, and
+ * gives DONTNEED, a window at a time, for what lies a window or more
+ * behind the cursor -- but only while no other request is streaming
+ * the file, since the advice covers the file's pages, not this
+ * reader's.  If others come and go, what was passed meanwhile is
+ * dropped once this one is alone.
+ */
+
+static void stream_advise(request * req)
+{
+    off_t pos = req->ranges->start;
+
+    if (!req->streaming)
+        return;
+
+#ifdef POSIX_FADV_WILLNEED
+    if (pos + (off_t) stream_window / 2 >= req->stream_ahead) {
+        off_t from = (pos > req->stream_ahead ? pos : req->stream_ahead);
+
+        posix_fadvise(req->data_fd, from, pos + stream_window - from,
+                      POSIX_FADV_WILLNEED);
+        req->stream_ahead = pos + stream_window;
+    }
+    if (pos >= req->stream_behind + 2 * (off_t) stream_window &&
+        req->stream_file && req->stream_file->readers == 1) {
+        off_t to = pos - stream_window;
+
+        to -= to % DIRECT_IO_ALIGN;     /* whole pages only */
+        if (to > req->stream_behind) {
+            posix_fadvise(req->data_fd, req->stream_behind,
+                          to - req->stream_behind, POSIX_FADV_DONTNEED);
+            req->stream_behind = to;
+        }
+    }
+#endif
+}
+
+/*
+ * Name: direct_copy
+ * Description: Copies what the O_DIRECT bounce buffer holds at
+ * req->ranges->start (up to len bytes) into req->buffer.
+ *
+ * Return values: bytes copied, 0 if the bounce buffer doesn't cover
+ * req->ranges->start
+ */
+
+static int direct_copy(request * req, int len)
+{
+    off_t skip = req->ranges->start - req->direct_offset;
+
+    if (req->direct_len == 0 || skip < 0 || skip >= req->direct_len)
+        return 0;
+    if (len > req->direct_len - skip)
+        len = req->direct_len - skip;
+    memcpy(req->buffer + req->buffer_end, req->direct_buf + skip, len);
+    return len;
+}
+
+/*
+ * Name: shuffle_read
+ * Description: Reads up to len bytes at req->ranges->start into
+ * req->buffer, with pread(2), so there is no separate lseek.  Goes
+ * through the bounce buffer for O_DIRECT files, and through an io
+ * thread when there are any.
+ *
+ * Return values: as read(2), or -2 when the read was handed to an io
+ * thread and the request is parked.
+ */
+
+static int shuffle_read(request * req, int len)
+{
+    char *buf = req->buffer + req->buffer_end;
+    off_t offset = req->ranges->start;
+    int want = len;
+    int bytes_read;
+
+#ifdef USE_IO_THREADS
+    if (io_read_result(req, &bytes_read))
+        goto have_read;
+#endif
+
+    if (req->direct_buf) {
+        bytes_read = direct_copy(req, len);
+        if (bytes_read > 0)
+            return bytes_read;
+        buf = req->direct_buf;
+        offset -= offset % DIRECT_IO_ALIGN;
+        len = DIRECT_IO_SIZE;
+    }
+
+#ifdef USE_IO_THREADS
+    if (io_notify_fd != -1) {
+        /* hand the read off once the buffer has drained */
+        if (req->buffer_end - req->buffer_start != 0) {
+            errno = EAGAIN;
+            return -1;
+        }
+        if (io_submit_read(req, buf, len, offset) == 0)
+            return -1;
+        return -2;
+    }
+#endif
+
+    do {
+        bytes_read = pread(req->data_fd, buf, len, offset);
+    } while (bytes_read == -1 && errno == EINTR);
+
+#ifdef USE_IO_THREADS
+  have_read:
+#endif
+    if (req->direct_buf) {
+#ifdef O_DIRECT
+        if (bytes_read == -1 && errno == EINVAL) {
+            /* the filesystem won't do O_DIRECT after all */
+            fcntl(req->data_fd, F_SETFL,
+                  fcntl(req->data_fd, F_GETFL) & ~O_DIRECT);
+            free(req->direct_buf);
+            req->direct_buf = NULL;
+            return shuffle_read(req, want);
+        }
+#endif
+        if (bytes_read > 0) {
+            req->direct_offset = req->ranges->start -
+                req->ranges->start % DIRECT_IO_ALIGN;
+            req->direct_len = bytes_read;
+            bytes_read = direct_copy(req, want);
+        }
+    }
+    return bytes_read;
+}
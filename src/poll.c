@@ -30,14 +30,20 @@ void update_blocked(struct pollfd pfd1[]);
 struct pollfd *pfds;
 unsigned int pfd_len;
 
-void loop(int server_s)
+void loop(void)
 {
     struct pollfd pfd1[2][MAX_FD];
     short which = 0, other = 1, temp;
-    int server_pfd, watch_server;
+    struct listener *l;
+    int watch_server;
+#ifdef USE_IO_THREADS
+    int io_pfd = 0;
+#endif
+    int negative_pfd = 0;
+    int signal_pfd = 0;
 
     pfds = pfd1[which];
-    pfd_len = server_pfd = 0;
+    pfd_len = 0;
     watch_server = 1;
 
     while (1) {
@@ -51,29 +57,12 @@ void loop(int server_s)
             sigchld_run();
         if (sigalrm_flag)
             sigalrm_run();
+        cgi_watchdog();
 
         if (sigterm_flag) {
             if (sigterm_flag == 1) {
                 sigterm_stage1_run();
-                close(server_s);
-                server_s = -1;
-                /* remove server_pfd */
-                {
-                    unsigned int i, j;
-
-                    for(i = 0, j = 0;i < pfd_len;++i) {
-                        if (i == (unsigned) server_pfd)
-                            continue;
-                        pfd1[other][j].fd = pfd1[which][j].fd;
-                        pfd1[other][j].events = pfd1[which][j].events;
-                        ++j;
-                    }
-                    pfd_len = j;
-                    pfds = pfd1[other];
-                    temp = other;
-                    other = which;
-                    which = temp;
-                }
+                listen_close();
                 watch_server = 0;
             }
             if (sigterm_flag == 2 && !request_ready && !request_block) {
@@ -81,14 +70,33 @@ void loop(int server_s)
             }
         } else {
             if (total_connections < max_connections) {
-                server_pfd = pfd_len++;
-                pfds[server_pfd].fd = server_s;
-                pfds[server_pfd].events = BOA_READ;
+                for (l = listeners; l; l = l->next) {
+                    l->pfd = pfd_len++;
+                    pfds[l->pfd].fd = l->fd;
+                    pfds[l->pfd].events = BOA_READ;
+                }
                 watch_server = 1;
             } else {
                 watch_server = 0;
             }
         }
+#ifdef USE_IO_THREADS
+        if (io_notify_fd != -1) {
+            io_pfd = pfd_len++;
+            pfds[io_pfd].fd = io_notify_fd;
+            pfds[io_pfd].events = BOA_READ;
+        }
+#endif
+        if (negative_notify_fd != -1) {
+            negative_pfd = pfd_len++;
+            pfds[negative_pfd].fd = negative_notify_fd;
+            pfds[negative_pfd].events = BOA_READ;
+        }
+        if (signal_fd != -1) {
+            signal_pfd = pfd_len++;
+            pfds[signal_pfd].fd = signal_fd;
+            pfds[signal_pfd].events = BOA_READ;
+        }
 
         /* If there are any requests ready, the timeout is 0.
          * If not, and there are any requests blocking, the
@@ -100,23 +108,36 @@ void loop(int server_s)
         if (pfd_len) {
             timeout = (request_ready ? 0 :
                       (request_block ? default_timeout : -1));
+            /* cgi_watchdog wants to look once a second */
+            if ((timeout == -1 || timeout > 1000) && cgi_watching())
+                timeout = 1000;
 
             if (poll(pfds, pfd_len, timeout) == -1) {
                 if (errno == EINTR)
                     continue;       /* while(1) */
             }
             if (!sigterm_flag && watch_server) {
-                /*  */
-                if (pfds[server_pfd].revents &
-                  (POLLNVAL|POLLERR)) {
-                    /* problem with the server socket, unexpected */
-                    log_error("server pfd revent contains "
-                      "POLLNVAL or POLLERR! Exiting.");
-                    exit(EXIT_FAILURE);
-                } else if (pfds[server_pfd].revents & BOA_READ) {
-                    pending_requests = 1;
+                for (l = listeners; l; l = l->next) {
+                    if (pfds[l->pfd].revents & (POLLNVAL|POLLERR)) {
+                        /* problem with the server socket, unexpected */
+                        log_error("server pfd revent contains "
+                          "POLLNVAL or POLLERR! Exiting.");
+                        exit(EXIT_FAILURE);
+                    } else if (pfds[l->pfd].revents & BOA_READ) {
+                        l->pending = 1;
+                        pending_requests = 1;
+                    }
                 }
             }
+#ifdef USE_IO_THREADS
+            if (io_notify_fd != -1 && (pfds[io_pfd].revents & BOA_READ))
+                io_pool_collect();
+#endif
+            if (negative_notify_fd != -1 &&
+                (pfds[negative_pfd].revents & BOA_READ))
+                negative_collect();
+            if (signal_fd != -1 && (pfds[signal_pfd].revents & BOA_READ))
+                signal_collect();
             time(&current_time);
             /* if pfd_len is 0, we didn't poll, so the current time
              * should be up-to-date, and we *won't* be accepting anyway
@@ -137,7 +158,7 @@ void loop(int server_s)
         which = temp;
 
         /* process any active requests */
-        process_requests(server_s);
+        process_requests();
     }
 }
 
@@ -168,13 +189,22 @@ void update_blocked(struct pollfd pfd1[])
         time_since = current_time - current->time_last;
         next = current->next;
 
+        /* parked on an io thread, for a CGI slot, a FastCGI server, or
+         * a cached CGI: no pollfd, and no timeout here */
+        if (current->status == FILE_WAIT || current->status == CGI_WAIT ||
+            current->status == CGI_CACHE_WAIT || current->status == FCGI_WAIT)
+            continue;
+
         // FIXME::  the first below has the chance of leaking memory!
         //  (setting status to DEAD not DONE....)
         /* hmm, what if we are in "the middle" of a request and not
          * just waiting for a new one... perhaps check to see if anything
          * has been read via header position, etc... */
         revents = pfds[current->pollfd_id].revents;
-        if (revents & (POLLNVAL|POLLERR)) {
+        /* (a failed connect to a ProxyPass upstream is left to
+         * proxy_write, which tries another) */
+        if ((revents & POLLNVAL) ||
+            ((revents & POLLERR) && current->status != PROXY_WRITE)) {
             /* socket returned error */
             log_error_time();
             fprintf(stderr, "Socket %d returned "
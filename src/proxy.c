@@ -0,0 +1,1026 @@
+/*
+ *  Boa, an http server
+ *  Copyright (C) 1999-2005 Larry Doolittle <ldoolitt@boa.org>
+ *  Copyright (C) 2000-2005 Jon Nelson <jnelson@boa.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 1, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/* $Id$*/
+
+/*
+ * Reverse proxy (ProxyPass, ProxyDownTime).
+ *
+ * A request under a ProxyPass path is sent on to an upstream HTTP/1.1
+ * server, the rest of its path following the upstream URL's.  Like a
+ * FastCGI request, it takes the CGI road: POST data is spooled to the
+ * temporary file first, the request goes out in PROXY_WRITE, and the
+ * answer comes back in PIPE_READ/PIPE_WRITE.  proxy_read makes the
+ * upstream's status line and headers into a CGI header, and takes the
+ * body out of its chunks, so CGICache and CGIGzip work as for CGIs.
+ * As for a CGI, the client's connection is closed at the end.
+ *
+ * Connections to an upstream are kept alive, and go back to a pool for
+ * it once an answer has been read to its end.  Each carries one
+ * request at a time.  A kept connection the upstream has closed is
+ * mostly found out by a peek before it is used; a GET or HEAD which
+ * finds it closed anyway is sent again on a new one.
+ *
+ * Several ProxyPass lines for one path give it several upstreams,
+ * which requests go to in turn.  One which can't be connected to, or
+ * drops a new connection without answering, is left out for
+ * ProxyDownTime seconds, after which the next request tries it again.
+ */
+
+#include "boa.h"
+#include "escape.h"
+#include <netinet/tcp.h>
+
+enum PROXY_STATE {
+    PX_HEAD,                    /* reading the status line and headers */
+    PX_HEAD_OUT,                /* handing them out, as a CGI header */
+    PX_LENGTH,                  /* a body of Content-Length bytes */
+    PX_CLOSE,                   /* a body which ends at end of file */
+    PX_CHUNK_SIZE,              /* chunked: the size line */
+    PX_CHUNK_DATA,
+    PX_CHUNK_END,               /* the CRLF after a chunk */
+    PX_TRAILER,
+    PX_DONE                     /* all of the answer is in */
+};
+
+struct proxy_conn {
+    int fd;
+    int connecting;             /* connect(2) is in progress */
+    int reused;                 /* has carried a request before */
+    int sent;                   /* some of this request went out */
+    int got;                    /* some of the answer came in */
+    struct proxy_upstream *up;
+
+    /* the request's head, then its POST data */
+    char *out;
+    unsigned int out_size, out_start, out_end;
+    int body_done;
+
+    /* the answer; its header, once made, is in out */
+    enum PROXY_STATE state;
+    enum PROXY_STATE body;      /* where PX_HEAD_OUT goes on to */
+    int status;                 /* 0 until the status line is in */
+    int keep;                   /* the upstream keeps the connection */
+    int chunked;
+    int location;
+    off_t length;               /* Content-Length, or -1 */
+    off_t left;                 /* of the body, or of the chunk */
+    char in[BUFFER_SIZE];
+    unsigned int in_start, in_end;
+
+    struct proxy_conn *next;
+};
+
+struct proxy_upstream {
+    char *url;                  /* as given */
+    char *host;                 /* for the Host header */
+    char *path;                 /* what the ProxyPass path becomes */
+    struct sockaddr_storage addr;
+    socklen_t addr_len;
+    time_t down_until;
+    struct proxy_conn *idle;
+    unsigned int idle_count;
+    struct proxy_upstream *next;
+};
+
+struct proxy_pass {
+    char *prefix;               /* of the URL */
+    unsigned int prefix_len;
+    struct proxy_upstream *upstreams;
+    unsigned int count;
+    struct proxy_upstream *turn; /* the next to try */
+    struct proxy_pass *next;
+};
+
+static struct proxy_pass *proxy_passes = NULL;
+
+/*
+ * Name: proxy_add
+ * Description: For a ProxyPass line.  An upstream already given for
+ * the path (as when the config is read again on a SIGHUP) is left as
+ * it was.
+ */
+
+void proxy_add(const char *prefix, const char *url)
+{
+    struct proxy_pass *p;
+    struct proxy_upstream *u, **tail;
+    struct addrinfo hints, *ai;
+    const char *path;
+    char *name, *port;
+    int err;
+
+    if (url == NULL || strncasecmp(url, "http://", 7) || url[7] == '\0' ||
+        url[7] == '/') {
+        log_error_time();
+        fprintf(stderr, "ProxyPass %s: want an http://host[:port]/ URL\n",
+                prefix);
+        exit(EXIT_FAILURE);
+    }
+    add_alias(prefix, url, PROXYALIAS);
+
+    for (p = proxy_passes; p; p = p->next) {
+        if (!strcmp(p->prefix, prefix))
+            break;
+    }
+    if (p) {
+        for (u = p->upstreams; u; u = u->next) {
+            if (!strcmp(u->url, url))
+                return;
+        }
+    } else {
+        p = calloc(1, sizeof (struct proxy_pass));
+        if (p == NULL || (p->prefix = strdup(prefix)) == NULL)
+            DIE("out of memory adding ProxyPass");
+        p->prefix_len = strlen(prefix);
+        p->next = proxy_passes;
+        proxy_passes = p;
+    }
+
+    u = calloc(1, sizeof (struct proxy_upstream));
+    if (u == NULL || (u->url = strdup(url)) == NULL ||
+        (u->host = strdup(url + 7)) == NULL)
+        DIE("out of memory adding ProxyPass");
+    path = strchr(url + 7, '/');
+    if (path)
+        u->host[path - (url + 7)] = '\0';
+    u->path = strdup(path ? path : "/");
+    name = strdup(u->host);
+    if (u->path == NULL || name == NULL)
+        DIE("out of memory adding ProxyPass");
+
+    /* host, host:port, [v6 address] or [v6 address]:port */
+    port = strrchr(name, ':');
+    if (port && strchr(port, ']') == NULL)
+        *port++ = '\0';
+    else
+        port = "80";
+    if (*name == '[' && name[strlen(name) - 1] == ']') {
+        name[strlen(name) - 1] = '\0';
+        memmove(name, name + 1, strlen(name));
+    }
+
+    memset(&hints, 0, sizeof (hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    err = getaddrinfo(name, port, &hints, &ai);
+    if (err) {
+        log_error_time();
+        fprintf(stderr, "ProxyPass %s: %s: %s\n", prefix, u->host,
+                gai_strerror(err));
+        exit(EXIT_FAILURE);
+    }
+    memcpy(&u->addr, ai->ai_addr, ai->ai_addrlen);
+    u->addr_len = ai->ai_addrlen;
+    freeaddrinfo(ai);
+    free(name);
+
+    /* in the order given */
+    for (tail = &p->upstreams; *tail; tail = &(*tail)->next)
+        ;
+    *tail = u;
+    p->count++;
+}
+
+/*
+ * Name: proxy_route
+ * Description: Called by translate_uri for a request under the
+ * ProxyPass path prefix.
+ *
+ * Return values: 0 on error (answered), else 1
+ */
+
+int proxy_route(request * req, const char *prefix)
+{
+    struct proxy_pass *p;
+
+    for (p = proxy_passes; p; p = p->next) {
+        if (!strcmp(p->prefix, prefix))
+            break;
+    }
+    if (p == NULL) {
+        log_error_doc(req);
+        fprintf(stderr, "no ProxyPass for %s\n", prefix);
+        send_r_error(req);
+        return 0;
+    }
+    /* for the logs, and the CGICache key */
+    req->pathname = strdup(req->request_uri);
+    if (req->pathname == NULL) {
+        boa_perror(req, "strdup of pathname for ProxyPass");
+        return 0;
+    }
+    req->proxy_pass = p;
+    req->cgi_type = CGI;
+    return 1;
+}
+
+/*
+ * Name: proxy_down
+ * Description: Leaves u out for ProxyDownTime seconds.
+ */
+
+static void proxy_down(struct proxy_upstream *u, const char *why)
+{
+    if (u->down_until <= current_time) {
+        log_error_time();
+        fprintf(stderr, "ProxyPass upstream %s is down: %s\n", u->url, why);
+    }
+    u->down_until = current_time + proxy_down_time;
+}
+
+/*
+ * Name: proxy_pick
+ * Description: The next of p's upstreams, in turn, which isn't down.
+ */
+
+static struct proxy_upstream *proxy_pick(struct proxy_pass *p)
+{
+    struct proxy_upstream *u = p->turn;
+    unsigned int i;
+
+    for (i = 0; i < p->count; ++i) {
+        if (u == NULL)
+            u = p->upstreams;
+        if (u->down_until <= current_time) {
+            p->turn = u->next;
+            return u;
+        }
+        u = u->next;
+    }
+    return NULL;
+}
+
+static void proxy_close(struct proxy_conn *c)
+{
+    close(c->fd);
+    free(c->out);
+    free(c);
+}
+
+/*
+ * Name: proxy_connect
+ * Description: An idle connection to u, or (always, if fresh is set)
+ * a new one.  A new one may still be connecting.
+ *
+ * Return values: it, or NULL (logged)
+ */
+
+static struct proxy_conn *proxy_connect(struct proxy_upstream *u, int fresh)
+{
+    struct proxy_conn *c;
+    char probe;
+    int one = 1;
+
+    while (!fresh && (c = u->idle) != NULL) {
+        u->idle = c->next;
+        u->idle_count--;
+        /* as in fcgi_connect: closed meanwhile, it reads as end of file */
+        if (recv(c->fd, &probe, 1, MSG_PEEK | MSG_DONTWAIT) == -1 &&
+            (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            c->next = NULL;
+            c->reused = 1;
+            return c;
+        }
+        proxy_close(c);
+    }
+
+    c = calloc(1, sizeof (struct proxy_conn));
+    if (c == NULL) {
+        log_error_time();
+        perror("ProxyPass connection");
+        return NULL;
+    }
+    c->up = u;
+    c->fd = socket(u->addr.ss_family, SOCK_STREAM, 0);
+    if (c->fd == -1) {
+        log_error_time();
+        perror("ProxyPass socket");
+        free(c);
+        return NULL;
+    }
+    fcntl(c->fd, F_SETFD, FD_CLOEXEC);
+    /* a request's head and its POST data go out in separate writes */
+    setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, (void *) &one,
+               sizeof (one));
+    if (set_nonblock_fd(c->fd) == -1) {
+        log_error_time();
+        perror("ProxyPass fcntl");
+        close(c->fd);
+        free(c);
+        return NULL;
+    }
+    if (connect(c->fd, (struct sockaddr *) &u->addr, u->addr_len) == -1) {
+        if (errno != EINPROGRESS) {
+            proxy_down(u, strerror(errno));
+            close(c->fd);
+            free(c);
+            return NULL;
+        }
+        c->connecting = 1;
+    }
+    return c;
+}
+
+/*
+ * Name: proxy_append
+ * Description: Puts len bytes of s at the end of c->out.
+ *
+ * Return values: 0 if out of memory, else 1
+ */
+
+static int proxy_append(struct proxy_conn *c, const char *s, unsigned int len)
+{
+    if (c->out_end + len > c->out_size) {
+        unsigned int size = (c->out_size ? c->out_size : 4096);
+        char *n;
+
+        while (size < c->out_end + len)
+            size *= 2;
+        n = realloc(c->out, size);
+        if (n == NULL)
+            return 0;
+        c->out = n;
+        c->out_size = size;
+    }
+    memcpy(c->out + c->out_end, s, len);
+    c->out_end += len;
+    return 1;
+}
+
+static int proxy_puts(struct proxy_conn *c, const char *s)
+{
+    return proxy_append(c, s, strlen(s));
+}
+
+static int proxy_header(struct proxy_conn *c, const char *name,
+                        const char *value)
+{
+    return (proxy_puts(c, name) && proxy_append(c, ": ", 2) &&
+            proxy_puts(c, value) && proxy_append(c, CRLF, 2));
+}
+
+/* request headers which are the proxy's own, not passed on; and
+ * repeats of those Boa keeps the first of and sends itself */
+static const char *const proxy_hop_headers[] = {
+    "HTTP_CONNECTION=", "HTTP_KEEP_ALIVE=", "HTTP_PROXY_CONNECTION=",
+    "HTTP_PROXY_AUTHORIZATION=", "HTTP_TE=", "HTTP_TRAILER=",
+    "HTTP_TRANSFER_ENCODING=", "HTTP_UPGRADE=", "HTTP_EXPECT=",
+    "HTTP_X_FORWARDED_FOR=", "HTTP_X_FORWARDED_HOST=",
+    "HTTP_CONTENT_LENGTH=", "HTTP_CONTENT_TYPE=", "HTTP_HOST=", NULL
+};
+
+/* the value of req's CGI variable name (which includes the '=') */
+static const char *proxy_env(request * req, const char *name)
+{
+    unsigned int len = strlen(name);
+    int i;
+
+    for (i = common_cgi_env_count; i < req->cgi_env_index; ++i) {
+        if (!strncmp(req->cgi_env[i], name, len))
+            return req->cgi_env[i] + len;
+    }
+    return NULL;
+}
+
+/*
+ * Name: proxy_request
+ * Description: Puts the head of req's request to c->up in c->out:
+ * the client's headers, kept as HTTP_ variables by
+ * process_option_line, made back into header names (User-Agent from
+ * HTTP_USER_AGENT), and those Boa took for itself.
+ *
+ * Return values: 0 if out of memory, else 1
+ */
+
+static int proxy_request(request * req, struct proxy_conn *c)
+{
+    const char *rest = req->request_uri + req->proxy_pass->prefix_len;
+    const char *method, *v;
+    unsigned char *s;
+    char hex[4];
+    int i, ok;
+
+    method = (req->method == M_POST ? "POST" :
+              req->method == M_HEAD ? "HEAD" : "GET");
+    ok = proxy_puts(c, method) && proxy_append(c, " ", 1) &&
+        proxy_puts(c, c->up->path);
+    /* request_uri has been unescaped */
+    for (s = (unsigned char *) rest; ok && *s; ++s) {
+        if (needs_escape((unsigned int) *s) || *s == '?') {
+            sprintf(hex, "%%%02X", *s);
+            ok = proxy_append(c, hex, 3);
+        } else
+            ok = proxy_append(c, (char *) s, 1);
+    }
+    if (ok && req->query_string)
+        ok = proxy_append(c, "?", 1) && proxy_puts(c, req->query_string);
+    ok = ok && proxy_puts(c, " HTTP/1.1" CRLF) &&
+        proxy_header(c, "Host", c->up->host);
+
+    for (i = common_cgi_env_count; ok && i < req->cgi_env_index; ++i) {
+        const char *e = req->cgi_env[i];
+        const char *const *h;
+        char *eq = strchr(e, '=');
+        int up = 1;
+
+        if (eq == NULL || strncmp(e, "HTTP_", 5))
+            continue;
+        for (h = proxy_hop_headers; *h; ++h) {
+            if (!strncmp(e, *h, strlen(*h)))
+                break;
+        }
+        if (*h)
+            continue;
+        /* HTTP_ACCEPT_LANGUAGE: Accept-Language */
+        for (e += 5; ok && e < eq; ++e) {
+            char ch = (*e == '_' ? '-' : up ? *e : tolower(*e));
+
+            up = (*e == '_');
+            ok = proxy_append(c, &ch, 1);
+        }
+        ok = ok && proxy_append(c, ": ", 2) && proxy_puts(c, eq + 1) &&
+            proxy_append(c, CRLF, 2);
+    }
+#ifdef ACCEPT_ON
+    if (ok && req->accept[0])
+        ok = proxy_header(c, "Accept", req->accept);
+#endif
+    if (ok && req->if_modified_since)
+        ok = proxy_header(c, "If-Modified-Since", req->if_modified_since);
+    if (ok && req->if_unmodified_since)
+        ok = proxy_header(c, "If-Unmodified-Since",
+                          req->if_unmodified_since);
+    if (ok && req->if_none_match)
+        ok = proxy_header(c, "If-None-Match", req->if_none_match);
+    if (ok && req->method == M_POST) {
+        ok = proxy_header(c, "Content-Type", (req->content_type ?
+                                              req->content_type :
+                                              default_type)) &&
+            proxy_header(c, "Content-Length",
+                         simple_itoa(req->filesize));
+    }
+
+    /* who asked, and what of */
+    ok = ok && proxy_puts(c, "X-Forwarded-For: ");
+    v = proxy_env(req, "HTTP_X_FORWARDED_FOR=");
+    if (ok && v)
+        ok = proxy_puts(c, v) && proxy_append(c, ", ", 2);
+    ok = ok && proxy_puts(c, req->remote_ip_addr) &&
+        proxy_append(c, CRLF, 2);
+    if (ok && req->header_host)
+        ok = proxy_header(c, "X-Forwarded-Host", req->header_host);
+
+    return ok && proxy_append(c, CRLF, 2);
+}
+
+/*
+ * Name: proxy_send
+ * Description: Sets req going to the upstream on c.
+ *
+ * Return values: 0 if out of memory (logged), else 1
+ */
+
+static int proxy_send(request * req, struct proxy_conn *c)
+{
+    c->out_start = c->out_end = 0;
+    c->sent = c->got = 0;
+    c->state = PX_HEAD;
+    c->status = 0;
+    c->in_start = c->in_end = 0;
+    if (!proxy_request(req, c)) {
+        log_error_doc(req);
+        fputs("out of memory for ProxyPass request\n", stderr);
+        proxy_close(c);
+        return 0;
+    }
+    c->body_done = (req->method != M_POST);
+    if (req->method == M_POST)
+        lseek(req->post_data_fd, 0, SEEK_SET);
+
+    req->proxy_conn = c;
+    req->data_fd = c->fd;
+    req->status = PROXY_WRITE;
+    return 1;
+}
+
+/*
+ * Name: proxy_start
+ * Description: Called by init_cgi for a request under a ProxyPass
+ * path.
+ *
+ * Return values: 0 on error (answered), 1 if the request is on its way
+ */
+
+int proxy_start(request * req)
+{
+    struct proxy_pass *p = req->proxy_pass;
+    struct proxy_upstream *u;
+    struct proxy_conn *c = NULL;
+    unsigned int i;
+
+    /* a repeated Content-Length or Host: which one would the upstream
+     * go by?  Not necessarily Boa's, on a connection others share */
+    if (proxy_env(req, "HTTP_CONTENT_LENGTH=") ||
+        proxy_env(req, "HTTP_HOST=")) {
+        log_error_doc(req);
+        fputs("repeated Content-Length or Host header\n", stderr);
+        send_r_bad_request(req);
+        return 0;
+    }
+
+    for (i = 0; c == NULL && i < p->count; ++i) {
+        u = proxy_pick(p);
+        if (u == NULL)
+            break;
+        c = proxy_connect(u, 0);
+    }
+    if (c == NULL) {
+        log_error_doc(req);
+        fprintf(stderr, "no upstream for ProxyPass %s is up\n", p->prefix);
+        send_r_service_unavailable(req);
+        return 0;
+    }
+    if (!proxy_send(req, c)) {
+        send_r_error(req);
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * Name: proxy_retry
+ * Description: Starts req over on another connection: a new one to
+ * the same upstream if same is set (a kept one turned out closed),
+ * else one to the next upstream which is up.
+ *
+ * Return values: 1 if the request is on its way again, else 0
+ */
+
+static int proxy_retry(request * req, int same)
+{
+    struct proxy_pass *p = req->proxy_pass;
+    struct proxy_upstream *u = req->proxy_conn->up;
+    struct proxy_conn *c = NULL;
+    unsigned int i;
+
+    proxy_close(req->proxy_conn);
+    req->proxy_conn = NULL;
+    req->data_fd = 0;
+
+    if (same)
+        c = proxy_connect(u, 1);
+    for (i = 0; c == NULL && i < p->count; ++i) {
+        u = proxy_pick(p);
+        if (u == NULL)
+            break;
+        c = proxy_connect(u, 0);
+    }
+    if (c == NULL) {
+        log_error_doc(req);
+        fprintf(stderr, "no upstream for ProxyPass %s is up\n", p->prefix);
+        return 0;
+    }
+    return proxy_send(req, c);
+}
+
+/*
+ * Name: proxy_write
+ * Description: Sends the request's head, and its POST data as it is
+ * read from the temporary file; then turns to reading the answer.
+ *
+ * Return values:
+ *  -1: request blocked, move to blocked queue
+ *   0: error, close it down
+ *   1: successful write, recycle in ready queue
+ */
+
+int proxy_write(request * req)
+{
+    struct proxy_conn *c = req->proxy_conn;
+    int n;
+
+    if (c->connecting) {
+        int err = 0;
+        socklen_t len = sizeof (err);
+
+        if (getsockopt(c->fd, SOL_SOCKET, SO_ERROR, &err, &len) == -1)
+            err = errno;
+        if (err) {
+            proxy_down(c->up, strerror(err));
+            if (proxy_retry(req, 0))
+                return 1;
+            send_r_bad_gateway(req);
+            return 0;
+        }
+        c->connecting = 0;
+    }
+
+    if (c->out_start == c->out_end) {
+        if (c->body_done) {
+            req->status = PIPE_READ;
+            req->cgi_status = CGI_PARSE;
+            /* as for a CGI pipe: the top half of the buffer */
+            req->header_line = req->header_end =
+                (req->buffer + BUFFER_SIZE / 2);
+            req->filepos = 0;
+            return 1;
+        }
+        n = read(req->post_data_fd, c->out, c->out_size);
+        if (n == -1) {
+            boa_perror(req, "read of POST data for ProxyPass");
+            return 0;
+        }
+        c->out_start = 0;
+        c->out_end = n;
+        if (n == 0)
+            c->body_done = 1;
+        return 1;
+    }
+
+    n = write(c->fd, c->out + c->out_start, c->out_end - c->out_start);
+    if (n == -1) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return -1;
+        if (errno == EINTR)
+            return 1;
+        if (!c->sent) {
+            /* nothing went: try again elsewhere */
+            int same = (c->reused && (errno == EPIPE || errno == ECONNRESET));
+
+            if (!same)
+                proxy_down(c->up, strerror(errno));
+            if (proxy_retry(req, same))
+                return 1;
+        } else {
+            log_error_doc(req);
+            perror("ProxyPass write");
+        }
+        send_r_bad_gateway(req);
+        return 0;
+    }
+    c->sent = 1;
+    c->out_start += n;
+    return 1;
+}
+
+/*
+ * Name: proxy_release
+ * Description: Done with req's connection: back to the pool if the
+ * answer was read to its end and the upstream keeps it, else closed.
+ */
+
+static void proxy_release(request * req, int reusable)
+{
+    struct proxy_conn *c = req->proxy_conn;
+    struct proxy_upstream *u = c->up;
+
+    req->proxy_conn = NULL;
+    req->data_fd = 0;
+    if (reusable && c->keep && c->in_start == c->in_end &&
+        u->idle_count < PROXY_IDLE_MAX) {
+        c->next = u->idle;
+        u->idle = c;
+        u->idle_count++;
+    } else
+        proxy_close(c);
+}
+
+/*
+ * Name: proxy_status
+ * Description: The upstream's status line: "HTTP/1.1 404 Not Found"
+ * goes in c->out as "Status: 404 Not Found".
+ *
+ * Return values: 0 if it isn't one, or out of memory; else 1
+ */
+
+static int proxy_status(struct proxy_conn *c, char *line)
+{
+    char *p;
+
+    if (strncmp(line, "HTTP/1.", 7) || !isdigit((unsigned char) line[7]) ||
+        line[8] != ' ')
+        return 0;
+    c->status = strtol(line + 9, &p, 10);
+    if (c->status < 100 || c->status > 999 || p != line + 12)
+        return 0;
+    c->keep = (line[7] != '0');
+    c->chunked = c->location = 0;
+    c->length = -1;
+    c->out_start = c->out_end = 0;
+    return proxy_puts(c, "Status: ") && proxy_puts(c, line + 9) &&
+        proxy_append(c, CRLF, 2);
+}
+
+/* whether the comma-separated list has token in it */
+static int proxy_token(const char *list, const char *token)
+{
+    unsigned int len = strlen(token);
+
+    while (*list) {
+        while (*list == ' ' || *list == '\t' || *list == ',')
+            ++list;
+        if (!strncasecmp(list, token, len) &&
+            (list[len] == '\0' || list[len] == ',' || list[len] == ' ' ||
+             list[len] == '\t' || list[len] == ';'))
+            return 1;
+        while (*list && *list != ',')
+            ++list;
+    }
+    return 0;
+}
+
+/*
+ * Name: proxy_head_line
+ * Description: One line of the upstream's header, without its line
+ * end.  Connection headers are the proxy's own business, and the body
+ * is sent as it is unchunked.  A 200's Date and Server are Boa's.
+ *
+ * Return values: 0 if out of memory, or the answer is bad; else 1
+ */
+
+static int proxy_head_line(request * req, struct proxy_conn *c, char *line)
+{
+    char *value;
+
+    if (c->status == 0)
+        return proxy_status(c, line);
+
+    if (*line == '\0') {
+        unsigned int status_len;
+
+        if (c->status < 200) {
+            /* 100 Continue and the like: the real answer follows */
+            c->status = 0;
+            return 1;
+        }
+        if (req->method == M_HEAD || c->status == 204 || c->status == 304)
+            c->body = PX_DONE;
+        else if (c->chunked)
+            c->body = PX_CHUNK_SIZE;
+        else if (c->length >= 0) {
+            c->body = (c->length ? PX_LENGTH : PX_DONE);
+            c->left = c->length;
+            if (!proxy_header(c, "Content-Length", simple_itoa(c->length)))
+                return 0;
+        } else {
+            c->body = PX_CLOSE;
+            c->keep = 0;
+        }
+        if (!proxy_append(c, CRLF, 2))
+            return 0;
+        /* a plain 200 gets Boa's status line and headers, and may be
+         * compressed; others go out as they are */
+        status_len = strchr(c->out, '\n') + 1 - c->out;
+        if (c->status == 200 && !c->location)
+            c->out_start = status_len;
+        else
+            c->out_start = 0;
+        c->state = PX_HEAD_OUT;
+        return 1;
+    }
+
+    value = strchr(line, ':');
+    if (value == NULL)
+        return (*line == ' ' || *line == '\t'); /* folded: let it go */
+    *value = '\0';
+    if (!strcasecmp(line, "Connection")) {
+        if (proxy_token(value + 1, "close"))
+            c->keep = 0;
+        else if (proxy_token(value + 1, "keep-alive"))
+            c->keep = 1;
+        return 1;
+    }
+    if (!strcasecmp(line, "Transfer-Encoding")) {
+        c->chunked = proxy_token(value + 1, "chunked");
+        return 1;
+    }
+    if (!strcasecmp(line, "Content-Length")) {
+        c->length = strtoll(value + 1, NULL, 10);
+        if (c->length < 0)
+            return 0;
+        return 1;
+    }
+    if (!strcasecmp(line, "Keep-Alive") ||
+        !strcasecmp(line, "Proxy-Connection") ||
+        !strcasecmp(line, "Trailer") || !strcasecmp(line, "Upgrade"))
+        return 1;
+    if (c->status == 200 &&
+        (!strcasecmp(line, "Date") || !strcasecmp(line, "Server")))
+        return 1;
+    if (!strcasecmp(line, "Location"))
+        c->location = 1;
+    *value = ':';
+    return proxy_puts(c, line) && proxy_append(c, CRLF, 2);
+}
+
+/*
+ * Name: proxy_line
+ * Description: Takes one line of the answer, in the states which read
+ * by lines.
+ *
+ * Return values: 0 if the answer is bad, or out of memory; else 1
+ */
+
+static int proxy_line(request * req, struct proxy_conn *c, char *line)
+{
+    char *end;
+    unsigned long size;
+
+    switch (c->state) {
+    case PX_HEAD:
+        return proxy_head_line(req, c, line);
+    case PX_CHUNK_SIZE:
+        size = strtoul(line, &end, 16);
+        if (end == line)
+            return 0;
+        if (size == 0)
+            c->state = PX_TRAILER;
+        else {
+            c->left = size;
+            c->state = PX_CHUNK_DATA;
+        }
+        return 1;
+    case PX_CHUNK_END:
+        c->state = PX_CHUNK_SIZE;
+        return (*line == '\0');
+    case PX_TRAILER:
+        if (*line == '\0')
+            c->state = PX_DONE;
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+/*
+ * Name: proxy_read
+ * Description: Like read() on a CGI pipe: up to len bytes of the
+ * upstream's answer, made into a CGI's, into buf.
+ *
+ * Return values: the number of bytes, 0 at the end of the answer, or
+ * -1 with errno set
+ */
+
+int proxy_read(request * req, char *buf, unsigned int len)
+{
+    struct proxy_conn *c = req->proxy_conn;
+    unsigned int avail;
+    char *eol;
+    int n = 0;
+
+    if (c == NULL)
+        return 0;
+
+    while (1) {
+        avail = c->in_end - c->in_start;
+        switch (c->state) {
+        case PX_HEAD_OUT:
+            n = c->out_end - c->out_start;
+            if (n == 0) {
+                c->state = c->body;
+                continue;
+            }
+            if ((unsigned) n > len)
+                n = len;
+            memcpy(buf, c->out + c->out_start, n);
+            c->out_start += n;
+            return n;
+
+        case PX_LENGTH:
+        case PX_CHUNK_DATA:
+        case PX_CLOSE:
+            if (c->state != PX_CLOSE) {
+                if (c->left == 0) {
+                    c->state = (c->state == PX_LENGTH ? PX_DONE :
+                                PX_CHUNK_END);
+                    continue;
+                }
+                if ((off_t) len > c->left)
+                    len = c->left;
+            }
+            if (avail) {
+                n = (len < avail ? len : avail);
+                memcpy(buf, c->in + c->in_start, n);
+                c->in_start += n;
+            } else {
+                n = read(c->fd, buf, len);
+                if (n <= 0)
+                    break;
+                c->got = 1;
+            }
+            c->left -= n;
+            return n;
+
+        case PX_DONE:
+            proxy_release(req, 1);
+            return 0;
+
+        default:
+            /* the header, chunk sizes and the trailer go by lines */
+            eol = memchr(c->in + c->in_start, '\n', avail);
+            if (eol) {
+                char *line = c->in + c->in_start;
+
+                c->in_start = eol + 1 - c->in;
+                if (eol > line && eol[-1] == '\r')
+                    --eol;
+                *eol = '\0';
+                if (proxy_line(req, c, line))
+                    continue;
+                log_error_doc(req);
+                fprintf(stderr, "bad answer from ProxyPass upstream %s\n",
+                        c->up->url);
+                goto bad;
+            }
+            if (avail == sizeof (c->in)) {
+                log_error_doc(req);
+                fprintf(stderr, "too long a line from ProxyPass upstream "
+                        "%s\n", c->up->url);
+                goto bad;
+            }
+            if (c->in_start) {
+                memmove(c->in, c->in + c->in_start, avail);
+                c->in_start = 0;
+                c->in_end = avail;
+            }
+            n = read(c->fd, c->in + c->in_end, sizeof (c->in) - c->in_end);
+            if (n <= 0)
+                break;
+            c->got = 1;
+            c->in_end += n;
+            continue;
+        }
+        break;
+    }
+
+    if (n == -1 && errno != ECONNRESET)
+        return -1;
+    if (c->state == PX_CLOSE && n == 0) {
+        proxy_release(req, 0);
+        return 0;
+    }
+    if (c->state == PX_HEAD && !c->got) {
+        /* not a word: a kept connection it had closed, or trouble */
+        if (c->reused && req->method != M_POST) {
+            if (proxy_retry(req, 1)) {
+                errno = EAGAIN;
+                return -1;
+            }
+            return 0;
+        }
+        if (!c->reused)
+            proxy_down(c->up, (n == 0 ? "closed without an answer" :
+                               strerror(errno)));
+        log_error_doc(req);
+        fprintf(stderr, "ProxyPass upstream %s didn't answer\n",
+                c->up->url);
+    } else {
+        log_error_doc(req);
+        fprintf(stderr, "ProxyPass upstream %s cut its answer short\n",
+                c->up->url);
+    }
+  bad:
+    /* what came is all there is; it is not kept */
+    cgi_cache_failed(req);
+    proxy_release(req, 0);
+    return 0;
+}
+
+/*
+ * Name: proxy_abort
+ * Description: For free_request: a connection still held goes back to
+ * the pool only if the whole answer was read from it (as for a HEAD,
+ * whose header ends the request).  One which timed out connecting
+ * puts its upstream down.
+ */
+
+void proxy_abort(request * req)
+{
+    struct proxy_conn *c = req->proxy_conn;
+
+    if (c == NULL)
+        return;
+    if (c->connecting && req->status == TIMED_OUT)
+        proxy_down(c->up, "connect timed out");
+    proxy_release(req, c->state == PX_DONE ||
+                  (c->state == PX_HEAD_OUT && c->body == PX_DONE));
+}
@@ -38,6 +38,12 @@ void block_request(request * req)
     dequeue(&request_ready, req);
     enqueue(&request_block, req);
 
+    /* no fd: io_pool_collect, cgi_wake, cgi_cache_wake or fcgi_wake
+     * readies it */
+    if (req->status == FILE_WAIT || req->status == CGI_WAIT ||
+        req->status == CGI_CACHE_WAIT || req->status == FCGI_WAIT)
+        return;
+
     if (req->buffer_end) {
         BOA_FD_SET(req, req->fd, BOA_WRITE);
     } else {
@@ -57,6 +63,10 @@ void block_request(request * req)
         case PIPE_READ:
             BOA_FD_SET(req, req->data_fd, BOA_READ);
             break;
+        case FCGI_WRITE:
+        case PROXY_WRITE:
+            BOA_FD_SET(req, req->data_fd, BOA_WRITE);
+            break;
         case BODY_WRITE:
             BOA_FD_SET(req, req->post_data_fd, BOA_WRITE);
             break;
@@ -78,6 +88,10 @@ void ready_request(request * req)
     dequeue(&request_block, req);
     enqueue(&request_ready, req);
 
+    if (req->status == FILE_WAIT || req->status == CGI_WAIT ||
+        req->status == CGI_CACHE_WAIT || req->status == FCGI_WAIT)
+        return;
+
     if (req->buffer_end) {
         BOA_FD_CLR(req, req->fd, BOA_WRITE);
     } else {
@@ -97,6 +111,10 @@ void ready_request(request * req)
         case PIPE_READ:
             BOA_FD_CLR(req, req->data_fd, BOA_READ);
             break;
+        case FCGI_WRITE:
+        case PROXY_WRITE:
+            BOA_FD_CLR(req, req->data_fd, BOA_WRITE);
+            break;
         case BODY_WRITE:
             BOA_FD_CLR(req, req->post_data_fd, BOA_WRITE);
             break;
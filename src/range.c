@@ -27,7 +27,8 @@
 #include "boa.h"
 
 static void range_abort(request * req);
-static void range_add(request * req, unsigned long start, unsigned long stop);
+static void range_add(request * req, off_t start, off_t stop);
+static int ranges_coalesce(request * req);
 static Range *range_pool = NULL;
 
 void ranges_reset(request * req)
@@ -42,6 +43,7 @@ void ranges_reset(request * req)
         r = bob;
     }
     req->ranges = NULL;
+    req->numranges = 0;
 }
 
 Range *range_pool_pop(void)
@@ -87,13 +89,14 @@ static void range_abort(request * req)
     req->ranges->stop = -1;
 }
 
-static void range_add(request * req, unsigned long start, unsigned long stop)
+static void range_add(request * req, off_t start, off_t stop)
 {
     Range *prev;
     Range *r = range_pool_pop();
 
     DEBUG(DEBUG_RANGE) {
-        fprintf(stderr, "range.c, range_add: got: %lu-%lu\n", start, stop);
+        fprintf(stderr, "range.c, range_add: got: %lld-%lld\n",
+                (long long) start, (long long) stop);
     }
 
     for(prev = req->ranges;prev;prev = prev->next) {
@@ -112,6 +115,17 @@ static void range_add(request * req, unsigned long start, unsigned long stop)
     req->numranges++;
 }
 
+/* one more digit of a range number; too big a one is as good as the
+ * biggest, since ranges_fixup clips stop to the file (and rejects a
+ * start beyond it) anyway
+ */
+static off_t range_digit(off_t n, int c)
+{
+    if (n > (BOA_OFF_MAX - (c - '0')) / 10)
+        return BOA_OFF_MAX;
+    return n * 10 + (c - '0');
+}
+
 /* parse_range converts the range string to a binary form _before_
  * we know the size of the file.  ranges_fixup touches up that
  * binary form _after_ we have req->filesize to work with.
@@ -147,14 +161,15 @@ int ranges_fixup(request * req)
          * 5) start > stop && start != -1 :: invalid
          */
         DEBUG(DEBUG_RANGE) {
-            fprintf(stderr, "range.c: ranges_fixup: %lu-%lu\n", r->start, r->stop);
+            fprintf(stderr, "range.c: ranges_fixup: %lld-%lld\n",
+                    (long long) r->start, (long long) r->stop);
         }
 
         /* no stop range specified or stop is too big.
          * RFC says it gets req->filesize - 1
          */
-        if (r->stop == (unsigned) -1 || r->stop >= req->filesize) {
-            /* r->start is *not* -1 */
+        if (r->start != -1 &&
+            (r->stop == -1 || r->stop >= req->filesize)) {
             r->stop = req->filesize - 1;
         }
 
@@ -166,15 +181,16 @@ int ranges_fixup(request * req)
          * assuming a 6 byte file, and last 4 bytes:
          *       -=> 6 - 4 = 2 through 6 - 1 = 5
          * RFC says it gets filesize - stop.
-         * Stop is already valid from a filesize point of view.
+         * Stop is N here, not a position.
          */
-        if ((long) r->start == -1) {
+        if (r->start == -1) {
             /* last N bytes of the entity body.
              * r->stop contains is N
-             * due to the above test we are guaranteed
-             * that r->stop is < req->filesize
+             * N may be the whole file or more, which means all of it.
              * we have to reset r->stop here, though
              */
+            if (r->stop > req->filesize)
+                r->stop = req->filesize;
             r->start = req->filesize - r->stop;
             r->stop = req->filesize - 1;
         }
@@ -188,7 +204,7 @@ int ranges_fixup(request * req)
         /* since start <= stop and stop < filesize,
          * start < filesize
          */
-        if ((long) r->start < 0 || r->start > r->stop) {
+        if (r->start < 0 || r->start > r->stop) {
             Range *temp;
 
             temp = r;
@@ -206,7 +222,8 @@ int ranges_fixup(request * req)
         /* r->stop and r->start may be the same, however */
 
         DEBUG(DEBUG_RANGE) {
-            fprintf(stderr, "ending with start: %lu\tstop: %lu\n", r->start, r->stop);
+            fprintf(stderr, "ending with start: %lld\tstop: %lld\n",
+                    (long long) r->start, (long long) r->stop);
         }
 
         if (prev == NULL)
@@ -222,12 +239,60 @@ int ranges_fixup(request * req)
         return 0;
     }
 
+    req->numranges = ranges_coalesce(req);
+    if (max_ranges && req->numranges > max_ranges) {
+        /* RFC 2616 lets us ignore the Range header altogether, which
+         * is better than sending a response many times the size of
+         * the file.  The caller sees no ranges, and sends a 200.
+         */
+        log_error_doc(req);
+        fprintf(stderr, "%d ranges requested, MaxRanges is %u: "
+                "sending the whole file\n", req->numranges, max_ranges);
+        ranges_reset(req);
+    }
+
     DEBUG(DEBUG_RANGE) {
         fprintf(stderr, "ranges_fixup returning 1\n");
     }
     return 1;
 }
 
+/*
+ * Name: ranges_coalesce
+ * Description: Sorts the (already fixed up) ranges by start, and merges
+ * those which overlap or touch, so no byte is sent twice.
+ * Returns: the number of ranges left
+ */
+static int ranges_coalesce(request * req)
+{
+    Range *sorted = NULL, *r, *next, **pp;
+    int count = 0;
+
+    /* insertion sort: the list is rarely more than a few long, and
+     * its length is bounded by the size of the request header */
+    for (r = req->ranges; r; r = next) {
+        next = r->next;
+        for (pp = &sorted; *pp && (*pp)->start <= r->start;
+             pp = &(*pp)->next);
+        r->next = *pp;
+        *pp = r;
+    }
+
+    for (r = sorted; r; r = r->next) {
+        while (r->next && r->next->start <= r->stop + 1) {
+            Range *temp = r->next;
+
+            if (temp->stop > r->stop)
+                r->stop = temp->stop;
+            r->next = temp->next;
+            range_pool_push(temp);
+        }
+        ++count;
+    }
+    req->ranges = sorted;
+    return count;
+}
+
 /*
  * Name: parse_range
  * Description: Takes a char* string and extracts Range information from it.
@@ -277,7 +342,7 @@ int range_parse(request * req, const char *str)
 #define null 4
 #define other 5
         int ccode;
-        unsigned long start = 0, stop = 0;
+        off_t start = 0, stop = 0;
 
 #define ACTMASK1 (0xE0)
 #define PB  (0x20)              /* Push Beginning */
@@ -341,11 +406,11 @@ int range_parse(request * req, const char *str)
 
             fcode = stable[mode * 6 + ccode];
             if ((fcode & ACTMASK1) == PB)
-                start = start * 10 + (c - '0');
+                start = range_digit(start, c);
             else if ((fcode & ACTMASK1) == DB)
                 start = -1;
             else if ((fcode & ACTMASK1) == PE)
-                stop = stop * 10 + (c - '0');
+                stop = range_digit(stop, c);
             else if ((fcode & ACTMASK1) == DE)
                 stop = -1;
             if ((fcode & ACTMASK2) == AR) {
@@ -355,8 +420,8 @@ int range_parse(request * req, const char *str)
                 range_abort(req);
                 return 0;
             } else if ((fcode & ACTMASK2) == SR) {
-                if ((start == stop) && (start == (unsigned) -1)) {
-                    /* neither was specified, or they were very big. */
+                if ((start == stop) && (start == -1)) {
+                    /* neither was specified */
                     log_error_doc(req);
                     log_error_time();
                     fprintf(stderr, "Invalid range request (neither start nor stop were specified).\n");
@@ -389,12 +454,13 @@ void log_error_mesg(char *file, int line, char *mesg, int die)
 int main(int argc, char *argv[])
 {
     request req;
-    int c, fake_size = 10000;
+    int c;
+    off_t fake_size = 10000;
     char buff[1024], *p;
 
     req.ranges = NULL;
     if (argc >= 2)
-        fake_size = simple_itoa(argv[1]);
+        fake_size = boa_atoo(argv[1]);
     while (fgets(buff, 1024, stdin)) {
         p = buff + strlen(buff) - 1;
         if (p >= buff && *p == '\n')
@@ -128,7 +128,11 @@ int read_header(request * req)
 
             /* terminate string that begins at req->header_line */
 
-            if (req->logline) {
+            if (req->proxy_protocol) {
+                if (listen_proxy_line(req) == 0)
+                    /* errors already logged */
+                    return 0;
+            } else if (req->logline) {
                 if (process_option_line(req) == 0) {
                     /* errors already logged */
                     return 0;
@@ -179,9 +183,9 @@ int read_header(request * req)
                  */
 
                 if (req->content_length) {
-                    int content_length;
+                    off_t content_length;
 
-                    content_length = boa_atoi(req->content_length);
+                    content_length = boa_atoo(req->content_length);
                     /* Is a content-length of 0 legal? */
                     if (content_length < 0) {
                         log_error_doc(req);
@@ -195,8 +199,8 @@ int read_header(request * req)
                         && content_length > single_post_limit) {
                         log_error_doc(req);
                         fprintf(stderr,
-                                "Content-Length [%d] > SinglePostLimit [%d] on POST!\n",
-                                content_length, single_post_limit);
+                                "Content-Length [%lld] > SinglePostLimit [%d] on POST!\n",
+                                (long long) content_length, single_post_limit);
                         send_r_bad_request(req);
                         return 0;
                     }
@@ -313,10 +317,10 @@ int read_body(request * req)
     unsigned int bytes_to_read, bytes_free;
 
     bytes_free = BUFFER_SIZE - (req->header_end - req->header_line);
-    bytes_to_read = req->filesize - req->filepos;
-
-    if (bytes_to_read > bytes_free)
+    if (req->filesize - req->filepos > bytes_free)
         bytes_to_read = bytes_free;
+    else
+        bytes_to_read = req->filesize - req->filepos;
 
     if (bytes_to_read <= 0) {
         req->status = BODY_WRITE; /* go write it */
@@ -402,9 +406,9 @@ int write_body(request * req)
     }
     DEBUG(DEBUG_HEADER_READ) {
         log_error_time();
-        fprintf(stderr, "%s:%d - wrote %d bytes of CGI body. %ld of %ld\n",
-                __FILE__, __LINE__,
-                bytes_written, req->filepos, req->filesize);
+        fprintf(stderr, "%s:%d - wrote %d bytes of CGI body. %lld of %lld\n",
+                __FILE__, __LINE__, bytes_written,
+                (long long) req->filepos, (long long) req->filesize);
     }
 
     req->filepos += bytes_written;
@@ -417,9 +421,9 @@ int write_body(request * req)
 
             req->header_line[bytes_written] = '\0';
             fprintf(stderr,
-                    "%s:%d - wrote %d bytes (%s). %lu of %lu\n",
-                    __FILE__, __LINE__, bytes_written,
-                    req->header_line, req->filepos, req->filesize);
+                    "%s:%d - wrote %d bytes (%s). %lld of %lld\n",
+                    __FILE__, __LINE__, bytes_written, req->header_line,
+                    (long long) req->filepos, (long long) req->filesize);
             req->header_line[bytes_written] = c;
         }
     }
@@ -38,6 +38,20 @@ struct status status;
 
 static unsigned int sockbufsize = SOCKETBUF_SIZE;
 
+/* The body handlers for these states send any pending headers
+ * along with the first chunk of the body (see process_get and
+ * io_shuffle_sendfile), so process_requests leaves them alone.
+ * HEAD responses have no body to share a segment with.
+ */
+#ifdef HAVE_SENDFILE
+#define COALESCE_HEADERS(req) \
+    (((req)->status == WRITE || (req)->status == IOSHUFFLE) && \
+     (req)->method != M_HEAD)
+#else
+#define COALESCE_HEADERS(req) \
+    ((req)->status == WRITE && (req)->method != M_HEAD)
+#endif
+
 /* function prototypes located in this file only */
 static void free_request(request * req);
 static void sanitize_request(request * req, int make_new_request);
@@ -64,6 +78,8 @@ request *new_request(void)
             perror("malloc for new request");
             return NULL;
         }
+        req->cgi_env_arena = NULL;
+        req->cgi_env_arena_size = 0;
     }
 
     sanitize_request(req, 1);
@@ -74,12 +90,14 @@ request *new_request(void)
 /*
  * Name: get_request
  *
- * Description: Polls the server socket for a request.  If one exists,
- * does some basic initialization and adds it to the ready queue;.
+ * Description: Polls a server socket the loop saw a connection on for
+ * a request.  If one exists, does some basic initialization and adds
+ * it to the ready queue;.
  */
 
-void get_request(int server_sock)
+void get_request(void)
 {
+    struct listener *l;
     int fd;                     /* socket */
     struct SOCKADDR remote_addr; /* address */
     struct SOCKADDR salocal;
@@ -87,10 +105,17 @@ void get_request(int server_sock)
     request *conn;              /* connection */
     socklen_t len;
 
+    for (l = listeners; l && !l->pending; l = l->next)
+        ;
+    if (l == NULL) {
+        pending_requests = 0;
+        return;
+    }
+
 #ifndef INET6
     remote_addr.S_FAMILY = (sa_family_t) 0xdead;
 #endif
-    fd = accept(server_sock, (struct sockaddr *) &remote_addr,
+    fd = accept(l->fd, (struct sockaddr *) &remote_addr,
                 &remote_addrlen);
 
     if (fd == -1) {
@@ -100,7 +125,8 @@ void get_request(int server_sock)
         } else {
             /* no requests */
         }
-        pending_requests = 0;
+        /* the next call goes on to the next one, if any */
+        l->pending = 0;
         return;
     }
     if (fd >= FD_SETSIZE) {
@@ -114,7 +140,8 @@ void get_request(int server_sock)
        the select() and accept() syscalls.
        Code and description by Larry Doolittle <ldoolitt@boa.org>
      */
-    if (remote_addr.sin_family != PF_INET) {
+    if (remote_addr.sin_family != PF_INET &&
+        remote_addr.sin_family != PF_UNIX) {
         struct sockaddr *bogus = (struct sockaddr *) &remote_addr;
         char *ap, ablock[44];
         int i;
@@ -160,6 +187,7 @@ void get_request(int server_sock)
     conn->header_line = conn->client_stream;
     conn->time_last = current_time;
     conn->kacount = ka_max;
+    conn->proxy_protocol = l->proxy_protocol;
 
     if (ascii_sockaddr
         (&salocal, conn->local_ip_addr,
@@ -231,7 +259,7 @@ void get_request(int server_sock)
 
 #ifdef USE_TCPNODELAY
     /* Thanks to Jef Poskanzer <jef@acme.com> for this tweak */
-    {
+    if (l->path == NULL) {
         int one = 1;
         if (setsockopt(conn->fd, IPPROTO_TCP, TCP_NODELAY,
                        (void *) &one, sizeof (one)) == -1) {
@@ -345,9 +373,34 @@ static void free_request(request * req)
 
     if (req->mmap_entry_var)
         release_mmap(req->mmap_entry_var);
+    else if (req->index_entry_var)
+        release_index(req->index_entry_var);
+    else if (req->pack_entry_var)
+        ;                       /* part of the pack, which stays mapped */
+    else if (req->cgi_cache)
+        cgi_cache_forget(req);  /* any data_mem is the entry's */
     else if (req->data_mem)
         munmap(req->data_mem, req->filesize);
 
+    if (req->direct_buf)
+        free(req->direct_buf);
+    if (req->stream_file)
+        stream_done(req);
+    if (req->cgi_gzip)
+        cgi_gzip_free(req);
+    if (req->tcl_response)
+        tcl_forget(req);
+
+    if (req->fcgi_conn) {
+        BOA_FD_CLR(req, req->data_fd, BOA_WRITE);
+        fcgi_abort(req);
+    }
+    if (req->proxy_conn) {
+        BOA_FD_CLR(req, req->data_fd, BOA_WRITE);
+        proxy_abort(req);
+    }
+    cgi_forget(req);
+
     if (req->data_fd) {
         close(req->data_fd);
         BOA_FD_CLR(req, req->data_fd, BOA_READ);
@@ -358,19 +411,13 @@ static void free_request(request * req)
         BOA_FD_CLR(req, req->post_data_fd, BOA_WRITE);
     }
 
+#ifdef USE_IO_THREADS
+    io_job_free(req);
+#endif
+
     if (req->response_status >= 400)
         status.errors++;
 
-    for (i = common_cgi_env_count; i < req->cgi_env_index; ++i) {
-        if (req->cgi_env[i]) {
-            free(req->cgi_env[i]);
-        } else {
-            log_error_time();
-            fprintf(stderr, "Warning: CGI Environment contains NULL value"
-                    "(index %d of %d).\n", i, req->cgi_env_index);
-        }
-    }
-
     if (req->pathname)
         free(req->pathname);
     if (req->path_info)
@@ -453,13 +500,13 @@ static void free_request(request * req)
  * ready list for more processing.
  */
 
-void process_requests(int server_sock)
+void process_requests(void)
 {
     int retval = 0;
     request *current, *trailer;
 
     if (pending_requests) {
-        get_request(server_sock);
+        get_request();
 #ifdef ORIGINAL_BEHAVIOR
         pending_requests = 0;
 #endif
@@ -472,7 +519,7 @@ void process_requests(int server_sock)
         retval = 1;             /* emulate "success" in case we don't have to flush */
 
         if (current->buffer_end && /* there is data in the buffer */
-            current->status < TIMED_OUT) {
+            current->status < TIMED_OUT && !COALESCE_HEADERS(current)) {
             retval = req_flush(current);
             /*
              * retval can be -2=error, -1=blocked, or bytes left
@@ -512,6 +559,17 @@ void process_requests(int server_sock)
             case PIPE_WRITE:
                 retval = write_from_pipe(current);
                 break;
+            case FCGI_WRITE:
+            case FCGI_WAIT:
+                retval = fcgi_write(current);
+                break;
+            case PROXY_WRITE:
+                retval = proxy_write(current);
+                break;
+            case CGI_WAIT:
+            case CGI_CACHE_WAIT:
+                retval = cgi_resume(current);
+                break;
             case IOSHUFFLE:
 #ifdef HAVE_SENDFILE
                 retval = io_shuffle_sendfile(current);
@@ -519,6 +577,11 @@ void process_requests(int server_sock)
                 retval = io_shuffle(current);
 #endif
                 break;
+#ifdef USE_IO_THREADS
+            case FILE_WAIT:
+                retval = io_resume(current);
+                break;
+#endif
             case DONE:
                 /* a non-status that will terminate the request */
                 retval = req_flush(current);
@@ -556,7 +619,7 @@ void process_requests(int server_sock)
          * current->next is valid!
          */
         if (pending_requests)
-            get_request(server_sock);
+            get_request();
 
         switch (retval) {
         case -1:               /* request blocked */
@@ -599,7 +662,7 @@ int process_logline(request * req)
 {
     char *stop, *stop2;
 
-    req->logline = req->client_stream;
+    req->logline = req->header_line;
 
     if (strlen(req->logline) < 5) {
         /* minimum length req'd. */
@@ -918,12 +981,12 @@ int process_option_line(request * req)
 
     switch (line[0]) {
     case 'A':
-        if (!memcmp(line, "ACCEPT", 7)) {
 #ifdef ACCEPT_ON
+        if (!memcmp(line, "ACCEPT", 7)) {
             add_accept_header(req, value);
-#endif
             return 1;
         }
+#endif
         break;
     case 'C':
         if (!memcmp(line, "CONTENT_TYPE", 13) && !req->content_type) {
@@ -951,6 +1014,17 @@ int process_option_line(request * req)
             && !req->if_modified_since) {
             req->if_modified_since = value;
             return 1;
+        } else if (!memcmp(line, "IF_UNMODIFIED_SINCE", 20)
+                   && !req->if_unmodified_since) {
+            req->if_unmodified_since = value;
+            return 1;
+        } else if (!memcmp(line, "IF_NONE_MATCH", 14)
+                   && !req->if_none_match) {
+            req->if_none_match = value;
+            return 1;
+        } else if (!memcmp(line, "IF_RANGE", 9) && !req->header_ifrange) {
+            req->header_ifrange = value;
+            return 1;
         }
         break;
     case 'R':
@@ -1022,6 +1096,7 @@ void free_requests(void) {
     ptr = request_free;
     while (ptr != NULL) {
         next = ptr->next;
+        free(ptr->cgi_env_arena);
         free(ptr);
         ptr = next;
     }
@@ -0,0 +1,276 @@
+/*
+ *  Boa, an http server
+ *  Copyright (C) 1999-2005 Larry Doolittle <ldoolitt@boa.org>
+ *  Copyright (C) 2000-2005 Jon Nelson <jnelson@boa.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 1, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/* $Id$*/
+
+/*
+ * Document opens relative to the root they were translated under.
+ *
+ * translate_uri notes in req->root_len how much of req->pathname is
+ * the DocumentRoot, Alias, VHostRoot or UserDir directory.  Each such
+ * directory is opened once and kept in root_list, and documents are
+ * then opened with openat(2) on the rest of the path, so the kernel
+ * no longer walks the whole path from / on every request.
+ *
+ * With ResolveBeneath, openat2(2) and RESOLVE_BENEATH are used
+ * instead, so that neither ".." nor a symlink can take a request
+ * outside its root.
+ *
+ * A root is stat()ed at most once a second to see whether it is still
+ * the same directory (deploying by switching a symlink is common).
+ * When it changed, or its slot is wanted for another root, its fd is
+ * closed.  An io thread never uses these fds itself: io_submit_open
+ * gives it a dup() of its own.
+ */
+
+#include "boa.h"
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#ifdef SYS_openat2
+#include <linux/openat2.h>
+#endif
+#endif
+
+#ifndef O_DIRECTORY
+#define O_DIRECTORY 0
+#endif
+
+struct root_entry {
+    char *root;                 /* malloced, NULL if the slot is free */
+    unsigned int len;
+    int fd;
+    dev_t dev;
+    ino_t ino;
+    time_t checked;
+};
+
+static struct root_entry root_list[ROOT_CACHE_SIZE];
+
+static unsigned long root_hits = 0, root_opens = 0;
+
+static unsigned int root_hash(const char *str, unsigned int len)
+{
+    unsigned int hash = 2166136261U;
+
+    while (len--) {
+        hash ^= (unsigned char) *str++;
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
+static void root_retire(struct root_entry *e)
+{
+    if (e->fd != -1)
+        close(e->fd);
+    e->fd = -1;
+}
+
+/*
+ * Name: root_open
+ * Description: (Re)opens the root directory for slot e.
+ *
+ * Return values: the fd, or -1
+ */
+
+static int root_open(struct root_entry *e)
+{
+    struct stat statbuf;
+    int fd;
+
+    fd = open(e->root, O_RDONLY | O_DIRECTORY);
+    if (fd == -1)
+        return -1;
+    if (fstat(fd, &statbuf) == -1 || !S_ISDIR(statbuf.st_mode) ||
+        fcntl(fd, F_SETFD, 1) == -1) {
+        close(fd);
+        return -1;
+    }
+    root_opens++;
+    e->fd = fd;
+    e->dev = statbuf.st_dev;
+    e->ino = statbuf.st_ino;
+    e->checked = current_time;
+    return fd;
+}
+
+/*
+ * Name: root_fd
+ * Description: Finds (or opens) the directory root[0..len).
+ *
+ * Return values: a directory fd, or -1
+ */
+
+static int root_fd(const char *root, unsigned int len)
+{
+    struct root_entry *e;
+    struct stat statbuf;
+
+    e = root_list + (root_hash(root, len) & ROOT_CACHE_MASK);
+    if (e->root && e->len == len && !memcmp(e->root, root, len)) {
+        if (e->fd == -1)
+            return root_open(e);
+        if (e->checked != current_time) {
+            if (stat(e->root, &statbuf) == -1 ||
+                statbuf.st_dev != e->dev || statbuf.st_ino != e->ino) {
+                root_retire(e);
+                return root_open(e);
+            }
+            e->checked = current_time;
+        }
+        root_hits++;
+        return e->fd;
+    }
+
+    if (e->root) {
+        root_retire(e);
+        free(e->root);
+    } else
+        e->fd = -1;
+    e->root = malloc(len + 1);
+    if (e->root == NULL)
+        return -1;
+    memcpy(e->root, root, len);
+    e->root[len] = '\0';
+    e->len = len;
+    return root_open(e);
+}
+
+/*
+ * Name: doc_root_fd
+ * Description: If path lies under the root req was translated under,
+ * returns that root's directory fd, and in *rel the rest of path.
+ * Only called from the main thread.
+ *
+ * Return values: a directory fd, -1 (path should be opened as is), or
+ * ROOT_FD_NONE if the root could not be opened and ResolveBeneath is
+ * on (path must not be opened at all)
+ */
+
+int doc_root_fd(request * req, const char *path, const char **rel)
+{
+    unsigned int len = req->root_len;
+    const char *p;
+    int fd;
+
+    if (len == 0 || req->pathname == NULL ||
+        strncmp(path, req->pathname, len) != 0)
+        return -1;
+    /* the root must end on a component boundary */
+    if (path[len] != '/' && path[len] != '\0' && path[len - 1] != '/')
+        return -1;
+
+    for (p = path + len; *p == '/'; ++p);
+    *rel = (*p ? p : ".");
+    fd = root_fd(path, len);
+    if (fd == -1 && resolve_beneath)
+        return ROOT_FD_NONE;
+    return fd;
+}
+
+/*
+ * Name: doc_openat
+ * Description: Opens rel read-only under dirfd, or path if dirfd is
+ * -1.  Fails with EXDEV if dirfd is ROOT_FD_NONE.  Safe to call from
+ * an io thread.
+ */
+
+int doc_openat(int dirfd, const char *rel, const char *path)
+{
+#ifdef SYS_openat2
+    static int no_openat2 = 0;
+#endif
+
+    if (dirfd == ROOT_FD_NONE) {
+        errno = EXDEV;
+        return -1;
+    }
+    if (dirfd == -1)
+        return open(path, O_RDONLY);
+
+#ifdef SYS_openat2
+    if (resolve_beneath && !no_openat2) {
+        struct open_how how;
+        int fd;
+
+        memset(&how, 0, sizeof (how));
+        how.flags = O_RDONLY;
+        how.resolve = RESOLVE_BENEATH;
+        fd = syscall(SYS_openat2, dirfd, rel, &how, sizeof (how));
+        if (fd != -1 || errno != ENOSYS)
+            return fd;
+        no_openat2 = 1;         /* old kernel; a benign race */
+    }
+#endif
+    return openat(dirfd, rel, O_RDONLY);
+}
+
+/*
+ * Name: doc_open
+ * Description: open(path, O_RDONLY), relative to req's root if path
+ * is under it.
+ */
+
+int doc_open(request * req, const char *path)
+{
+    const char *rel = NULL;
+    int dirfd = doc_root_fd(req, path, &rel);
+
+    return doc_openat(dirfd, rel, path);
+}
+
+/*
+ * Name: resolve_init
+ * Description: Called at startup.  Warns if ResolveBeneath was asked
+ * for where it can't be had.
+ */
+
+void resolve_init(void)
+{
+    if (!resolve_beneath)
+        return;
+#ifdef SYS_openat2
+    {
+        struct open_how how;
+        int fd;
+
+        memset(&how, 0, sizeof (how));
+        how.flags = O_RDONLY;
+        how.resolve = RESOLVE_BENEATH;
+        fd = syscall(SYS_openat2, AT_FDCWD, ".", &how, sizeof (how));
+        if (fd != -1)
+            close(fd);
+        if (fd != -1 || errno != ENOSYS)
+            return;
+    }
+#endif
+    log_error_time();
+    fputs("ResolveBeneath: openat2 not available, symlinks "
+          "and .. are not confined to the document root\n", stderr);
+}
+
+void resolve_show_stats(void)
+{
+    log_error_time();
+    fprintf(stderr, "root directories: %lu hits, %lu opens\n",
+            root_hits, root_opens);
+}
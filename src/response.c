@@ -44,19 +44,40 @@ const char *http_ver_string(enum HTTP_VERSION ver)
     return NULL;
 }
 
+/*
+ * Name: document_type
+ * Description: The MIME type to send for req, and in *charset, the
+ * charset to add to it (NULL for none).
+ */
+const char *document_type(request * req, const char **charset)
+{
+    /* in-process directory listings have no extension to go by,
+     * and the pack knows the type of what is in it
+     */
+    const char *mime_type = (req->index_entry_var ? "text/html" :
+                             req->pack_entry_var ?
+                             pack_mime(req->pack_entry_var) :
+                             get_mime_type(req->request_uri));
+
+    *charset = NULL;
+    if (mime_type != NULL && default_charset != NULL &&
+        strncasecmp(mime_type, "text", 4) == 0)
+        *charset = default_charset;
+    return mime_type;
+}
+
 void print_content_type(request * req)
 {
-    char * mime_type = get_mime_type(req->request_uri);
+    const char *charset;
+    const char *mime_type = document_type(req, &charset);
 
     if (mime_type != NULL) {
         req_write(req, "Content-Type: ");
         req_write(req, mime_type);
-        if (default_charset != NULL &&
-            strncasecmp( mime_type, "text", 4)==0) {
-
+        if (charset != NULL) {
             /* add default charset */
             req_write( req, "; charset=");
-            req_write( req, default_charset);
+            req_write( req, charset);
         }
         req_write(req, CRLF);
     }
@@ -77,6 +98,15 @@ void print_last_modified(request * req)
     req_write(req, lm);
 }
 
+void print_etag(request * req)
+{
+    if (req->etag[0]) {
+        req_write(req, "ETag: ");
+        req_write(req, req->etag);
+        req_write(req, CRLF);
+    }
+}
+
 void print_ka_phrase(request * req)
 {
     if (req->kacount > 0 &&
@@ -118,22 +148,69 @@ void print_content_range(request * req)
     req_write(req, CRLF);
 }
 
-void print_partial_content_continue(request * req)
-{
-    static char msg[] = CRLF "--THIS_STRING_SEPARATES" CRLF;
+#define BOUNDARY "THIS_STRING_SEPARATES"
 
-    if (req->numranges > 1) {
-        req_write(req, msg);
+/*
+ * Name: multipart_header
+ * Description: Formats into buf what precedes range r in a
+ * multipart/byteranges body: the boundary, Content-Type and
+ * Content-Range.  With r NULL, the closing boundary instead.
+ * Everything that goes into such a body comes from here, so that
+ * multipart_length is right.
+ *
+ * Return values: the length of the string in buf
+ */
+int multipart_header(request * req, Range * r, char *buf, unsigned int len)
+{
+    const char *charset;
+    const char *mime_type;
+    int n;
+
+    if (r == NULL)
+        n = snprintf(buf, len, CRLF "--" BOUNDARY "--" CRLF);
+    else {
+        mime_type = document_type(req, &charset);
+        n = snprintf(buf, len, CRLF "--" BOUNDARY CRLF
+                     "Content-Type: %s%s%s" CRLF
+                     "Content-Range: bytes %lld-%lld/%lld" CRLF CRLF,
+                     mime_type ? mime_type : "",
+                     charset ? "; charset=" : "",
+                     charset ? charset : "",
+                     (long long) r->start, (long long) r->stop,
+                     (long long) req->filesize);
+    }
+    if (n < 0 || (unsigned) n >= len) {
+        /* MULTIPART_HEADER_SIZE is well above any sane MIME type */
+        buf[0] = '\0';
+        return 0;
     }
-    print_content_type(req);
-    print_content_range(req);
+    return n;
 }
 
-void print_partial_content_done(request * req)
+/*
+ * Name: multipart_length
+ * Description: The Content-Length of the multipart/byteranges body
+ * for req->ranges.
+ */
+static off_t multipart_length(request * req)
 {
-    static char msg[] = CRLF "--THIS_STRING_SEPARATES--" CRLF;
+    char buf[MULTIPART_HEADER_SIZE];
+    off_t total;
+    Range *r;
 
-    req_write(req, msg);
+    total = multipart_header(req, NULL, buf, sizeof (buf));
+    for (r = req->ranges; r; r = r->next)
+        total += multipart_header(req, r, buf, sizeof (buf)) +
+            (r->stop - r->start + 1);
+    return total;
+}
+
+static void print_multipart_header(request * req, Range * r)
+{
+    char buf[MULTIPART_HEADER_SIZE];
+
+    multipart_header(req, r, buf, sizeof (buf));
+    req_write(req, buf);
 }
 
 /* The routines above are only called by the routines below.
@@ -150,12 +227,10 @@ int complete_response(request *req)
     range_pool_push(r);
 
     /* successfully flushed */
-    if (req->response_status == R_PARTIAL_CONTENT && req->numranges > 1) {
-        if (req->ranges != NULL) {
-            print_partial_content_continue(req);
-            req_write(req, CRLF);
-        } else {
-            print_partial_content_done(req);
+    if (req->response_status == R_PARTIAL_CONTENT && req->numranges > 1 &&
+        req->method != M_HEAD) {
+        print_multipart_header(req, req->ranges);
+        if (req->ranges == NULL) {
             req->status = DONE;
             req_flush(req);
         }
@@ -195,6 +270,8 @@ void send_r_request_ok(request * req)
     if (!req->cgi_type) {
         print_content_length(req);
         print_last_modified(req);
+        print_etag(req);
+        print_cache_control(req);
         print_content_type(req);
         req_write(req, CRLF);
     }
@@ -224,7 +301,7 @@ void send_r_partial_content(request * req)
 {
     static char msg[] = " 206 Partial Content" CRLF;
     static char msg2[] = "Content-Type: multipart/byteranges; "
-        "boundary=THIS_STRING_SEPARATES" CRLF;
+        "boundary=" BOUNDARY CRLF;
 
     req->response_status = R_PARTIAL_CONTENT;
 #if 0
@@ -239,16 +316,23 @@ void send_r_partial_content(request * req)
     req_write(req, msg);
     print_http_headers(req);
     print_last_modified(req);
+    print_etag(req);
+    print_cache_control(req);
     if (req->numranges > 1) {
         req_write(req, msg2);
-        req_write(req, CRLF);
+        req_write(req, "Content-Length: ");
+        req_write(req, simple_itoa(multipart_length(req)));
+        req_write(req, CRLF CRLF);
+        if (req->method != M_HEAD)
+            print_multipart_header(req, req->ranges);
     } else {
         req_write(req, "Content-Length: ");
         req_write(req, simple_itoa(req->ranges->stop - req->ranges->start + 1));
         req_write(req, CRLF);
+        print_content_type(req);
+        print_content_range(req);
+        req_write(req, CRLF);
     }
-    print_partial_content_continue(req);
-    req_write(req, CRLF);
 }
 
 
@@ -309,11 +393,13 @@ void send_r_moved_temp(request * req, const char *url, const char *more_hdr)
 /* R_NOT_MODIFIED: 304 */
 void send_r_not_modified(request * req)
 {
-    SQUASH_KA(req);
+    /* a 304 never has a body, so the connection can be kept alive */
     req->response_status = R_NOT_MODIFIED;
     req_write(req, http_ver_string(req->http_version));
     req_write(req, " 304 Not Modified" CRLF);
     print_http_headers(req);
+    print_etag(req);
+    print_cache_control(req);
     print_content_type(req);
     req_write(req, CRLF);
     req_flush(req);
@@ -385,15 +471,43 @@ void send_r_forbidden(request * req)
 }
 
 /* R_NOT_FOUND: 404 */
+/*
+ * Name: not_found_header
+ * Description: Everything after the version in a 404 header is the
+ * same for every request within a second (keep-alive is always off),
+ * so it is put together once a second rather than piece by piece.
+ */
+static const char *not_found_header(void)
+{
+    static char buf[256];
+    static time_t built = 0;
+    static int built_conceal = -1;
+    char date[30];
+
+    if (built != current_time ||
+        built_conceal != conceal_server_identity) {
+        rfc822_time_buf(date, 0);
+        date[29] = '\0';
+        snprintf(buf, sizeof (buf), " 404 Not Found" CRLF
+                 "Date: %s" CRLF "%s"
+                 "Accept-Ranges: bytes" CRLF
+                 "Connection: close" CRLF
+                 "Content-Type: " HTML CRLF CRLF,
+                 date, conceal_server_identity ? "" :
+                 "Server: " SERVER_VERSION CRLF);
+        built = current_time;
+        built_conceal = conceal_server_identity;
+    }
+    return buf;
+}
+
 void send_r_not_found(request * req)
 {
     SQUASH_KA(req);
     req->response_status = R_NOT_FOUND;
     if (req->http_version != HTTP09) {
         req_write(req, http_ver_string(req->http_version));
-        req_write(req, " 404 Not Found" CRLF);
-        print_http_headers(req);
-        req_write(req, "Content-Type: " HTML CRLF CRLF); /* terminate header */
+        req_write(req, not_found_header()); /* terminates the header */
     }
     if (req->method != M_HEAD) {
         req_write(req, "<HTML><HEAD><TITLE>404 Not Found</TITLE></HEAD>\n"
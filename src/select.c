@@ -43,8 +43,10 @@ fd_set block_read_fdset;
 fd_set block_write_fdset;
 int max_fd = 0;
 
-void loop(int server_s)
+void loop(void)
 {
+    struct listener *l;
+
     FD_ZERO(BOA_READ);
     FD_ZERO(BOA_WRITE);
 
@@ -58,6 +60,7 @@ void loop(int server_s)
             sigchld_run();
         if (sigalrm_flag)
             sigalrm_run();
+        cgi_watchdog();
 
         if (sigterm_flag) {
             /* sigterm_flag:
@@ -66,22 +69,32 @@ void loop(int server_s)
              */
             if (sigterm_flag == 1) {
                 sigterm_stage1_run();
-                BOA_FD_CLR(req, server_s, BOA_READ);
-                close(server_s);
                 /* make sure the server isn't in the block list */
-                server_s = -1;
+                for (l = listeners; l; l = l->next)
+                    BOA_FD_CLR(req, l->fd, BOA_READ);
+                listen_close();
             }
             if (sigterm_flag == 2 && !request_ready && !request_block) {
                 sigterm_stage2_run(); /* terminal */
             }
         } else {
-            if (total_connections > max_connections) {
-                /* FIXME: for poll we don't subtract 20. why? */
-                BOA_FD_CLR(req, server_s, BOA_READ);
-            } else {
-                BOA_FD_SET(req, server_s, BOA_READ); /* server always set */
+            for (l = listeners; l; l = l->next) {
+                if (total_connections > max_connections) {
+                    /* FIXME: for poll we don't subtract 20. why? */
+                    BOA_FD_CLR(req, l->fd, BOA_READ);
+                } else {
+                    BOA_FD_SET(req, l->fd, BOA_READ); /* server always set */
+                }
             }
         }
+#ifdef USE_IO_THREADS
+        if (io_notify_fd != -1)
+            BOA_FD_SET(req, io_notify_fd, BOA_READ);
+#endif
+        if (negative_notify_fd != -1)
+            BOA_FD_SET(req, negative_notify_fd, BOA_READ);
+        if (signal_fd != -1)
+            BOA_FD_SET(req, signal_fd, BOA_READ);
 
         pending_requests = 0;
         /* max_fd is > 0 when something is blocked */
@@ -91,10 +104,13 @@ void loop(int server_s)
 
             req_timeout.tv_sec = (request_ready ? 0 : default_timeout);
             req_timeout.tv_usec = 0l; /* reset timeout */
+            /* cgi_watchdog wants to look once a second */
+            if (req_timeout.tv_sec > 1 && cgi_watching())
+                req_timeout.tv_sec = 1;
 
             if (select(max_fd + 1, BOA_READ,
                        BOA_WRITE, NULL,
-                       (request_ready || request_block ?
+                       (request_ready || request_block || cgi_watching() ?
                         &req_timeout : NULL)) == -1) {
                 /* what is the appropriate thing to do here on EBADF */
                 if (errno == EINTR)
@@ -107,9 +123,21 @@ void loop(int server_s)
              * Thus avoiding many operations in fdset_update
              * and others.
              */
-            if (!sigterm_flag && FD_ISSET(server_s, BOA_READ)) {
-                pending_requests = 1;
+            for (l = listeners; l && !sigterm_flag; l = l->next) {
+                if (FD_ISSET(l->fd, BOA_READ)) {
+                    l->pending = 1;
+                    pending_requests = 1;
+                }
             }
+#ifdef USE_IO_THREADS
+            if (io_notify_fd != -1 && FD_ISSET(io_notify_fd, BOA_READ))
+                io_pool_collect();
+#endif
+            if (negative_notify_fd != -1 &&
+                FD_ISSET(negative_notify_fd, BOA_READ))
+                negative_collect();
+            if (signal_fd != -1 && FD_ISSET(signal_fd, BOA_READ))
+                signal_collect();
             time(&current_time); /* for "new" requests if we've been in
             * select too long */
             /* if we skip this section (for example, if max_fd == 0),
@@ -128,7 +156,7 @@ void loop(int server_s)
 
         /* any blocked req's move from request_ready to request_block */
         if (pending_requests || request_ready) {
-            process_requests(server_s);
+            process_requests();
         }
     }
 }
@@ -158,6 +186,15 @@ static void fdset_update(void)
         time_t time_since = current_time - current->time_last;
         next = current->next;
 
+        /* parked on an io thread: no fd, and no timeout, since the
+         * request must not go away while the thread is using it;
+         * waiting for a CGI slot or a FastCGI server: cgi_watchdog
+         * times it out;
+         * waiting for a cached CGI: its filler times out, if anything */
+        if (current->status == FILE_WAIT || current->status == CGI_WAIT ||
+            current->status == CGI_CACHE_WAIT || current->status == FCGI_WAIT)
+            continue;
+
         /* hmm, what if we are in "the middle" of a request and not
          * just waiting for a new one... perhaps check to see if anything
          * has been read via header position, etc... */
@@ -213,6 +250,15 @@ static void fdset_update(void)
                                BOA_READ);
                 }
                 break;
+            case FCGI_WRITE:
+            case PROXY_WRITE:
+                if (FD_ISSET(current->data_fd, BOA_WRITE))
+                    ready_request(current);
+                else {
+                    BOA_FD_SET(current, current->data_fd,
+                               BOA_WRITE);
+                }
+                break;
             case DONE:
                 if (FD_ISSET(current->fd, BOA_WRITE))
                     ready_request(current);
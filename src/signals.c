@@ -28,9 +28,9 @@
 #include <sys/wait.h>           /* wait */
 #endif
 #include <signal.h>             /* signal */
-
-sigjmp_buf env;
-int handle_sigbus;
+#ifdef __linux__
+#include <sys/signalfd.h>       /* signalfd */
+#endif
 
 void sigsegv(int);
 void sigbus(int);
@@ -40,6 +40,10 @@ void sigint(int);
 void sigchld(int);
 void sigalrm(int);
 
+/* with signalfd, SIGTERM, SIGHUP, SIGCHLD and SIGALRM are blocked and
+ * read from here by the main loop, rather than interrupting it */
+int signal_fd = -1;
+
 /*
  * Name: init_signals
  * Description: Sets up signal handlers for all our friends.
@@ -92,8 +96,69 @@ void init_signals(void)
 
     sa.sa_handler = SIG_IGN;
     sigaction(SIGUSR2, &sa, NULL);
+
+#ifdef SFD_NONBLOCK
+    {
+        sigset_t events;
+
+        sigemptyset(&events);
+        sigaddset(&events, SIGTERM);
+        sigaddset(&events, SIGHUP);
+        sigaddset(&events, SIGCHLD);
+        sigaddset(&events, SIGALRM);
+        signal_fd = signalfd(-1, &events, SFD_NONBLOCK | SFD_CLOEXEC);
+        if (signal_fd == -1) {
+            log_error_time();
+            perror("signalfd (the handlers will do)");
+        } else {
+            /* before any threads start, so that they have them
+             * blocked too, and leave them to signal_fd */
+            sigprocmask(SIG_BLOCK, &events, NULL);
+        }
+    }
+#endif
+}
+
+/*
+ * Name: signal_collect
+ * Description: Called from the main loop when signal_fd is readable.
+ * Sets the flags the handlers would have; the loop acts on them as
+ * it always has.
+ */
+
+void signal_collect(void)
+{
+#ifdef SFD_NONBLOCK
+    struct signalfd_siginfo si[8];
+    int n, i;
+
+    while ((n = read(signal_fd, si, sizeof (si))) > 0) {
+        for (i = 0; i < n / (int) sizeof (si[0]); ++i) {
+            switch (si[i].ssi_signo) {
+            case SIGTERM:
+                sigterm(SIGTERM);
+                break;
+            case SIGHUP:
+                sighup(SIGHUP);
+                break;
+            case SIGCHLD:
+                sigchld(SIGCHLD);
+                break;
+            case SIGALRM:
+                sigalrm(SIGALRM);
+                break;
+            }
+        }
+    }
+#endif
 }
 
+/*
+ * Name: reset_signals
+ * Description: For a child about to exec: default handlers, and no
+ * signals blocked.
+ */
+
 void reset_signals(void)
 {
     struct sigaction sa;
@@ -123,6 +188,9 @@ void reset_signals(void)
     sigaction(SIGALRM, &sa, NULL);
     sigaction(SIGUSR1, &sa, NULL);
     sigaction(SIGUSR2, &sa, NULL);
+
+    sigemptyset(&sa.sa_mask);
+    sigprocmask(SIG_SETMASK, &sa.sa_mask, NULL);
 }
 
 void sigsegv(int dummy)
@@ -134,14 +202,10 @@ void sigsegv(int dummy)
     abort();
 }
 
-extern sigjmp_buf env;
-extern int handle_sigbus;
-
+/* mmapped files are only ever read by the kernel (see process_get),
+ * so a SIGBUS is a bug like any other */
 void sigbus(int dummy)
 {
-    if (handle_sigbus) {
-        longjmp(env, dummy);
-    }
     time(&current_time);
     log_error_time();
     fprintf(stderr, "caught SIGBUS, dumping core in %s\n", tempdir);
@@ -174,6 +238,8 @@ void sigterm_stage2_run(void)
     dump_mime();
     dump_passwd();
     dump_alias();
+    dump_cache_policies();
+    fcgi_stop();
     free_requests();
     range_pool_empty();
     free(server_root);
@@ -208,6 +274,10 @@ void sighup_run(void)
     dump_mime();
     dump_passwd();
     dump_alias();
+    dump_cache_policies();
+    dump_cgi_cache();
+    dump_cgi_gzip();
+    dump_tcl();
     free_requests();
     range_pool_empty();
 
@@ -240,13 +310,16 @@ void sigchld_run(void)
 
     sigchld_flag = 0;
 
-    while ((pid = waitpid(-1, &child_status, WNOHANG)) > 0)
+    while ((pid = waitpid(-1, &child_status, WNOHANG)) > 0) {
         if (verbose_cgi_logs) {
             time(&current_time);
             log_error_time();
             fprintf(stderr, "reaping child %d: status %d\n", (int) pid,
                     child_status);
         }
+        cgi_reaped(pid, child_status);
+        fcgi_reaped(pid);
+    }
     return;
 }
 
@@ -262,5 +335,10 @@ void sigalrm_run(void)
     fprintf(stderr, "%ld requests, %ld errors\n",
             status.requests, status.errors);
     hash_show_stats();
+    resolve_show_stats();
+    negative_show_stats();
+#ifdef USE_IO_THREADS
+    io_pool_show_stats();
+#endif
     sigalrm_flag = 0;
 }
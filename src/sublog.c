@@ -21,6 +21,7 @@
 
 /* $Id: sublog.c,v 1.6.2.6 2005/02/22 14:11:29 jnelson Exp $*/
 
+#include "config.h"
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -0,0 +1,668 @@
+/*
+ *  Boa, an http server
+ *  Copyright (C) 1999-2005 Larry Doolittle <ldoolitt@boa.org>
+ *  Copyright (C) 2000-2005 Jon Nelson <jnelson@boa.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 1, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/* $Id$*/
+
+/*
+ * Tcl scripts run inside the server (TclAlias, TclMaxCommands).
+ *
+ * A TclAlias is a ScriptAlias whose scripts are not forked and exec'd
+ * but run by a Tcl interpreter in the server, for small glue scripts
+ * where starting a process is most of the work.  init_script_alias
+ * finds the script and sets up path_info and the rest as for a CGI;
+ * cgi_start hands it to tcl_run once the CGI variables are made.
+ *
+ * Each script becomes a proc the first time it is asked for, so Tcl
+ * compiles it to bytecode once and keeps that, until the file
+ * changes.  The scripts share one safe interpreter (see Tcl's
+ * interp(n)), a child of an otherwise unused one: they have Tcl's
+ * safe core and the boa:: commands, but no exec, open, socket, cd,
+ * source or load, so they can neither touch files nor fork the
+ * server.  exit, vwait, update and after are taken away too.
+ *
+ * A script runs to the end there and then, in the main loop.
+ * TclMaxCommands and TclMaxTime stop one that loops; both are looked
+ * at between commands, so one command that takes long on its own
+ * (string repeat with a huge count, say) still holds the server up
+ * until it is done.
+ *
+ * The script talks to the request through the boa namespace:
+ *   boa::env name ?default?     a CGI variable
+ *   boa::post                   the POST data
+ *   boa::status code ?reason?
+ *   boa::header name value
+ *   boa::write string
+ * What it leaves is made into a CGI's output, which tcl_read gives
+ * read_from_pipe as if from a pipe, so the header is handled, and
+ * CGICache and CGIGzip apply, just as for a CGI.
+ *
+ * Tcl is needed; built without it (see Makefile.in), TclAlias is an
+ * error.
+ */
+
+#include "boa.h"
+
+#ifdef HAVE_TCL
+#include <tcl.h>
+
+struct tcl_script {
+    char *pathname;
+    Tcl_Obj *proc;              /* the name of its proc */
+    time_t mtime;
+    off_t size;
+    ino_t ino;
+    struct tcl_script *next;
+};
+
+struct tcl_response {
+    int status;                 /* 0 if the script set none */
+    Tcl_DString reason;
+    Tcl_DString location;
+    Tcl_DString headers;
+    Tcl_DString body;
+    int content_type;           /* the script gave one */
+    Tcl_DString out;            /* all of it, as a CGI would have said */
+    unsigned int out_pos;
+};
+
+static Tcl_Interp *tcl_master = NULL;
+static Tcl_Interp *tcl_interp = NULL;   /* the safe one, scripts run in */
+static Tcl_Obj *tcl_cmdcount = NULL;
+static struct tcl_script *tcl_scripts = NULL;
+static unsigned int tcl_procs = 0;
+
+/* the request the running script is for */
+static request *tcl_req = NULL;
+
+static const struct {
+    int code;
+    const char *reason;
+} tcl_reasons[] = {
+    {200, "OK"}, {201, "Created"}, {202, "Accepted"},
+    {204, "No Content"}, {301, "Moved Permanently"}, {302, "Found"},
+    {303, "See Other"}, {304, "Not Modified"},
+    {307, "Temporary Redirect"}, {400, "Bad Request"},
+    {401, "Unauthorized"}, {403, "Forbidden"}, {404, "Not Found"},
+    {405, "Method Not Allowed"}, {409, "Conflict"}, {410, "Gone"},
+    {500, "Internal Server Error"}, {501, "Not Implemented"},
+    {502, "Bad Gateway"}, {503, "Service Unavailable"},
+    {0, NULL}
+};
+
+static int tcl_bad_text(const char *s)
+{
+    return (strchr(s, '\r') != NULL || strchr(s, '\n') != NULL);
+}
+
+/* boa::env name ?default? */
+static int tcl_env_cmd(ClientData cd, Tcl_Interp * interp, int objc,
+                       Tcl_Obj * const objv[])
+{
+    const char *name;
+    int i, len;
+
+    if (objc != 2 && objc != 3) {
+        Tcl_WrongNumArgs(interp, 1, objv, "name ?default?");
+        return TCL_ERROR;
+    }
+    name = Tcl_GetStringFromObj(objv[1], &len);
+    for (i = 0; i < tcl_req->cgi_env_index; ++i) {
+        const char *e = tcl_req->cgi_env[i];
+
+        if (!strncmp(e, name, len) && e[len] == '=') {
+            Tcl_SetObjResult(interp, Tcl_NewStringObj(e + len + 1, -1));
+            return TCL_OK;
+        }
+    }
+    if (objc == 3)
+        Tcl_SetObjResult(interp, objv[2]);
+    return TCL_OK;
+}
+
+/* boa::post */
+static int tcl_post_cmd(ClientData cd, Tcl_Interp * interp, int objc,
+                        Tcl_Obj * const objv[])
+{
+    Tcl_Obj *data;
+    unsigned char *p;
+    long len;
+    int n, got;
+
+    if (objc != 1) {
+        Tcl_WrongNumArgs(interp, 1, objv, NULL);
+        return TCL_ERROR;
+    }
+    if (tcl_req->method != M_POST || tcl_req->post_data_fd == 0)
+        return TCL_OK;
+
+    len = lseek(tcl_req->post_data_fd, 0, SEEK_END);
+    if (len == -1 || lseek(tcl_req->post_data_fd, 0, SEEK_SET) == -1) {
+        Tcl_SetObjResult(interp, Tcl_NewStringObj(strerror(errno), -1));
+        return TCL_ERROR;
+    }
+    data = Tcl_NewByteArrayObj(NULL, 0);
+    p = Tcl_SetByteArrayLength(data, len);
+    for (got = 0; got < len; got += n) {
+        n = read(tcl_req->post_data_fd, p + got, len - got);
+        if (n == -1 && errno == EINTR) {
+            n = 0;
+            continue;
+        }
+        if (n <= 0)
+            break;
+    }
+    Tcl_SetByteArrayLength(data, got);
+    Tcl_SetObjResult(interp, data);
+    return TCL_OK;
+}
+
+/* boa::status code ?reason? */
+static int tcl_status_cmd(ClientData cd, Tcl_Interp * interp, int objc,
+                          Tcl_Obj * const objv[])
+{
+    struct tcl_response *r = tcl_req->tcl_response;
+    const char *reason = "";
+    int code, i;
+
+    if (objc != 2 && objc != 3) {
+        Tcl_WrongNumArgs(interp, 1, objv, "code ?reason?");
+        return TCL_ERROR;
+    }
+    if (Tcl_GetIntFromObj(interp, objv[1], &code) != TCL_OK)
+        return TCL_ERROR;
+    if (code < 100 || code > 999) {
+        Tcl_SetObjResult(interp, Tcl_NewStringObj("bad status code", -1));
+        return TCL_ERROR;
+    }
+    if (objc == 3) {
+        reason = Tcl_GetString(objv[2]);
+        if (tcl_bad_text(reason)) {
+            Tcl_SetObjResult(interp, Tcl_NewStringObj("bad reason", -1));
+            return TCL_ERROR;
+        }
+    } else {
+        for (i = 0; tcl_reasons[i].code; ++i) {
+            if (tcl_reasons[i].code == code) {
+                reason = tcl_reasons[i].reason;
+                break;
+            }
+        }
+    }
+    r->status = code;
+    Tcl_DStringFree(&r->reason);
+    Tcl_DStringAppend(&r->reason, reason, -1);
+    return TCL_OK;
+}
+
+/* boa::header name value */
+static int tcl_header_cmd(ClientData cd, Tcl_Interp * interp, int objc,
+                          Tcl_Obj * const objv[])
+{
+    struct tcl_response *r = tcl_req->tcl_response;
+    const char *name, *value;
+
+    if (objc != 3) {
+        Tcl_WrongNumArgs(interp, 1, objv, "name value");
+        return TCL_ERROR;
+    }
+    name = Tcl_GetString(objv[1]);
+    value = Tcl_GetString(objv[2]);
+    if (*name == '\0' || strchr(name, ':') || strchr(name, ' ') ||
+        tcl_bad_text(name) || tcl_bad_text(value)) {
+        Tcl_SetObjResult(interp, Tcl_NewStringObj("bad header", -1));
+        return TCL_ERROR;
+    }
+    if (!strcasecmp(name, "Status") || !strcasecmp(name, "Content-Length")) {
+        /* boa::status, and the length is ours to give */
+        Tcl_SetObjResult(interp, Tcl_NewStringObj("header not allowed", -1));
+        return TCL_ERROR;
+    }
+    if (!strcasecmp(name, "Location")) {
+        Tcl_DStringFree(&r->location);
+        Tcl_DStringAppend(&r->location, value, -1);
+        return TCL_OK;
+    }
+    if (!strcasecmp(name, "Content-Type"))
+        r->content_type = 1;
+    Tcl_DStringAppend(&r->headers, name, -1);
+    Tcl_DStringAppend(&r->headers, ": ", 2);
+    Tcl_DStringAppend(&r->headers, value, -1);
+    Tcl_DStringAppend(&r->headers, CRLF, 2);
+    return TCL_OK;
+}
+
+/* boa::write string */
+static int tcl_write_cmd(ClientData cd, Tcl_Interp * interp, int objc,
+                         Tcl_Obj * const objv[])
+{
+    struct tcl_response *r = tcl_req->tcl_response;
+    const char *s;
+    int len;
+
+    if (objc != 2) {
+        Tcl_WrongNumArgs(interp, 1, objv, "string");
+        return TCL_ERROR;
+    }
+    s = Tcl_GetStringFromObj(objv[1], &len);
+    Tcl_DStringAppend(&r->body, s, len);
+    return TCL_OK;
+}
+
+/*
+ * Name: tcl_init
+ * Description: Makes the interpreters, the first time a script is run.
+ *
+ * Return values: 1 on success, 0 if there is no interpreter to be had
+ */
+
+static int tcl_init(void)
+{
+    static int failed = 0;
+
+    if (tcl_interp)
+        return 1;
+    if (failed)
+        return 0;
+
+    Tcl_FindExecutable(NULL);
+    tcl_master = Tcl_CreateInterp();
+    if (tcl_master != NULL)
+        tcl_interp = Tcl_CreateSlave(tcl_master, "boa", 1);
+    if (tcl_interp == NULL) {
+        failed = 1;
+        log_error_time();
+        fputs("unable to make a Tcl interpreter\n", stderr);
+        if (tcl_master != NULL)
+            Tcl_DeleteInterp(tcl_master);
+        tcl_master = NULL;
+        return 0;
+    }
+    /* nothing may leave the main loop, or wait in it */
+    Tcl_Eval(tcl_interp, "foreach c {exit vwait update after} "
+             "{catch {rename $c {}}}; namespace eval ::boa::script {}");
+    Tcl_ResetResult(tcl_interp);
+
+    Tcl_CreateObjCommand(tcl_interp, "::boa::env", tcl_env_cmd, NULL, NULL);
+    Tcl_CreateObjCommand(tcl_interp, "::boa::post", tcl_post_cmd, NULL,
+                         NULL);
+    Tcl_CreateObjCommand(tcl_interp, "::boa::status", tcl_status_cmd, NULL,
+                         NULL);
+    Tcl_CreateObjCommand(tcl_interp, "::boa::header", tcl_header_cmd, NULL,
+                         NULL);
+    Tcl_CreateObjCommand(tcl_interp, "::boa::write", tcl_write_cmd, NULL,
+                         NULL);
+
+    tcl_cmdcount = Tcl_NewStringObj("info cmdcount", -1);
+    Tcl_IncrRefCount(tcl_cmdcount);
+    /* TclMaxTime is looked at after every command */
+    Tcl_LimitSetGranularity(tcl_interp, TCL_LIMIT_TIME, 1);
+    return 1;
+}
+
+/*
+ * Name: tcl_load
+ * Description: Makes the proc for script s, from its file.
+ *
+ * Return values: 1 on success, 0 on failure (logged)
+ */
+
+static int tcl_load(request * req, struct tcl_script *s, int fd,
+                    struct stat *statbuf)
+{
+    Tcl_DString text;
+    Tcl_Obj *objv[4];
+    char *buf;
+    char name[32];
+    off_t got;
+    int n, ret;
+
+    buf = malloc(statbuf->st_size + 1);
+    if (buf == NULL) {
+        boa_perror(req, "malloc for Tcl script");
+        return 0;
+    }
+    for (got = 0; got < statbuf->st_size; got += n) {
+        n = read(fd, buf + got, statbuf->st_size - got);
+        if (n == -1 && errno == EINTR) {
+            n = 0;
+            continue;
+        }
+        if (n <= 0)
+            break;
+    }
+    Tcl_ExternalToUtfDString(NULL, buf, got, &text);
+    free(buf);
+
+    if (s->proc == NULL) {
+        snprintf(name, sizeof (name), "::boa::script::%u", ++tcl_procs);
+        s->proc = Tcl_NewStringObj(name, -1);
+        Tcl_IncrRefCount(s->proc);
+    }
+    objv[0] = Tcl_NewStringObj("proc", 4);
+    objv[1] = s->proc;
+    objv[2] = Tcl_NewObj();
+    objv[3] = Tcl_NewStringObj(Tcl_DStringValue(&text),
+                               Tcl_DStringLength(&text));
+    Tcl_DStringFree(&text);
+    for (n = 0; n < 4; ++n)
+        Tcl_IncrRefCount(objv[n]);
+    ret = Tcl_EvalObjv(tcl_interp, 4, objv, TCL_EVAL_GLOBAL);
+    for (n = 0; n < 4; ++n)
+        Tcl_DecrRefCount(objv[n]);
+    if (ret != TCL_OK) {
+        log_error_doc(req);
+        fprintf(stderr, "Tcl script %s: %s\n", s->pathname,
+                Tcl_GetStringResult(tcl_interp));
+        Tcl_ResetResult(tcl_interp);
+        return 0;
+    }
+
+    s->mtime = statbuf->st_mtime;
+    s->size = statbuf->st_size;
+    s->ino = statbuf->st_ino;
+    return 1;
+}
+
+/*
+ * Name: tcl_script_find
+ * Description: The script for req->pathname, made into a proc again
+ * if the file has changed since it last was.
+ *
+ * Return values: the script, or NULL on failure (logged)
+ */
+
+static struct tcl_script *tcl_script_find(request * req)
+{
+    struct tcl_script *s;
+    struct stat statbuf;
+    int fd;
+
+    fd = open(req->pathname, O_RDONLY);
+    if (fd == -1) {
+        boa_perror(req, "open of Tcl script");
+        return NULL;
+    }
+    if (fstat(fd, &statbuf) == -1) {
+        close(fd);
+        boa_perror(req, "fstat of Tcl script");
+        return NULL;
+    }
+
+    for (s = tcl_scripts; s; s = s->next) {
+        if (!strcmp(s->pathname, req->pathname))
+            break;
+    }
+    if (s && s->mtime == statbuf.st_mtime && s->size == statbuf.st_size &&
+        s->ino == statbuf.st_ino) {
+        close(fd);
+        return s;
+    }
+    if (s == NULL) {
+        s = calloc(1, sizeof (struct tcl_script));
+        if (s == NULL || (s->pathname = strdup(req->pathname)) == NULL) {
+            free(s);
+            close(fd);
+            boa_perror(req, "out of memory for Tcl script");
+            return NULL;
+        }
+        s->next = tcl_scripts;
+        tcl_scripts = s;
+    }
+    if (!tcl_load(req, s, fd, &statbuf)) {
+        s->mtime = 0;           /* try again next time */
+        close(fd);
+        send_r_error(req);
+        return NULL;
+    }
+    close(fd);
+    return s;
+}
+
+static void tcl_response_free(struct tcl_response *r)
+{
+    Tcl_DStringFree(&r->reason);
+    Tcl_DStringFree(&r->location);
+    Tcl_DStringFree(&r->headers);
+    Tcl_DStringFree(&r->body);
+    Tcl_DStringFree(&r->out);
+    free(r);
+}
+
+/*
+ * Name: tcl_compose
+ * Description: Puts what the script left together as a CGI's output:
+ * Status (or else Location) first, as process_cgi_header wants it,
+ * and a Content-Length, since the length is known.
+ */
+
+static void tcl_compose(request * req, struct tcl_response *r)
+{
+    Tcl_DString *out = &r->out;
+    char buf[64];
+
+    if (r->status) {
+        snprintf(buf, sizeof (buf), "Status: %d ", r->status);
+        Tcl_DStringAppend(out, buf, -1);
+        Tcl_DStringAppend(out, Tcl_DStringValue(&r->reason), -1);
+        Tcl_DStringAppend(out, CRLF, 2);
+    }
+    if (Tcl_DStringLength(&r->location)) {
+        Tcl_DStringAppend(out, "Location: ", -1);
+        Tcl_DStringAppend(out, Tcl_DStringValue(&r->location), -1);
+        Tcl_DStringAppend(out, CRLF, 2);
+    }
+    Tcl_DStringAppend(out, Tcl_DStringValue(&r->headers),
+                      Tcl_DStringLength(&r->headers));
+    if (!r->status && Tcl_DStringLength(&r->location)) {
+        /* process_cgi_header makes the redirect, and its body */
+        Tcl_DStringAppend(out, CRLF, 2);
+        Tcl_DStringFree(&r->headers);
+        Tcl_DStringFree(&r->body);
+        return;
+    }
+    if (!r->content_type) {
+        Tcl_DStringAppend(out, "Content-Type: ", -1);
+        Tcl_DStringAppend(out, default_type, -1);
+        Tcl_DStringAppend(out, CRLF, 2);
+    }
+    snprintf(buf, sizeof (buf), "Content-Length: %d" CRLF CRLF,
+             Tcl_DStringLength(&r->body));
+    Tcl_DStringAppend(out, buf, -1);
+    if (req->method != M_HEAD)
+        Tcl_DStringAppend(out, Tcl_DStringValue(&r->body),
+                          Tcl_DStringLength(&r->body));
+    Tcl_DStringFree(&r->headers);
+    Tcl_DStringFree(&r->body);
+}
+
+/*
+ * Name: tcl_run
+ * Description: Called by cgi_start, in place of starting a child, for
+ * a script under a TclAlias.
+ *
+ * Return values:
+ *  0: failed, and answered with an error
+ *  1: the output is there for read_from_pipe (PIPE_READ)
+ */
+
+int tcl_run(request * req)
+{
+    struct tcl_script *s;
+    struct tcl_response *r;
+    Tcl_Time limit;
+    int count = 0, ret, commands, timed;
+
+    if (!tcl_init()) {
+        send_r_error(req);
+        return 0;
+    }
+    s = tcl_script_find(req);
+    if (s == NULL)
+        return 0;
+
+    r = malloc(sizeof (struct tcl_response));
+    if (r == NULL) {
+        boa_perror(req, "malloc for Tcl response");
+        return 0;
+    }
+    r->status = r->content_type = 0;
+    r->out_pos = 0;
+    Tcl_DStringInit(&r->reason);
+    Tcl_DStringInit(&r->location);
+    Tcl_DStringInit(&r->headers);
+    Tcl_DStringInit(&r->body);
+    Tcl_DStringInit(&r->out);
+    req->tcl_response = r;
+
+    /* the limit is on the interpreter's count, which goes on rising */
+    if (Tcl_EvalObjEx(tcl_interp, tcl_cmdcount, 0) == TCL_OK)
+        Tcl_GetIntFromObj(NULL, Tcl_GetObjResult(tcl_interp), &count);
+    Tcl_LimitSetCommands(tcl_interp, count + tcl_max_commands);
+    Tcl_GetTime(&limit);
+    limit.sec += tcl_max_time / 1000;
+    limit.usec += (tcl_max_time % 1000) * 1000;
+    if (limit.usec >= 1000000) {
+        limit.sec++;
+        limit.usec -= 1000000;
+    }
+    Tcl_LimitSetTime(tcl_interp, &limit);
+    Tcl_LimitTypeSet(tcl_interp, TCL_LIMIT_COMMANDS | TCL_LIMIT_TIME);
+
+    tcl_req = req;
+    ret = Tcl_EvalObjv(tcl_interp, 1, &s->proc, TCL_EVAL_GLOBAL);
+    tcl_req = NULL;
+    commands = Tcl_LimitTypeExceeded(tcl_interp, TCL_LIMIT_COMMANDS);
+    timed = Tcl_LimitTypeExceeded(tcl_interp, TCL_LIMIT_TIME);
+    /* which also lets the interpreter run again, if a limit was hit */
+    Tcl_LimitTypeReset(tcl_interp, TCL_LIMIT_COMMANDS | TCL_LIMIT_TIME);
+
+    if (ret != TCL_OK) {
+        log_error_doc(req);
+        if (commands || timed)
+            fprintf(stderr, "Tcl script %s ran past %s\n", req->pathname,
+                    commands ? "TclMaxCommands" : "TclMaxTime");
+        else
+            fprintf(stderr, "Tcl script %s: %s\n", req->pathname,
+                    Tcl_GetVar(tcl_interp, "errorInfo", TCL_GLOBAL_ONLY));
+        Tcl_ResetResult(tcl_interp);
+        cgi_cache_failed(req);
+        send_r_error(req);
+        return 0;
+    }
+    Tcl_ResetResult(tcl_interp);
+
+    tcl_compose(req, r);
+    req->status = PIPE_READ;
+    req->cgi_status = CGI_PARSE;
+    /* as for a CGI pipe: the top half of the buffer */
+    req->header_line = req->header_end = (req->buffer + BUFFER_SIZE / 2);
+    req->filepos = 0;
+    return 1;
+}
+
+/*
+ * Name: tcl_read
+ * Description: read_from_pipe's read, for a script's output.
+ *
+ * Return values: bytes copied to buf; 0 at the end
+ */
+
+int tcl_read(request * req, char *buf, unsigned int len)
+{
+    struct tcl_response *r = req->tcl_response;
+    unsigned int left = Tcl_DStringLength(&r->out) - r->out_pos;
+
+    if (len > left)
+        len = left;
+    memcpy(buf, Tcl_DStringValue(&r->out) + r->out_pos, len);
+    r->out_pos += len;
+    return len;
+}
+
+/*
+ * Name: tcl_forget
+ * Description: Called by free_request.
+ */
+
+void tcl_forget(request * req)
+{
+    tcl_response_free(req->tcl_response);
+    req->tcl_response = NULL;
+}
+
+/*
+ * Name: dump_tcl
+ * Description: On a SIGHUP, forgets the scripts; the interpreter, and
+ * any globals the scripts have set in it, stay.
+ */
+
+void dump_tcl(void)
+{
+    struct tcl_script *s;
+
+    while ((s = tcl_scripts) != NULL) {
+        tcl_scripts = s->next;
+        Tcl_DeleteCommand(tcl_interp, Tcl_GetString(s->proc));
+        Tcl_DecrRefCount(s->proc);
+        free(s->pathname);
+        free(s);
+    }
+}
+
+#else
+
+int tcl_run(request * req)
+{
+    send_r_error(req);
+    return 0;
+}
+
+int tcl_read(request * req, char *buf, unsigned int len)
+{
+    return 0;
+}
+
+void tcl_forget(request * req)
+{
+}
+
+void dump_tcl(void)
+{
+}
+
+#endif
+
+/*
+ * Name: tcl_alias_add
+ * Description: For a TclAlias line.
+ */
+
+void tcl_alias_add(const char *fakename, const char *realname)
+{
+#ifdef HAVE_TCL
+    add_alias(fakename, realname, TCLALIAS);
+#else
+    log_error_time();
+    fprintf(stderr,
+            "This version of Boa doesn't support TclAlias.\n"
+            "Please build it with Tcl (see src/Makefile).\n");
+#endif
+}
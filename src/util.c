@@ -316,7 +316,8 @@ static int date_to_tm(struct tm *parsed_gmt, const char *cmtime)
         return -1;
     if (parsed_gmt->tm_mon < 0 || parsed_gmt->tm_mon > 11)
         return -1;
-    if (parsed_gmt->tm_year < 70 || parsed_gmt->tm_year > 120)
+    /* 4-digit years only go up to 9999 */
+    if (parsed_gmt->tm_year < 70 || parsed_gmt->tm_year > 9999 - 1900)
         return -1;
 
     return 0;
@@ -365,6 +366,38 @@ int modified_since(time_t * mtime, const char *if_modified_since)
     return 0;
 }
 
+/*
+ * Name: http_date
+ * Description: The time an HTTP date (in any of the forms above)
+ * stands for, as for an Expires header.
+ *
+ * RETURN VALUES:
+ *  the time, or -1 if the date can't be parsed
+ */
+
+time_t http_date(const char *date)
+{
+    struct tm t;
+    long days;
+    int y, m;
+
+    if (date_to_tm(&t, date) != 0)
+        return -1;
+
+    /* timegm() is not everywhere: count the days from 1970, with
+     * years starting in March so that leap days come last */
+    y = t.tm_year + 1900;
+    m = t.tm_mon + 1;
+    if (m <= 2) {
+        y--;
+        m += 12;
+    }
+    days = 365L * y + y / 4 - y / 100 + y / 400 +
+        (153 * (m - 3) + 2) / 5 + t.tm_mday - 719469;
+    return (time_t) days * 86400 + t.tm_hour * 3600 + t.tm_min * 60 +
+        t.tm_sec;
+}
+
 /*
  * Name: to_upper
  *
@@ -502,13 +535,13 @@ void rfc822_time_buf(char *buf, time_t s)
     memcpy(p, day_tab + t->tm_wday * 4, 4);
 }
 
-char *simple_itoa(unsigned int i)
+char *simple_itoa(unsigned long long i)
 {
     /* 21 digits plus null terminator, good for 64-bit or smaller ints
      * for bigger ints, use a bigger buffer!
      *
-     * 4294967295 is, incidentally, MAX_UINT (on 32bit systems at this time)
-     * and is 10 bytes long
+     * 18446744073709551615 is, incidentally, the largest unsigned
+     * 64-bit number, and is 20 bytes long
      */
     static char local[22];
     char *p = &local[21];
@@ -543,6 +576,27 @@ int boa_atoi(const char *s)
     return retval;
 }
 
+/*
+ * Name: boa_atoo
+ * Description: As boa_atoi, for sizes and offsets: all digits, and
+ * no bigger than an off_t holds.
+ */
+
+off_t boa_atoo(const char *s)
+{
+    off_t retval = 0;
+
+    if (!isdigit(*s))
+        return -1;
+
+    for (; isdigit(*s); ++s) {
+        if (retval > (BOA_OFF_MAX - (*s - '0')) / 10)
+            return -1;          /* too big */
+        retval = retval * 10 + (*s - '0');
+    }
+    return (*s == '\0' ? retval : -1);
+}
+
 int create_temporary_file(short want_unlink, char *storage, unsigned int size)
 {
     static char boa_tempfile[MAX_PATH_LENGTH + 1];
@@ -715,7 +769,8 @@ static struct dbg debug_level_table[] = {
     {DEBUG_BODY_READ, "Body Read State"},
     {DEBUG_MMAP_CACHE, "mmap Cache"},
     {DEBUG_REQUEST, "Generic Request"},
-    {DEBUG_HASH, "hash table"}
+    {DEBUG_HASH, "hash table"},
+    {DEBUG_INDEX_CACHE, "Directory listing cache"}
 };
 
 
@@ -0,0 +1,327 @@
+/*
+ *  Boa, an http server
+ *  Copyright (C) 1999-2005 Larry Doolittle <ldoolitt@boa.org>
+ *  Copyright (C) 2000-2005 Jon Nelson <jnelson@boa.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 1, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/* $Id$*/
+
+/*
+ * Cache warming at startup (WarmupManifest, WarmupLog).
+ *
+ * The URLs in the manifest, then the most requested ones in the tail
+ * of the access log, up to WarmupCount of them, go through
+ * translate_uri just as a request would.  The documents they name are
+ * opened (which fills the root directory and negative caches), mapped
+ * through the mmap cache, and given MADV_WILLNEED.  Files too big to
+ * map get POSIX_FADV_WILLNEED on their first StreamingWindow bytes.
+ *
+ * This is done before the first request is accepted; connections made
+ * meanwhile wait in the listen queue.
+ */
+
+#include "boa.h"
+
+struct warm_url {
+    char *uri;
+    unsigned int count;
+    unsigned int next;          /* index + 1 of the next in the bucket */
+};
+
+static struct warm_url *warm_list = NULL;
+static unsigned int warm_list_len = 0, warm_list_size = 0;
+static unsigned int warm_buckets[WARMUP_HASH_SIZE]; /* index + 1 */
+
+static unsigned int warm_files = 0, warm_skipped = 0;
+static unsigned long warm_bytes = 0;
+
+static unsigned int warm_hash(const char *str)
+{
+    unsigned int hash = 2166136261U;
+
+    while (*str) {
+        hash ^= (unsigned char) *str++;
+        hash *= 16777619U;
+    }
+    return hash & (WARMUP_HASH_SIZE - 1);
+}
+
+/*
+ * Name: warm_add
+ * Description: Counts weight more hits on uri.
+ */
+
+static void warm_add(const char *uri, unsigned int weight)
+{
+    unsigned int i, hash = warm_hash(uri);
+
+    for (i = warm_buckets[hash]; i; i = warm_list[i - 1].next) {
+        if (!strcmp(warm_list[i - 1].uri, uri)) {
+            warm_list[i - 1].count += weight;
+            return;
+        }
+    }
+    if (warm_list_len == warm_list_size) {
+        struct warm_url *n;
+        unsigned int size = warm_list_size ? 2 * warm_list_size : 256;
+
+        n = realloc(warm_list, size * sizeof (struct warm_url));
+        if (n == NULL)
+            return;
+        warm_list = n;
+        warm_list_size = size;
+    }
+    warm_list[warm_list_len].uri = strdup(uri);
+    if (warm_list[warm_list_len].uri == NULL)
+        return;
+    warm_list[warm_list_len].count = weight;
+    warm_list[warm_list_len].next = warm_buckets[hash];
+    warm_buckets[hash] = ++warm_list_len;
+}
+
+static int warm_by_count(const void *a, const void *b)
+{
+    const struct warm_url *x = a, *y = b;
+
+    return (x->count < y->count) - (x->count > y->count);
+}
+
+/* one URL per line; # starts a comment */
+static void read_manifest(const char *name)
+{
+    FILE *f = fopen(name, "r");
+    char line[MAX_HEADER_LENGTH + 1];
+    unsigned int weight = UINT_MAX / 2; /* ahead of anything logged */
+
+    if (f == NULL) {
+        log_error_time();
+        perror(name);
+        return;
+    }
+    while (fgets(line, sizeof (line), f)) {
+        char *p = line + strcspn(line, " \t\r\n#");
+
+        *p = '\0';
+        if (line[0] == '/')
+            warm_add(line, weight--); /* and in the order given */
+    }
+    fclose(f);
+}
+
+/*
+ * Name: read_log
+ * Description: Counts the successful GETs in the last WARMUP_LOG_TAIL
+ * bytes of an access log in Boa's (the common) format.
+ */
+
+static void read_log(const char *name)
+{
+    FILE *f = fopen(name, "r");
+    char line[MAX_HEADER_LENGTH + 512];
+    long size;
+
+    if (f == NULL) {
+        log_error_time();
+        perror(name);
+        return;
+    }
+    if (fseek(f, 0, SEEK_END) == 0 && (size = ftell(f)) > WARMUP_LOG_TAIL) {
+        fseek(f, size - WARMUP_LOG_TAIL, SEEK_SET);
+        fgets(line, sizeof (line), f); /* the rest of a line */
+    } else
+        rewind(f);
+
+    while (fgets(line, sizeof (line), f)) {
+        char *uri, *end;
+        int status;
+
+        /* ... "GET /uri HTTP/1.1" 200 ... */
+        uri = strstr(line, "\"GET ");
+        if (uri == NULL)
+            continue;
+        uri += 5;
+        end = strchr(uri, ' ');
+        if (end == NULL || *uri != '/')
+            continue;
+        *end = '\0';
+        end = strchr(end + 1, '"');
+        if (end == NULL || sscanf(end + 1, "%d", &status) != 1 ||
+            !(status == 200 || status == 206 || status == 304))
+            continue;
+        warm_add(uri, 1);
+    }
+    fclose(f);
+}
+
+/*
+ * Name: warm_document
+ * Description: Opens what req was translated to, and pulls it in.
+ */
+
+static void warm_document(request * req)
+{
+    struct stat statbuf;
+    int data_fd;
+
+    data_fd = negative_open(req, req->pathname);
+    if (data_fd == -1 || fstat(data_fd, &statbuf) == -1) {
+        warm_skipped++;
+        goto out;
+    }
+    if (S_ISDIR(statbuf.st_mode) && directory_index &&
+        req->pathname[strlen(req->pathname) - 1] == '/') {
+        char index[MAX_PATH_LENGTH];
+
+        close(data_fd);
+        if ((unsigned) snprintf(index, sizeof (index), "%s%s",
+                                req->pathname, directory_index)
+            >= sizeof (index) ||
+            (data_fd = negative_open(req, index)) == -1 ||
+            fstat(data_fd, &statbuf) == -1) {
+            warm_skipped++;
+            goto out;
+        }
+    }
+    if (!S_ISREG(statbuf.st_mode) || statbuf.st_size == 0) {
+        warm_skipped++;
+        goto out;
+    }
+
+    if ((unsigned long) statbuf.st_size <= max_file_mmap) {
+        struct mmap_entry *e = find_mmap(data_fd, &statbuf);
+
+        if (e) {
+#if defined(HAVE_MADVISE) && defined(MADV_WILLNEED)
+            madvise(e->mmap, e->len, MADV_WILLNEED);
+#endif
+            release_mmap(e);    /* stays mapped if MmapLockSize pinned it */
+        }
+        warm_bytes += statbuf.st_size;
+    } else {
+        off_t len = statbuf.st_size;
+
+        if (len > (off_t) stream_window)
+            len = stream_window;
+#ifdef POSIX_FADV_WILLNEED
+        posix_fadvise(data_fd, 0, len, POSIX_FADV_WILLNEED);
+#endif
+        warm_bytes += len;
+    }
+    warm_files++;
+
+  out:
+    if (data_fd != -1)
+        close(data_fd);
+}
+
+/*
+ * Name: warmup
+ * Description: Called once, just before the main loop.
+ */
+
+void warmup(void)
+{
+    request *req;
+    struct timeval start, end;
+    unsigned int i, n, step;
+    int sink[2] = { -1, -1 };
+
+    if (warmup_manifest == NULL && warmup_log == NULL)
+        return;
+    if (virtualhost || vhost_root) {
+        /* which address or host would a URL be for? */
+        log_error_time();
+        fputs("warmup: not done with VirtualHost or VHostRoot\n", stderr);
+        return;
+    }
+
+    gettimeofday(&start, NULL);
+    if (warmup_manifest)
+        read_manifest(warmup_manifest);
+    if (warmup_log)
+        read_log(warmup_log);
+    qsort(warm_list, warm_list_len, sizeof (struct warm_url),
+          warm_by_count);
+    n = (warm_list_len < warmup_count ? warm_list_len : warmup_count);
+
+    /* translate_uri may answer (a 404 or a redirect, say): that goes
+     * nowhere, but it is sent, so it has to be a socket.  Its other end
+     * is emptied after each URL, and neither end blocks, so a full one
+     * just drops the answer rather than holding up the startup. */
+    req = malloc(sizeof (request));
+    if (req == NULL || socketpair(AF_UNIX, SOCK_STREAM, 0, sink) == -1 ||
+        set_nonblock_fd(sink[0]) == -1 || set_nonblock_fd(sink[1]) == -1) {
+        log_error_time();
+        perror("warmup");
+        n = 0;
+    }
+
+    log_error_time();
+    fprintf(stderr, "warmup: %u URLs\n", n);
+    step = (n >= 100 ? n / 10 : n); /* every 10%, if it's worth it */
+    for (i = 0; i < n; ++i) {
+        memset(req, 0, sizeof (request));
+        req->fd = sink[0];
+        req->method = M_GET;
+        req->http_version = HTTP10;
+        req->time_last = current_time;
+        strncpy(req->request_uri, warm_list[i].uri, MAX_HEADER_LENGTH);
+
+        if (unescape_uri(req->request_uri, &req->query_string) == 0) {
+            warm_skipped++;
+        } else {
+            clean_pathname(req->request_uri);
+            if (!translate_uri(req) || req->cgi_type ||
+                req->pack_entry_var)
+                warm_skipped++; /* not there, a script, or in the pack */
+            else
+                warm_document(req);
+        }
+        free(req->pathname);
+        free(req->script_name);
+        free(req->path_info);
+        free(req->path_translated);
+        while (read(sink[1], req->buffer, BUFFER_SIZE) > 0)
+            ;
+
+        if ((i + 1) % step == 0 && i + 1 < n) {
+            log_error_time();
+            fprintf(stderr, "warmup: %u of %u URLs, %lu KB\n",
+                    i + 1, n, warm_bytes / 1024);
+        }
+    }
+
+    gettimeofday(&end, NULL);
+    log_error_time();
+    fprintf(stderr, "warmup: done, %u files (%lu KB), %u skipped, "
+            "in %ld ms\n", warm_files, warm_bytes / 1024, warm_skipped,
+            (long) ((end.tv_sec - start.tv_sec) * 1000 +
+                    (end.tv_usec - start.tv_usec) / 1000));
+
+    free(req);
+    if (sink[0] != -1) {
+        close(sink[0]);
+        close(sink[1]);
+    }
+    for (i = 0; i < warm_list_len; ++i)
+        free(warm_list[i].uri);
+    free(warm_list);
+    warm_list = NULL;
+    warm_list_len = warm_list_size = 0;
+    memset(warm_buckets, 0, sizeof (warm_buckets));
+}